@@ -0,0 +1,38 @@
+#!/bin/sh
+##
+##	End-to-end benchmark of wmdia on a private Xvfb.
+##
+##	Usage: bench.sh [wmdiabench options] [scenario...]
+##	The results are written as JSON to stdout.
+##
+
+## directory for the display number, sockets, slides and thumbnail cache
+dir=`mktemp -d /tmp/wmdia-bench.XXXXXX` || exit 1
+xvfb=
+
+cleanup() {
+    [ -n "$xvfb" ] && kill $xvfb 2>/dev/null && wait $xvfb 2>/dev/null
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+##
+##	Start Xvfb on a free display, it writes the display number to fd 3.
+##
+Xvfb -displayfd 3 -screen 0 640x480x24 -nolisten tcp \
+	3>"$dir/display" >/dev/null 2>&1 &
+xvfb=$!
+i=0
+while [ ! -s "$dir/display" ]; do
+    i=$((i + 1))
+    if [ $i -gt 100 ] || ! kill -0 $xvfb 2>/dev/null; then
+	echo "bench.sh: Xvfb didn't start" >&2
+	exit 1
+    fi
+    sleep 0.1
+done
+
+## empty home: cold thumbnail cache, no user configuration
+DISPLAY=:`cat "$dir/display"` XDG_RUNTIME_DIR="$dir" HOME="$dir" \
+	XDG_CACHE_HOME= ${WMDIABENCH:-./wmdiabench} "$@"
@@ -0,0 +1,387 @@
+///
+///	@file cache.c		@brief	Thumbnail cache module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Cache The thumbnail cache module.
+///
+///	Scaled dias are kept in a single memory mapped file
+///	($XDG_CACHE_HOME/wmdia/dias), so after the first pass a slide costs
+///	a page cache hit and one upload, nothing is decoded.
+///
+///	The file is a set associative hash table: a header, #CACHE_WAYS
+///	entries per set and one dia of native pixels per entry.  An image
+///	is keyed by hash of its path, its size and its mtime, a changed
+///	file simply misses.  Each set evicts its least recently used
+///	entry.  The number of sets follows from #CacheBudget.
+///
+///	Several wmdia can share the file, writers take an exclusive flock,
+///	readers a shared one.  flock doesn't exclude threads, inside one
+///	process only the slide worker uses the cache.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include <xcb/xcb.h>
+
+#include "wmdia.h"
+#include "cache.h"
+#include "stats.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define CACHE_MAGIC	0x43444D57	///< "WMDC" little endian
+#define CACHE_VERSION	1		///< version of the file layout
+#define CACHE_WAYS	8		///< entries per set
+
+    /// bytes of one cached dia
+#define CACHE_DIA_SIZE	(DIA_SIZE * DIA_SIZE * 4)
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Cache file header.
+///
+typedef struct _cache_header_
+{
+    uint32_t Magic;			///< #CACHE_MAGIC
+    uint32_t Version;			///< #CACHE_VERSION
+    uint32_t Sets;			///< number of sets
+    uint32_t Ways;			///< entries per set
+    uint32_t DiaSize;			///< bytes per dia
+    uint32_t Format;			///< pixel of 0x123456 in our visual
+    uint32_t Depth;			///< depth of our visual
+    uint32_t Clock;			///< LRU clock
+} CacheHeader;
+
+///
+///	Cache entry.
+///
+typedef struct _cache_entry_
+{
+    uint64_t Key;			///< hash of path
+    uint64_t Size;			///< file size of image
+    int64_t Mtime;			///< mtime of image in ns
+    uint32_t Used;			///< LRU clock of last use, 0 empty
+    uint32_t Reserved;			///< pad entry to 32 bytes
+} CacheEntry;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+unsigned CacheBudget = 64 * 1024 * 1024;	///< cache file size in bytes
+
+static int CacheFd = -1;		///< cache file
+static uint8_t *CacheAddr;		///< mapped cache file
+static size_t CacheSize;		///< size of mapped cache file
+static CacheHeader *CacheHead;		///< header of cache file
+static CacheEntry *CacheEntries;	///< entries of cache file
+static uint8_t *CacheDias;		///< dias of cache file
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Hash path (FNV-1a).
+**
+**	@param path	file name
+**
+**	@returns non-zero hash of path.
+*/
+uint64_t CacheHash(const char *path)
+{
+    uint64_t hash;
+
+    hash = 0xCBF29CE484222325ULL;
+    while (*path) {
+	hash ^= (uint8_t) * path++;
+	hash *= 0x100000001B3ULL;
+    }
+    return hash ? hash : 1;
+}
+
+/**
+**	Find entry of image.
+**
+**	@param key	hash of path
+**	@param st	stat of image
+**
+**	@returns entry index, -1 if not cached.
+*/
+static int CacheFind(uint64_t key, const struct stat *st)
+{
+    const CacheEntry *entry;
+    int64_t mtime;
+    int set;
+    int i;
+
+    mtime = st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+    set = key % CacheHead->Sets;
+    for (i = set * CACHE_WAYS; i < (set + 1) * CACHE_WAYS; ++i) {
+	entry = CacheEntries + i;
+	if (entry->Used && entry->Key == key
+	    && entry->Size == (uint64_t) st->st_size && entry->Mtime == mtime) {
+	    return i;
+	}
+    }
+    return -1;
+}
+
+/**
+**	Get cached dia of image.
+**
+**	@param path		file name of image
+**	@param st		stat of image
+**	@param[out] dia		#DIA_SIZE x #DIA_SIZE native pixels
+**	@param stride		pixels per dia line
+**
+**	@returns true if the dia was cached.
+*/
+int CacheGet(const char *path, const struct stat *st, uint32_t * dia,
+    int stride)
+{
+    const uint32_t *src;
+    uint64_t trace;
+    int i;
+    int y;
+
+    if (!CacheAddr) {
+	return 0;
+    }
+    trace = TraceBegin();
+    flock(CacheFd, LOCK_SH);
+    if ((i = CacheFind(CacheHash(path), st)) >= 0) {
+	src = (const uint32_t *)(CacheDias + i * CACHE_DIA_SIZE);
+	for (y = 0; y < DIA_SIZE; ++y) {
+	    memcpy(dia + y * stride, src + y * DIA_SIZE, DIA_SIZE * 4);
+	}
+	// other readers may run, the clock is only a hint
+	__atomic_store_n(&CacheEntries[i].Used,
+	    __atomic_add_fetch(&CacheHead->Clock, 1, __ATOMIC_RELAXED),
+	    __ATOMIC_RELAXED);
+    }
+    flock(CacheFd, LOCK_UN);
+    StatsAdd(i >= 0 ? StatsCacheHits : StatsCacheMisses, 1);
+    TraceEnd("cache get", trace, i >= 0);
+
+    return i >= 0;
+}
+
+/**
+**	Store dia of image in cache.
+**
+**	@param path	file name of image
+**	@param st	stat of image
+**	@param dia	#DIA_SIZE x #DIA_SIZE native pixels
+**	@param stride	pixels per dia line
+*/
+void CachePut(const char *path, const struct stat *st, const uint32_t * dia,
+    int stride)
+{
+    CacheEntry *entry;
+    uint32_t *dst;
+    uint64_t key;
+    int set;
+    int i;
+    int y;
+
+    if (!CacheAddr) {
+	return;
+    }
+    key = CacheHash(path);
+    flock(CacheFd, LOCK_EX);
+    if (CacheFind(key, st) < 0) {	// not stored by another wmdia
+	// empty or least recently used entry of the set
+	set = key % CacheHead->Sets;
+	entry = CacheEntries + set * CACHE_WAYS;
+	for (i = 1; i < CACHE_WAYS && entry->Used; ++i) {
+	    if (CacheEntries[set * CACHE_WAYS + i].Used < entry->Used) {
+		entry = CacheEntries + set * CACHE_WAYS + i;
+	    }
+	}
+	i = entry - CacheEntries;
+
+	dst = (uint32_t *) (CacheDias + i * CACHE_DIA_SIZE);
+	for (y = 0; y < DIA_SIZE; ++y) {
+	    memcpy(dst + y * DIA_SIZE, dia + y * stride, DIA_SIZE * 4);
+	}
+	entry->Key = key;
+	entry->Size = st->st_size;
+	entry->Mtime = st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+	entry->Used = ++CacheHead->Clock;
+    }
+    flock(CacheFd, LOCK_UN);
+}
+
+/**
+**	Get file name in the wmdia cache directory.
+**
+**	$XDG_CACHE_HOME/wmdia or ~/.cache/wmdia, it is created if missing.
+**
+**	@param[out] path	file name
+**	@param size		size of path buffer
+**	@param name		file name in cache directory
+**
+**	@returns -1 if there is no cache directory, 0 otherwise.
+*/
+int CacheFile(char *path, size_t size, const char *name)
+{
+    const char *dir;
+
+    if ((dir = getenv("XDG_CACHE_HOME")) && *dir) {
+	snprintf(path, size, "%s/wmdia", dir);
+    } else if ((dir = getenv("HOME"))) {
+	snprintf(path, size, "%s/.cache", dir);
+	mkdir(path, 0700);
+	snprintf(path, size, "%s/.cache/wmdia", dir);
+    } else {
+	return -1;
+    }
+    mkdir(path, 0700);
+    strncat(path, "/", size - strlen(path) - 1);
+    strncat(path, name, size - strlen(path) - 1);
+
+    return 0;
+}
+
+/**
+**	Open thumbnail cache.
+**
+**	A cache file of other layout, size or visual is replaced by a new
+**	file.  It is built under a temporary name and renamed into place,
+**	other wmdia keep their mapping of the old file.
+*/
+void CacheInit(void)
+{
+    char path[1024];
+    char tmp[1040];
+    CacheHeader head;
+    struct stat st;
+    size_t entries;
+    uint32_t sets;
+    int fd;
+
+    sets = CacheBudget / (CACHE_WAYS * (sizeof(CacheEntry) + CACHE_DIA_SIZE));
+    if (!sets) {
+	return;
+    }
+
+    if (CacheFile(path, sizeof(path), "dias")) {
+	return;
+    }
+
+    memset(&head, 0, sizeof(head));
+    head.Magic = CACHE_MAGIC;
+    head.Version = CACHE_VERSION;
+    head.Sets = sets;
+    head.Ways = CACHE_WAYS;
+    head.DiaSize = CACHE_DIA_SIZE;
+    head.Format = RgbPixel(0x12, 0x34, 0x56);
+    head.Depth = Screen->root_depth;
+
+    // dias are page aligned
+    entries = sizeof(CacheHeader) + sets * CACHE_WAYS * sizeof(CacheEntry);
+    entries = (entries + 4095) & ~4095;
+    CacheSize = entries + (size_t)sets * CACHE_WAYS * CACHE_DIA_SIZE;
+
+    CacheAddr = MAP_FAILED;
+    if ((fd = open(path, O_RDWR | O_CLOEXEC)) >= 0) {
+	flock(fd, LOCK_SH);
+	if (!fstat(fd, &st) && (size_t)st.st_size == CacheSize) {
+	    CacheAddr = mmap(NULL, CacheSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	    // clock isn't part of the layout
+	    if (CacheAddr != MAP_FAILED
+		&& memcmp(CacheAddr, &head, offsetof(CacheHeader, Clock))) {
+		munmap(CacheAddr, CacheSize);
+		CacheAddr = MAP_FAILED;
+	    }
+	}
+	flock(fd, LOCK_UN);
+	if (CacheAddr == MAP_FAILED) {
+	    close(fd);
+	    fd = -1;
+	}
+    }
+    if (fd < 0) {			// new or incompatible: replace
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+		    0600)) >= 0 && !ftruncate(fd, CacheSize)
+	    && (CacheAddr = mmap(NULL, CacheSize, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0)) != MAP_FAILED) {
+	    memcpy(CacheAddr, &head, sizeof(head));
+	}
+	if (CacheAddr == MAP_FAILED || rename(tmp, path)) {
+	    fprintf(stderr, "cache: can't create '%s': %s\n", path,
+		strerror(errno));
+	    if (CacheAddr != MAP_FAILED) {
+		munmap(CacheAddr, CacheSize);
+	    }
+	    if (fd >= 0) {
+		close(fd);
+		unlink(tmp);
+	    }
+	    CacheAddr = NULL;
+	    return;
+	}
+    }
+
+    CacheFd = fd;
+    CacheHead = (CacheHeader *) CacheAddr;
+    CacheEntries = (CacheEntry *) (CacheAddr + sizeof(CacheHeader));
+    CacheDias = CacheAddr + entries;
+}
+
+/**
+**	Close thumbnail cache.
+*/
+void CacheExit(void)
+{
+    if (CacheAddr) {
+	munmap(CacheAddr, CacheSize);
+	CacheAddr = NULL;
+    }
+    if (CacheFd >= 0) {
+	close(CacheFd);
+	CacheFd = -1;
+    }
+}
@@ -0,0 +1,57 @@
+///
+///	@file cache.h		@brief	Thumbnail cache module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Cache
+/// @{
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern unsigned CacheBudget;		///< cache file size in bytes, 0 off
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Hash path.
+extern uint64_t CacheHash(const char *);
+
+    /// Get file name in the wmdia cache directory.
+extern int CacheFile(char *, size_t, const char *);
+
+    /// Get cached dia of image.
+extern int CacheGet(const char *, const struct stat *, uint32_t *, int);
+
+    /// Store dia of image in cache.
+extern void CachePut(const char *, const struct stat *, const uint32_t *,
+    int);
+
+    /// Open thumbnail cache.
+extern void CacheInit(void);
+
+    /// Close thumbnail cache.
+extern void CacheExit(void);
+
+/// @}
@@ -0,0 +1,684 @@
+///
+///	@file control.c		@brief	Control socket module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Control The control socket module.
+///
+///	Scripts update a dock through the unix stream socket
+///	$XDG_RUNTIME_DIR/wmdia-<name>.sock instead of running display,
+///	xprop and xwininfo for each update.  Commands are lines, a batch
+///	of commands ends with an empty line or the end of the connection:
+///
+///		image <path>	show image file as dia
+///		raw		show the following 64x64 BGRX (16384 bytes)
+///		tooltip <text>	set TOOLTIP, \\n is a newline
+///		command <text>	set COMMAND
+///		next		show next slide
+///		prev		show previous slide
+///		stats		append the runtime statistics to "ok"
+///
+///	A batch is checked and prepared completely, before anything is
+///	applied.  It is applied with one X11 flush and answered with "ok"
+///	or "error <line>: <reason>".  Nothing is applied on error.  Images
+///	are decoded on the slide worker, meanwhile the client isn't read
+///	and the event loop continues.
+///
+///	Example: printf 'image a.jpg\ntooltip a.jpg\n\n' |
+///		socat - UNIX-CONNECT:$XDG_RUNTIME_DIR/wmdia-wmdia.sock
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <xcb/xcb.h>
+
+#include "wmdia.h"
+#include "slide.h"
+#include "control.h"
+#include "stats.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define CONTROL_CLIENTS	8		///< max. connected clients
+#define CONTROL_BATCH	(256 * 1024)	///< max. bytes of one batch
+
+    /// bytes of a raw frame
+#define CONTROL_RAW_SIZE	(DOCK_SIZE * DOCK_SIZE * 4)
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Control socket of one dock.
+///
+struct _control_socket_
+{
+    Dock *Dock;				///< controlled dock
+    int Fd;				///< listening socket, -1 if not open
+    char *Path;				///< file name of socket
+};
+
+///
+///	Connected control client.
+///
+typedef struct _control_client_
+{
+    ControlSocket *Socket;		///< socket the client connected to
+    int Fd;				///< connection
+    char *Buffer;			///< received, not yet executed bytes
+    int Fill;				///< bytes in buffer
+    char Eof;				///< client closed the connection
+    struct _control_batch_ *Pending;	///< batch waiting for its image
+    int PendingLen;			///< bytes of the pending batch
+} ControlClient;
+
+///
+///	Prepared batch, applied after all commands are checked.
+///
+typedef struct _control_batch_
+{
+    char HasFrame;			///< new dock contents
+    char HasTooltip;			///< new TOOLTIP
+    char HasCommand;			///< new COMMAND
+    char HasStats;			///< statistics requested
+    int Step;				///< sum of next (+1) and prev (-1)
+    const char *Image;			///< image file to decode or NULL
+    int ImageLine;			///< line number of the image command
+    uint64_t Trace;			///< start of the batch span
+    const char *Tooltip;		///< tooltip text, unescaped
+    int TooltipLen;			///< length of tooltip
+    const char *Command;		///< command text
+    int CommandLen;			///< length of command
+    uint32_t Pixels[DOCK_SIZE * DOCK_SIZE];	///< new dock contents
+} ControlBatch;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+static ControlSocket **ControlSockets;	///< sockets of all docks
+static int ControlSocketCount;		///< number of sockets
+
+static ControlClient ControlClients[CONTROL_CLIENTS];	///< connections
+static int ControlClientCount;		///< used entries of ControlClients
+
+static void ControlEvent(void);		///< forward define for ControlDecoded
+    /// forward define for ControlExecute
+static void ControlDecoded(void *, int);
+
+//----------------------------------------------------------------------------
+//	Batch
+//----------------------------------------------------------------------------
+
+/**
+**	Find the end of the first complete batch.
+**
+**	Skips the binary payload of raw commands.
+**
+**	@param buf	received bytes
+**	@param len	number of bytes
+**	@param eof	client closed the connection, rest is a batch
+**
+**	@returns length of the batch including its empty line, 0 if
+**	incomplete.
+*/
+static int ControlBatchEnd(const char *buf, int len, int eof)
+{
+    const char *nl;
+    int pos;
+
+    for (pos = 0; pos < len;) {
+	if (!(nl = memchr(buf + pos, '\n', len - pos))) {
+	    break;
+	}
+	if (nl == buf + pos) {		// empty line ends the batch
+	    return pos + 1;
+	}
+	if (nl - (buf + pos) == 3 && !memcmp(buf + pos, "raw", 3)) {
+	    pos += 4 + CONTROL_RAW_SIZE;
+	    if (pos > len) {
+		return eof ? len : 0;
+	    }
+	    continue;
+	}
+	pos = nl + 1 - buf;
+    }
+    return eof ? len : 0;
+}
+
+/**
+**	Unescape text of a command in place.
+**
+**	@param text	text, \\n is a newline and \\\\ a backslash
+**	@param len	length of text
+**
+**	@returns length of the unescaped text.
+*/
+static int ControlUnescape(char *text, int len)
+{
+    char *d;
+    int i;
+
+    d = text;
+    for (i = 0; i < len; ++i) {
+	if (text[i] == '\\' && i + 1 < len) {
+	    ++i;
+	    *d++ = text[i] == 'n' ? '\n' : text[i];
+	    continue;
+	}
+	*d++ = text[i];
+    }
+    return d - text;
+}
+
+/**
+**	Check and prepare all commands of a batch.
+**
+**	@param batch	prepared batch
+**	@param buf	commands of the batch, modified
+**	@param len	length of the batch
+**	@param[out] error	reason of an error
+**
+**	@returns line number of the bad command, 0 if the batch is good.
+*/
+static int ControlPrepare(ControlBatch * batch, char *buf, int len,
+    const char **error)
+{
+    const uint8_t *raw;
+    char *line;
+    char *arg;
+    char *nl;
+    char *end;
+    int lineno;
+    int n;
+    int i;
+
+    end = buf + len;
+    lineno = 0;
+    for (line = buf; line < end; line = nl + 1) {
+	++lineno;
+	if (!(nl = memchr(line, '\n', end - line))) {
+	    nl = end;			// last line without newline at eof
+	}
+	*nl = '\0';
+	if (line == nl) {
+	    break;
+	}
+	n = (arg = strchr(line, ' ')) ? arg - line : nl - line;
+	arg = arg ? arg + 1 : nl;
+
+	if (n == 5 && !strncmp(line, "image", 5)) {
+	    // the border of the dia is darkgray, the worker decodes the dia
+	    for (i = 0; i < DOCK_SIZE * DOCK_SIZE; ++i) {
+		batch->Pixels[i] = RgbPixel(0xA9, 0xA9, 0xA9);
+	    }
+	    batch->Image = arg;
+	    batch->ImageLine = lineno;
+	    batch->HasFrame = 1;
+	} else if (n == 3 && arg == nl && !strncmp(line, "raw", 3)) {
+	    // bare raw line only, ControlBatchEnd skips the same frame
+	    if (end - (nl + 1) < CONTROL_RAW_SIZE) {
+		*error = "short raw frame";
+		return lineno;
+	    }
+	    raw = (const uint8_t *)nl + 1;
+	    for (i = 0; i < DOCK_SIZE * DOCK_SIZE; ++i, raw += 4) {
+		batch->Pixels[i] = NativeRgb ? (uint32_t) (raw[2] << 16)
+		    | (raw[1] << 8) | raw[0] : RgbPixel(raw[2], raw[1], raw[0]);
+	    }
+	    batch->Image = NULL;	// the last frame wins
+	    batch->HasFrame = 1;
+	    nl += CONTROL_RAW_SIZE;
+	} else if (n == 7 && !strncmp(line, "tooltip", 7)) {
+	    batch->Tooltip = arg;
+	    batch->TooltipLen = ControlUnescape(arg, nl - arg);
+	    batch->HasTooltip = 1;
+	} else if (n == 7 && !strncmp(line, "command", 7)) {
+	    batch->Command = arg;
+	    batch->CommandLen = nl - arg;
+	    batch->HasCommand = 1;
+	} else if (n == 4 && !strncmp(line, "next", 4)) {
+	    batch->Step++;
+	} else if (n == 4 && !strncmp(line, "prev", 4)) {
+	    batch->Step--;
+	} else if (n == 5 && !strncmp(line, "stats", 5)) {
+	    batch->HasStats = 1;
+	} else {
+	    *error = "unknown command";
+	    return lineno;
+	}
+    }
+    return 0;
+}
+
+/**
+**	Apply prepared batch to the dock.
+**
+**	All requests are sent with one flush.
+**
+**	@param dock	controlled dock
+**	@param batch	prepared batch
+*/
+static void ControlApply(Dock * dock, const ControlBatch * batch)
+{
+    int i;
+
+    if (!dock->Window) {		// destroyed
+	return;
+    }
+    for (i = batch->Step; i > 0; --i) {
+	SlideStep(dock, 1);
+    }
+    for (i = batch->Step; i < 0; ++i) {
+	SlideStep(dock, -1);
+    }
+    if (batch->HasFrame) {
+	PutFrame(dock, batch->Pixels, DOCK_SIZE);
+    }
+    if (batch->HasTooltip) {
+	xcb_change_property(Connection, XCB_PROP_MODE_REPLACE, dock->Window,
+	    TooltipAtom, XCB_ATOM_STRING, 8, batch->TooltipLen,
+	    batch->Tooltip);
+    }
+    if (batch->HasCommand) {
+	xcb_change_property(Connection, XCB_PROP_MODE_REPLACE, dock->Window,
+	    CommandAtom, XCB_ATOM_STRING, 8, batch->CommandLen,
+	    batch->Command);
+    }
+    xcb_flush(Connection);
+}
+
+//----------------------------------------------------------------------------
+//	Clients
+//----------------------------------------------------------------------------
+
+/**
+**	Disconnect client.
+**
+**	A batch waiting for its image is freed, when the worker is done.
+**
+**	@param client	connected client
+*/
+static void ControlDisconnect(ControlClient * client)
+{
+    LoopDelFd(client->Fd);
+    close(client->Fd);
+    free(client->Buffer);
+    *client = ControlClients[--ControlClientCount];
+}
+
+/**
+**	Apply or reject a prepared batch and answer the client.
+**
+**	@param client	connected client
+**	@param batch	prepared batch, freed
+**	@param len	bytes of the batch in the client buffer
+**	@param lineno	line number of the bad command, 0 if good
+**	@param error	reason of the error
+*/
+static void ControlFinish(ControlClient * client, ControlBatch * batch,
+    int len, int lineno, const char *error)
+{
+    char reply[STATS_SIZE + 8];
+    ssize_t n;
+
+    if (lineno) {
+	snprintf(reply, sizeof(reply), "error %d: %s\n", lineno, error);
+    } else {
+	ControlApply(client->Socket->Dock, batch);
+	strcpy(reply, "ok\n");
+	if (batch->HasStats) {
+	    StatsFormat(reply + 3, sizeof(reply) - 3);
+	}
+    }
+    TraceEnd("control batch", batch->Trace, lineno);
+    free(batch);
+    // the reply fits into the socket buffer, a full one drops it
+    n = write(client->Fd, reply, strlen(reply));
+    (void)n;
+    memmove(client->Buffer, client->Buffer + len, client->Fill - len);
+    client->Fill -= len;
+}
+
+/**
+**	Execute complete batches of a client.
+**
+**	A batch with an image stops the execution, until the image is
+**	decoded.
+**
+**	@param client	connected client
+*/
+static void ControlExecute(ControlClient * client)
+{
+    ControlBatch *batch;
+    const char *error;
+    int len;
+    int lineno;
+
+    while (!client->Pending && client->Fill
+	&& (len = ControlBatchEnd(client->Buffer, client->Fill,
+		client->Eof))) {
+	if (!(batch = calloc(1, sizeof(*batch)))) {
+	    return;
+	}
+	batch->Trace = TraceBegin();
+	error = NULL;
+	lineno = ControlPrepare(batch, client->Buffer, len, &error);
+	if (!lineno && batch->Image) {
+	    if (!SlideDecode(batch->Image, batch->Pixels + DOCK_SIZE + 1,
+		    DOCK_SIZE, ControlDecoded, batch)) {
+		// not read, until the batch is done
+		LoopDelFd(client->Fd);
+		client->Pending = batch;
+		client->PendingLen = len;
+		return;
+	    }
+	    lineno = batch->ImageLine;
+	    error = "can't load image";
+	}
+	ControlFinish(client, batch, len, lineno, error);
+    }
+}
+
+/**
+**	Finish batch, whose image was decoded by the slide worker.
+**
+**	Called from the event loop.  The client continues with its next
+**	batch, or is disconnected after its last one.
+**
+**	@param opaque	pending batch
+**	@param ok	image could be loaded
+*/
+static void ControlDecoded(void *opaque, int ok)
+{
+    ControlClient *client;
+    ControlBatch *batch;
+    int i;
+
+    batch = opaque;
+    for (i = 0; i < ControlClientCount; ++i) {
+	if (ControlClients[i].Pending == batch) {
+	    break;
+	}
+    }
+    if (i == ControlClientCount) {	// client is gone
+	free(batch);
+	return;
+    }
+    client = ControlClients + i;
+    client->Pending = NULL;
+    ControlFinish(client, batch, client->PendingLen,
+	ok ? 0 : batch->ImageLine, "can't load image");
+    ControlExecute(client);
+    if (client->Pending) {
+	return;
+    }
+    if (client->Eof || LoopAddFd(client->Fd, ControlEvent)) {
+	ControlDisconnect(client);
+    }
+}
+
+/**
+**	Read from client.
+**
+**	@param client	connected client
+**
+**	@returns true if the client is disconnected.
+*/
+static int ControlRead(ControlClient * client)
+{
+    int n;
+
+    for (;;) {
+	if (client->Fill == CONTROL_BATCH) {
+	    n = write(client->Fd, "error 0: batch too big\n", 23);
+	    (void)n;
+	    ControlDisconnect(client);
+	    return 1;
+	}
+	n = read(client->Fd, client->Buffer + client->Fill,
+	    CONTROL_BATCH - client->Fill);
+	if (n > 0) {
+	    client->Fill += n;
+	    ControlExecute(client);
+	    if (client->Pending) {
+		return 0;
+	    }
+	    continue;
+	}
+	if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+	    return 0;
+	}
+	client->Eof = 1;		// eof or error
+	ControlExecute(client);
+	if (client->Pending) {		// disconnected, when done
+	    return 0;
+	}
+	ControlDisconnect(client);
+	return 1;
+    }
+}
+
+/**
+**	Handle control sockets and clients.
+**
+**	Called from the event loop.  The handler is shared by all sockets
+**	and clients, each one is read until it would block.
+*/
+static void ControlEvent(void)
+{
+    ControlClient *client;
+    int fd;
+    int i;
+
+    for (i = 0; i < ControlSocketCount; ++i) {
+	while ((fd = accept(ControlSockets[i]->Fd, NULL, NULL)) >= 0) {
+	    if (ControlClientCount == CONTROL_CLIENTS) {
+		close(fd);
+		continue;
+	    }
+	    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	    fcntl(fd, F_SETFD, FD_CLOEXEC);
+	    client = ControlClients + ControlClientCount;
+	    // one more byte, the last line of a batch is terminated
+	    if (!(client->Buffer = malloc(CONTROL_BATCH + 1))) {
+		close(fd);
+		continue;
+	    }
+	    client->Socket = ControlSockets[i];
+	    client->Fd = fd;
+	    client->Fill = 0;
+	    client->Eof = 0;
+	    client->Pending = NULL;
+	    if (LoopAddFd(fd, ControlEvent)) {
+		free(client->Buffer);
+		close(fd);
+		continue;
+	    }
+	    ControlClientCount++;
+	}
+    }
+    for (i = 0; i < ControlClientCount;) {
+	// clients waiting for an image aren't read
+	if (ControlClients[i].Pending || !ControlRead(ControlClients + i)) {
+	    ++i;			// disconnect moves the last client
+	}
+    }
+}
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Remove control socket.
+**
+**	@param control	control socket
+*/
+static void ControlDel(ControlSocket * control)
+{
+    int i;
+
+    for (i = 0; i < ControlClientCount;) {
+	if (ControlClients[i].Socket == control) {
+	    ControlDisconnect(ControlClients + i);
+	    continue;
+	}
+	++i;
+    }
+    if (control->Fd >= 0) {
+	LoopDelFd(control->Fd);
+	close(control->Fd);
+	unlink(control->Path);
+    }
+    free(control->Path);
+    free(control);
+}
+
+/**
+**	Create the control socket of a dock.
+**
+**	@param dock	controlled dock, Dock::Name names the socket
+**
+**	@returns -1 on error, 0 otherwise.
+*/
+int ControlInit(Dock * dock)
+{
+    ControlSocket *control;
+    ControlSocket **sockets;
+    struct sockaddr_un addr;
+    const char *dir;
+    mode_t mask;
+    int err;
+
+    if (!(dir = getenv("XDG_RUNTIME_DIR"))) {
+	dir = "/tmp";
+    }
+    if (!(control = calloc(1, sizeof(*control)))) {
+	return -1;
+    }
+    control->Dock = dock;
+    control->Fd = -1;
+    if (!(control->Path =
+	    malloc(strlen(dir) + strlen(dock->Name) + sizeof("/wmdia-.sock")))) {
+	goto error;
+    }
+    sprintf(control->Path, "%s/wmdia-%s.sock", dir, dock->Name);
+    if (strlen(control->Path) >= sizeof(addr.sun_path)) {
+	fprintf(stderr, "control: socket name '%s' too long\n",
+	    control->Path);
+	goto error;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, control->Path);
+    unlink(control->Path);		// stale socket of a crashed wmdia
+    control->Fd =
+	socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    // the socket is created 0600, COMMAND set by others would run on click
+    err = control->Fd < 0;
+    if (!err) {
+	mask = umask(077);
+	err = bind(control->Fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+    }
+    if (err || listen(control->Fd, CONTROL_CLIENTS)) {
+	fprintf(stderr, "control: can't create '%s'\n", control->Path);
+	goto error;
+    }
+
+    if (!(sockets =
+	    realloc(ControlSockets,
+		(ControlSocketCount + 1) * sizeof(*sockets)))) {
+	goto error;
+    }
+    ControlSockets = sockets;
+    ControlSockets[ControlSocketCount++] = control;
+    dock->Control = control;
+    LoopAddFd(control->Fd, ControlEvent);
+
+    return 0;
+
+  error:
+    ControlDel(control);
+    return -1;
+}
+
+/**
+**	Remove the control socket of a dock.
+**
+**	@param dock	dock of the socket
+*/
+void ControlClose(Dock * dock)
+{
+    int i;
+
+    for (i = 0; i < ControlSocketCount; ++i) {
+	if (ControlSockets[i] == dock->Control) {
+	    ControlDel(ControlSockets[i]);
+	    memmove(ControlSockets + i, ControlSockets + i + 1,
+		(ControlSocketCount - i - 1) * sizeof(*ControlSockets));
+	    ControlSocketCount--;
+	    break;
+	}
+    }
+    dock->Control = NULL;
+}
+
+/**
+**	Remove all control sockets.
+**
+**	Must be called after SlideExit, pending images are never decoded.
+*/
+void ControlExit(void)
+{
+    int i;
+
+    for (i = 0; i < ControlClientCount; ++i) {
+	free(ControlClients[i].Pending);
+	ControlClients[i].Pending = NULL;
+    }
+    for (i = 0; i < ControlSocketCount; ++i) {
+	ControlSockets[i]->Dock->Control = NULL;
+	ControlDel(ControlSockets[i]);
+    }
+    free(ControlSockets);
+    ControlSockets = NULL;
+    ControlSocketCount = 0;
+}
@@ -0,0 +1,41 @@
+///
+///	@file control.h	@brief	Control socket module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Control
+/// @{
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Create the control socket of a dock.
+extern int ControlInit(Dock *);
+
+    /// Remove the control socket of a dock.
+extern void ControlClose(Dock *);
+
+    /// Remove all control sockets.
+extern void ControlExit(void);
+
+/// @}
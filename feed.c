@@ -0,0 +1,322 @@
+///
+///	@file feed.c		@brief	Frame feed module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Feed The frame feed module.
+///
+///	Producers (video, webcam, metrics renderer) write raw 64x64 BGRX
+///	frames into a named POSIX shared memory ring, see wmdiafeed.h.
+///	The event loop is woken through a fifo and shows only the newest
+///	completed frame, frames which can't be shown in time are dropped.
+///	Each dock has its own feed /wmdia-<name>.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <xcb/xcb.h>
+
+#define WMDIA_FEED_NO_PRODUCER		///< only the layout is needed
+#include "wmdiafeed.h"
+#include "wmdia.h"
+#include "feed.h"
+#include "stats.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Frame feed of one dock.
+///
+struct _frame_feed_
+{
+    Dock *Dock;				///< dock showing the frames
+    int Fd;				///< wakeup fifo, -1 if not open
+    WmdiaFeed *Shm;			///< mapped frame feed
+    char *ShmName;			///< name of shared memory object
+    char *FifoName;			///< file name of wakeup fifo
+    uint32_t Sequence;			///< sequence of last shown frame
+};
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+static FrameFeed **Feeds;		///< feeds of all docks
+static int FeedCount;			///< number of feeds
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Show newest frame of a feed.
+**
+**	@param feed	frame feed
+*/
+static void FeedShow(FrameFeed * feed)
+{
+    uint32_t pixels[WMDIA_FEED_WIDTH * WMDIA_FEED_HEIGHT];
+    const uint32_t *src;
+    char buf[256];
+    uint32_t sequence;
+    uint32_t frame_sequence;
+    int index;
+    int retry;
+    int i;
+
+    // many wakeups are one wakeup
+    while (read(feed->Fd, buf, sizeof(buf)) > 0) {
+    }
+
+    sequence = __atomic_load_n(&feed->Shm->Sequence, __ATOMIC_ACQUIRE);
+    if (sequence == feed->Sequence) {
+	return;
+    }
+    //
+    //	Copy the newest frame, retry if the producer has overwritten it
+    //
+    for (retry = 0; retry < 3; ++retry) {
+	index = __atomic_load_n(&feed->Shm->Ready, __ATOMIC_ACQUIRE)
+	    % WMDIA_FEED_FRAMES;
+	frame_sequence =
+	    __atomic_load_n(&feed->Shm->FrameSequence[index],
+	    __ATOMIC_ACQUIRE);
+	if (frame_sequence & 1) {
+	    continue;
+	}
+	// layout fields in shared memory are writable by any producer
+	src = (const uint32_t *)((const uint8_t *)feed->Shm +
+	    sizeof(WmdiaFeed) +
+	    index * WMDIA_FEED_WIDTH * 4 * WMDIA_FEED_HEIGHT);
+	if (NativeRgb) {
+	    memcpy(pixels, src, sizeof(pixels));
+	} else {
+	    for (i = 0; i < WMDIA_FEED_WIDTH * WMDIA_FEED_HEIGHT; ++i) {
+		pixels[i] = RgbPixel((src[i] >> 16) & 0xFF,
+		    (src[i] >> 8) & 0xFF, src[i] & 0xFF);
+	    }
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (frame_sequence ==
+	    __atomic_load_n(&feed->Shm->FrameSequence[index],
+		__ATOMIC_RELAXED)) {
+	    break;
+	}
+    }
+    if (retry == 3) {			// producer too fast, next wakeup
+	return;
+    }
+
+    StatsAdd(StatsFeedDropped, sequence - feed->Sequence - 1);
+    feed->Sequence = sequence;
+    TraceInstant("feed frame", sequence);
+    feed->Dock->FrameSequence = sequence;
+
+    ShowFrame(feed->Dock, pixels, WMDIA_FEED_WIDTH);
+}
+
+/**
+**	Show newest frames of the feeds.
+**
+**	Called from the event loop, when a wakeup fifo is readable.  The
+**	handler is shared by all feeds, unchanged feeds cost one read.
+*/
+static void FeedEvent(void)
+{
+    int i;
+
+    for (i = 0; i < FeedCount; ++i) {
+	FeedShow(Feeds[i]);
+    }
+}
+
+/**
+**	Remove the frame feed.
+**
+**	@param feed	frame feed
+*/
+static void FeedDel(FrameFeed * feed)
+{
+    if (feed->Fd >= 0) {
+	LoopDelFd(feed->Fd);
+	close(feed->Fd);
+    }
+    if (feed->Shm) {
+	munmap(feed->Shm, WMDIA_FEED_SIZE);
+    }
+    if (feed->ShmName) {
+	shm_unlink(feed->ShmName);
+	free(feed->ShmName);
+    }
+    if (feed->FifoName) {
+	unlink(feed->FifoName);
+	free(feed->FifoName);
+    }
+    free(feed);
+}
+
+/**
+**	Create the frame feed of a dock.
+**
+**	@param dock	dock showing the frames, Dock::Name names the feed
+**
+**	@returns -1 on error, 0 otherwise.
+*/
+int FeedInit(Dock * dock)
+{
+    FrameFeed *feed;
+    FrameFeed **feeds;
+    const char *dir;
+    int fd;
+    int i;
+
+    if (!(dir = getenv("XDG_RUNTIME_DIR"))) {
+	dir = "/tmp";
+    }
+    if (!(feed = calloc(1, sizeof(*feed)))) {
+	return -1;
+    }
+    feed->Dock = dock;
+    feed->Fd = -1;
+    feed->ShmName = malloc(strlen(dock->Name) + sizeof("/wmdia-"));
+    sprintf(feed->ShmName, "/wmdia-%s", dock->Name);
+    feed->FifoName =
+	malloc(strlen(dir) + strlen(dock->Name) + sizeof("/wmdia-.feed"));
+    sprintf(feed->FifoName, "%s/wmdia-%s.feed", dir, dock->Name);
+
+    fd = shm_open(feed->ShmName, O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+	fprintf(stderr, "feed: can't create '%s'\n", feed->ShmName);
+	goto error;
+    }
+    if (ftruncate(fd, WMDIA_FEED_SIZE)) {
+	close(fd);
+	goto error;
+    }
+    feed->Shm = mmap(NULL, WMDIA_FEED_SIZE, PROT_READ | PROT_WRITE,
+	MAP_SHARED, fd, 0);
+    close(fd);
+    if (feed->Shm == MAP_FAILED) {
+	feed->Shm = NULL;
+	goto error;
+    }
+    feed->Shm->Width = WMDIA_FEED_WIDTH;
+    feed->Shm->Height = WMDIA_FEED_HEIGHT;
+    feed->Shm->Stride = WMDIA_FEED_WIDTH * 4;
+    feed->Shm->Frames = WMDIA_FEED_FRAMES;
+    feed->Shm->Offset = sizeof(*feed->Shm);
+    feed->Shm->Ready = 0;
+    feed->Shm->Sequence = 0;
+    for (i = 0; i < WMDIA_FEED_FRAMES; ++i) {
+	feed->Shm->FrameSequence[i] = 0;
+    }
+    feed->Shm->Version = WMDIA_FEED_VERSION;
+    __atomic_store_n(&feed->Shm->Magic, WMDIA_FEED_MAGIC, __ATOMIC_RELEASE);
+
+    unlink(feed->FifoName);
+    if (mkfifo(feed->FifoName, 0600)) {
+	fprintf(stderr, "feed: can't create '%s'\n", feed->FifoName);
+	goto error;
+    }
+    // opened read-write, we never see EOF, if producers come and go
+    feed->Fd = open(feed->FifoName, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (feed->Fd < 0) {
+	goto error;
+    }
+    if (!(feeds = realloc(Feeds, (FeedCount + 1) * sizeof(*feeds)))) {
+	goto error;
+    }
+    Feeds = feeds;
+    Feeds[FeedCount++] = feed;
+    dock->Feed = feed;
+    LoopAddFd(feed->Fd, FeedEvent);
+
+    return 0;
+
+  error:
+    FeedDel(feed);
+    return -1;
+}
+
+/**
+**	Remove the frame feed of a dock.
+**
+**	@param dock	dock of the feed
+*/
+void FeedClose(Dock * dock)
+{
+    int i;
+
+    for (i = 0; i < FeedCount; ++i) {
+	if (Feeds[i] == dock->Feed) {
+	    FeedDel(Feeds[i]);
+	    memmove(Feeds + i, Feeds + i + 1,
+		(FeedCount - i - 1) * sizeof(*Feeds));
+	    FeedCount--;
+	    break;
+	}
+    }
+    dock->Feed = NULL;
+}
+
+/**
+**	Report presented frame to the producer.
+**
+**	@param dock	dock of the feed
+**	@param sequence	sequence of the presented frame
+**	@param ust	presentation time in microseconds
+*/
+void FeedPresented(Dock * dock, uint32_t sequence, uint64_t ust)
+{
+    __atomic_store_n(&dock->Feed->Shm->PresentedUst, ust, __ATOMIC_RELAXED);
+    __atomic_store_n(&dock->Feed->Shm->Presented, sequence,
+	__ATOMIC_RELEASE);
+}
+
+/**
+**	Remove all frame feeds.
+*/
+void FeedExit(void)
+{
+    int i;
+
+    for (i = 0; i < FeedCount; ++i) {
+	Feeds[i]->Dock->Feed = NULL;
+	FeedDel(Feeds[i]);
+    }
+    free(Feeds);
+    Feeds = NULL;
+    FeedCount = 0;
+}
@@ -0,0 +1,44 @@
+///
+///	@file feed.h		@brief	Frame feed module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Feed
+/// @{
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Create the frame feed of a dock.
+extern int FeedInit(Dock *);
+
+    /// Remove the frame feed of a dock.
+extern void FeedClose(Dock *);
+
+    /// Report presented frame to the producer.
+extern void FeedPresented(Dock *, uint32_t, uint64_t);
+
+    /// Remove all frame feeds.
+extern void FeedExit(void);
+
+/// @}
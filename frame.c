@@ -0,0 +1,430 @@
+///
+///	@file frame.c		@brief	Frame upload module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Frame The frame upload module.
+///
+///	All pixels, which are pushed into the dock, go through this module.
+///	If the X server is local and supports MIT-SHM, a persistent shared
+///	memory segment with some dock sized slots is used and the server
+///	reads the pixels directly with xcb_shm_put_image.  A slot is reused
+///	after its completion event is received.  Otherwise or if all slots
+///	are busy, the pixels are send over the socket with xcb_put_image.
+///
+///	Pixels are 32bit values of the visual, one uint32_t per pixel.
+///
+///	Live frames are compared in 8x8 tiles against the shown frame, only
+///	the changed tiles are uploaded as few rectangles as possible.  The
+///	tile compare kernels (SSE2, AVX2) are in the pixel module.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+#include <xcb/xcb_image.h>
+
+#include "wmdia.h"
+#include "frame.h"
+#include "pixel.h"
+#include "stats.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define FRAME_SLOTS	8		///< number of slots in shm segment
+
+    /// bytes of one slot in shm segment
+#define FRAME_SLOT_SIZE	(DOCK_SIZE * DOCK_SIZE * 4)
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+int FrameNoShm;				///< don't use MIT-SHM
+
+static int FrameBpp;			///< bits per pixel of root depth
+static int FrameNative;			///< pixels are in server format
+
+static xcb_shm_seg_t FrameShmSeg;	///< shm segment, 0 if not available
+static uint8_t *FrameShmAddr;		///< shm segment mapped address
+static uint8_t FrameShmEvent;		///< shm completion event type
+static char FrameSlotBusy[FRAME_SLOTS];	///< slot used by server
+static int FrameNextSlot;		///< next slot to try
+
+static pthread_mutex_t FrameMutex = PTHREAD_MUTEX_INITIALIZER;	///< slot lock
+
+//----------------------------------------------------------------------------
+//	Upload
+//----------------------------------------------------------------------------
+
+/**
+**	Upload pixels over the socket.
+**
+**	@param drawable	destination drawable
+**	@param x	destination x position
+**	@param y	destination y position
+**	@param width	width of frame
+**	@param height	height of frame
+**	@param pixels	32bit pixels of the visual
+**	@param stride	pixels per line
+*/
+static void FramePutSocket(xcb_drawable_t drawable, int x, int y, int width,
+    int height, const uint32_t * pixels, int stride)
+{
+    xcb_image_t *image;
+    int i;
+    int j;
+
+    image =
+	xcb_image_create_native(Connection, width, height,
+	XCB_IMAGE_FORMAT_Z_PIXMAP, Screen->root_depth, NULL, 0L, NULL);
+    if (!image) {
+	return;
+    }
+    for (j = 0; j < height; ++j) {
+	if (FrameNative) {
+	    memcpy(image->data + j * image->stride, pixels + j * stride,
+		width * 4);
+	    continue;
+	}
+	for (i = 0; i < width; ++i) {
+	    xcb_image_put_pixel(image, i, j, pixels[j * stride + i]);
+	}
+    }
+    xcb_image_put(Connection, drawable, NormalGC, image, x, y, 0);
+    StatsAdd(StatsUploadSocketBytes, image->size);
+    xcb_image_destroy(image);
+}
+
+/**
+**	Upload native 32bit pixels into drawable.
+**
+**	Can be called from any thread.
+**
+**	@param drawable	destination drawable
+**	@param x	destination x position
+**	@param y	destination y position
+**	@param width	width of frame
+**	@param height	height of frame
+**	@param pixels	32bit pixels of the visual
+**	@param stride	pixels per line
+*/
+void FramePut(xcb_drawable_t drawable, int x, int y, int width, int height,
+    const uint32_t * pixels, int stride)
+{
+    uint32_t *dst;
+    uint64_t trace;
+    int slot;
+    int i;
+    int j;
+
+    trace = TraceBegin();
+    StatsAdd(StatsUploads, 1);
+    slot = -1;
+    if (FrameShmSeg && width * height * 4 <= FRAME_SLOT_SIZE) {
+	pthread_mutex_lock(&FrameMutex);
+	for (i = 0; i < FRAME_SLOTS; ++i) {
+	    j = (FrameNextSlot + i) % FRAME_SLOTS;
+	    if (!FrameSlotBusy[j]) {
+		FrameSlotBusy[j] = 1;
+		FrameNextSlot = (j + 1) % FRAME_SLOTS;
+		slot = j;
+		break;
+	    }
+	}
+	pthread_mutex_unlock(&FrameMutex);
+    }
+    if (slot < 0) {			// no shm or all slots busy
+	FramePutSocket(drawable, x, y, width, height, pixels, stride);
+	TraceEnd("upload socket", trace, width * height * 4);
+	return;
+    }
+
+    dst = (uint32_t *) (FrameShmAddr + slot * FRAME_SLOT_SIZE);
+    for (j = 0; j < height; ++j) {
+	memcpy(dst + j * width, pixels + j * stride, width * 4);
+    }
+    xcb_shm_put_image(Connection, drawable, NormalGC, width, height, 0, 0,
+	width, height, x, y, Screen->root_depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 1,
+	FrameShmSeg, slot * FRAME_SLOT_SIZE);
+    StatsAdd(StatsUploadShmBytes, width * height * 4);
+    TraceEnd("upload shm", trace, width * height * 4);
+}
+
+/**
+**	Upload native image into drawable.
+**
+**	@param drawable	destination drawable
+**	@param x	destination x position
+**	@param y	destination y position
+**	@param image	image created with xcb_image_create_native
+*/
+void FramePutImage(xcb_drawable_t drawable, int x, int y, xcb_image_t * image)
+{
+    if (FrameNative && image->format == XCB_IMAGE_FORMAT_Z_PIXMAP
+	&& image->bpp == 32) {
+	FramePut(drawable, x, y, image->width, image->height,
+	    (const uint32_t *)image->data, image->stride / 4);
+	return;
+    }
+    StatsAdd(StatsUploads, 1);
+    xcb_image_put(Connection, drawable, NormalGC, image, x, y, 0);
+    StatsAdd(StatsUploadSocketBytes, image->size);
+}
+
+/**
+**	Handle frame upload events.
+**
+**	@param event	X11 event
+**
+**	@returns true if the event was handled.
+*/
+int FrameEvent(const xcb_generic_event_t * event)
+{
+    const xcb_shm_completion_event_t *completion;
+
+    if (!FrameShmSeg || (event->response_type & 0x7F) != FrameShmEvent) {
+	return 0;
+    }
+    completion = (const xcb_shm_completion_event_t *)event;
+    pthread_mutex_lock(&FrameMutex);
+    FrameSlotBusy[completion->offset / FRAME_SLOT_SIZE] = 0;
+    pthread_mutex_unlock(&FrameMutex);
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------
+//	Tile diff
+//----------------------------------------------------------------------------
+
+    /// selected tile compare kernel
+FrameDiffFunc *FrameDiff;
+
+/**
+**	Build rectangles of changed tiles.
+**
+**	Adjacent tiles of a tile row are joined, equal runs of following
+**	tile rows are joined into one rectangle.
+**
+**	@param dirty		changed tiles returned by #FrameDiff
+**	@param[out] rects	#FRAME_RECTS_MAX rectangles in pixels
+**
+**	@returns number of rectangles.
+*/
+int FrameDirtyRects(uint64_t dirty, xcb_rectangle_t * rects)
+{
+    unsigned bits;
+    int n;
+    int i;
+    int tx;
+    int ty;
+    int x;
+    int w;
+
+    n = 0;
+    for (ty = 0; ty < FRAME_TILES_Y; ++ty) {
+	bits = (dirty >> ty * FRAME_TILES_X) & ((1U << FRAME_TILES_X) - 1);
+	for (tx = 0; tx < FRAME_TILES_X;) {
+	    if (!(bits & (1U << tx))) {
+		++tx;
+		continue;
+	    }
+	    x = tx;
+	    while (tx < FRAME_TILES_X && (bits & (1U << tx))) {
+		++tx;
+	    }
+	    x *= FRAME_TILE;
+	    w = tx * FRAME_TILE - x;
+	    // extend rectangle ending at this tile row
+	    for (i = 0; i < n; ++i) {
+		if (rects[i].x == x && rects[i].width == w
+		    && rects[i].y + rects[i].height == ty * FRAME_TILE) {
+		    rects[i].height += FRAME_TILE;
+		    break;
+		}
+	    }
+	    if (i == n) {
+		rects[n].x = x;
+		rects[n].y = ty * FRAME_TILE;
+		rects[n].width = w;
+		rects[n].height = FRAME_TILE;
+		++n;
+	    }
+	}
+    }
+    return n;
+}
+
+//----------------------------------------------------------------------------
+//	Setup
+//----------------------------------------------------------------------------
+
+/**
+**	Check if connection to X11 server is local.
+*/
+static int FrameIsLocal(void)
+{
+    char *host;
+    int display;
+    int screen;
+    int local;
+
+    host = NULL;
+    if (!xcb_parse_display(NULL, &host, &display, &screen)) {
+	return 0;
+    }
+    local = !*host || !strcmp(host, "unix");
+    free(host);
+
+    return local;
+}
+
+/**
+**	Setup MIT-SHM segment.
+**
+**	Version query and attach are sent together, only one round trip.
+*/
+static void FrameShmInit(void)
+{
+    const xcb_query_extension_reply_t *ext;
+    xcb_shm_query_version_cookie_t version_cookie;
+    xcb_void_cookie_t attach_cookie;
+    xcb_shm_query_version_reply_t *version;
+    xcb_generic_error_t *error;
+    xcb_shm_seg_t seg;
+    int shmid;
+    void *addr;
+
+    if (FrameNoShm || !FrameNative || !FrameIsLocal()) {
+	return;
+    }
+    ext = xcb_get_extension_data(Connection, &xcb_shm_id);
+    if (!ext || !ext->present) {
+	return;
+    }
+
+    shmid = shmget(IPC_PRIVATE, FRAME_SLOTS * FRAME_SLOT_SIZE,
+	IPC_CREAT | 0600);
+    if (shmid == -1) {
+	return;
+    }
+    addr = shmat(shmid, NULL, 0);
+    if (addr == (void *)-1) {
+	shmctl(shmid, IPC_RMID, NULL);
+	return;
+    }
+
+    seg = xcb_generate_id(Connection);
+    version_cookie = xcb_shm_query_version_unchecked(Connection);
+    attach_cookie = xcb_shm_attach_checked(Connection, seg, shmid, 1);
+    version = xcb_shm_query_version_reply(Connection, version_cookie, NULL);
+    error = xcb_request_check(Connection, attach_cookie);
+    // segment is destroyed, after server and we detached
+    shmctl(shmid, IPC_RMID, NULL);
+    if (error || !version) {		// f.e. server in other ipc namespace
+	if (!error) {
+	    xcb_shm_detach(Connection, seg);
+	}
+	free(error);
+	free(version);
+	shmdt(addr);
+	return;
+    }
+    free(version);
+
+    FrameShmSeg = seg;
+    FrameShmAddr = addr;
+    FrameShmEvent = ext->first_event + XCB_SHM_COMPLETION;
+}
+
+/**
+**	Request extension data needed by FrameInit.
+**
+**	Called before the window is mapped, the reply is collected later.
+*/
+void FramePrefetch(void)
+{
+    if (!FrameNoShm) {
+	xcb_prefetch_extension_data(Connection, &xcb_shm_id);
+    }
+}
+
+/**
+**	Setup frame upload.
+*/
+void FrameInit(void)
+{
+    xcb_format_iterator_t iter;
+    int i;
+
+    // best supported tile compare kernel is last
+    for (i = 0; PixelDiffKernels[i].Name; ++i) {
+	if (PixelDiffKernels[i].Supported()) {
+	    FrameDiff = PixelDiffKernels[i].Diff;
+	}
+    }
+
+    FrameBpp = 0;
+    for (iter = xcb_setup_pixmap_formats_iterator(xcb_get_setup(Connection));
+	iter.rem; xcb_format_next(&iter)) {
+	if (iter.data->depth == Screen->root_depth) {
+	    FrameBpp = iter.data->bits_per_pixel;
+	}
+    }
+    // our pixels can be used unconverted
+    FrameNative = FrameBpp == 32
+	&& xcb_get_setup(Connection)->image_byte_order ==
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	XCB_IMAGE_ORDER_LSB_FIRST;
+#else
+	XCB_IMAGE_ORDER_MSB_FIRST;
+#endif
+
+    FrameShmInit();
+}
+
+/**
+**	Cleanup frame upload.
+*/
+void FrameExit(void)
+{
+    if (FrameShmSeg) {
+	xcb_shm_detach(Connection, FrameShmSeg);
+	shmdt(FrameShmAddr);
+	FrameShmSeg = 0;
+	FrameShmAddr = NULL;
+    }
+}
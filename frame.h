@@ -0,0 +1,81 @@
+///
+///	@file frame.h		@brief	Frame upload module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Frame
+/// @{
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define FRAME_TILE	8		///< width and height of diff tiles
+#define FRAME_TILES_X	(DOCK_SIZE / FRAME_TILE)	///< tiles per row
+#define FRAME_TILES_Y	(DOCK_SIZE / FRAME_TILE)	///< tile rows
+
+    /// max. rectangles of changed tiles, checkerboard
+#define FRAME_RECTS_MAX	(FRAME_TILES_X * FRAME_TILES_Y / 2)
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+    /// Compare tiles of shown and new frame.
+typedef uint64_t FrameDiffFunc(const uint32_t *, const uint32_t *, int);
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern int FrameNoShm;			///< don't use MIT-SHM
+
+    /// selected tile compare kernel
+extern FrameDiffFunc *FrameDiff;
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Upload native 32bit pixels into drawable.
+extern void FramePut(xcb_drawable_t, int, int, int, int, const uint32_t *,
+    int);
+
+    /// Upload native image into drawable.
+extern void FramePutImage(xcb_drawable_t, int, int, xcb_image_t *);
+
+    /// Build rectangles of changed tiles.
+extern int FrameDirtyRects(uint64_t, xcb_rectangle_t *);
+
+    /// Handle frame upload events.
+extern int FrameEvent(const xcb_generic_event_t *);
+
+    /// Request extension data needed by FrameInit.
+extern void FramePrefetch(void);
+
+    /// Setup frame upload.
+extern void FrameInit(void);
+
+    /// Cleanup frame upload.
+extern void FrameExit(void);
+
+/// @}
@@ -0,0 +1,427 @@
+///
+///	@file image.c		@brief	Image loader module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Image The image loader module.
+///
+///	Loads images as dias: scaled to fit into #DIA_SIZE x #DIA_SIZE,
+///	centered on a darkgray background, like
+///	display -resize 62x62 -bordercolor darkgray -border 31
+///	-gravity center -crop 62x62+0+0 does.
+///
+///	JPEG images are decoded with the DCT scaling of libjpeg (down to
+///	1/8), PNG images are read row by row.  Both feed the rows directly
+///	into the area-averaging scaler (see @ref Scale), which writes
+///	pixels of our visual.  The full size raster is never materialized,
+///	except for interlaced PNG images.  All other formats are converted
+///	by ImageMagick.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <setjmp.h>
+#include <spawn.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include <xcb/xcb.h>
+
+#include "wmdia.h"
+#include "scale.h"
+#include "image.h"
+#include "stats.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define IMAGE_MAX_SIDE	32768		///< max. PNG width and height
+#define IMAGE_MAX_RASTER (16 * 1024 * 1024)	///< max. interlaced PNG pixels
+
+//----------------------------------------------------------------------------
+//	JPEG
+//----------------------------------------------------------------------------
+
+///
+///	libjpeg error handler with longjmp.
+///
+struct _jpeg_error_
+{
+    struct jpeg_error_mgr Mgr;		///< libjpeg error manager
+    jmp_buf Jmp;			///< return on error
+};
+
+/**
+**	Fatal libjpeg error.
+**
+**	@param cinfo	libjpeg common info
+*/
+static void ImageJpegError(j_common_ptr cinfo)
+{
+    longjmp(((struct _jpeg_error_ *)cinfo->err)->Jmp, 1);
+}
+
+/**
+**	Load JPEG image.
+**
+**	The smallest DCT scaling, which is still larger than the dia, is
+**	used.
+**
+**	@param file	opened image file
+**	@param dia	dia native pixels
+**	@param stride	pixels per dia line
+**
+**	@returns 1 loaded, 0 error, -1 color space libjpeg can't convert
+**	to RGB (CMYK, YCCK).
+*/
+static int ImageLoadJpeg(FILE * file, uint32_t * dia, int stride)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct _jpeg_error_ jerr;
+    Scaler scaler;
+    uint8_t *volatile row;
+    JSAMPROW rows[1];
+    int dw;
+    int dh;
+    int denom;
+
+    scaler.Accu = NULL;
+    row = NULL;
+    cinfo.err = jpeg_std_error(&jerr.Mgr);
+    jerr.Mgr.error_exit = ImageJpegError;
+    if (setjmp(jerr.Jmp)) {
+	jpeg_destroy_decompress(&cinfo);
+	ScalerExit(&scaler);
+	free(row);
+	return 0;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, file);
+    jpeg_read_header(&cinfo, TRUE);
+    if (cinfo.jpeg_color_space == JCS_CMYK
+	|| cinfo.jpeg_color_space == JCS_YCCK) {
+	jpeg_destroy_decompress(&cinfo);
+	return -1;
+    }
+
+    ScaleFit(cinfo.image_width, cinfo.image_height, &dw, &dh);
+    for (denom = 8; denom > 1; denom /= 2) {
+	if ((cinfo.image_width + denom - 1) / denom >= (unsigned)dw
+	    && (cinfo.image_height + denom - 1) / denom >= (unsigned)dh) {
+	    break;
+	}
+    }
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = denom;
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = FALSE;
+    cinfo.do_block_smoothing = FALSE;
+    jpeg_start_decompress(&cinfo);
+
+    if (ScalerInitDia(&scaler, cinfo.output_width, cinfo.output_height,
+	    dia, stride)) {
+	jpeg_destroy_decompress(&cinfo);
+	return 0;
+    }
+    if (!(row = malloc(cinfo.output_width * cinfo.output_components))) {
+	jpeg_destroy_decompress(&cinfo);
+	ScalerExit(&scaler);
+	return 0;
+    }
+    rows[0] = row;
+    while (cinfo.output_scanline < cinfo.output_height) {
+	jpeg_read_scanlines(&cinfo, rows, 1);
+	ScalerPutRow(&scaler, rows[0]);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    ScalerExit(&scaler);
+    free(row);
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------
+//	PNG
+//----------------------------------------------------------------------------
+
+/**
+**	Load PNG image.
+**
+**	Non interlaced images are read row by row, only interlaced images
+**	need the full raster.  Images larger than #IMAGE_MAX_SIDE are
+**	rejected, interlaced images with more than #IMAGE_MAX_RASTER pixels
+**	are left to ImageMagick.
+**
+**	@param file	opened image file
+**	@param dia	dia native pixels
+**	@param stride	pixels per dia line
+**
+**	@returns -1 if the image must be converted, false on errors.
+*/
+static int ImageLoadPng(FILE * file, uint32_t * dia, int stride)
+{
+    png_structp png;
+    png_infop info;
+    Scaler scaler;
+    uint8_t *volatile rows;
+    size_t width;
+    size_t height;
+    size_t y;
+    int passes;
+    int pass;
+
+    if (!(png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL,
+		NULL))) {
+	return 0;
+    }
+    if (!(info = png_create_info_struct(png))) {
+	png_destroy_read_struct(&png, NULL, NULL);
+	return 0;
+    }
+    scaler.Accu = NULL;
+    rows = NULL;
+    if (setjmp(png_jmpbuf(png))) {
+	png_destroy_read_struct(&png, &info, NULL);
+	ScalerExit(&scaler);
+	free(rows);
+	return 0;
+    }
+    png_set_user_limits(png, IMAGE_MAX_SIDE, IMAGE_MAX_SIDE);
+    png_init_io(png, file);
+    png_read_info(png, info);
+
+    // everything to 8bit RGB
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_set_strip_alpha(png);
+    passes = png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    width = png_get_image_width(png, info);
+    height = png_get_image_height(png, info);
+    if (passes != 1 && width * height > IMAGE_MAX_RASTER) {
+	png_destroy_read_struct(&png, &info, NULL);
+	return -1;
+    }
+    if (ScalerInitDia(&scaler, width, height, dia, stride)) {
+	png_destroy_read_struct(&png, &info, NULL);
+	return 0;
+    }
+
+    if (passes == 1) {
+	if (!(rows = malloc(width * 3))) {
+	    png_destroy_read_struct(&png, &info, NULL);
+	    ScalerExit(&scaler);
+	    return 0;
+	}
+	for (y = 0; y < height; ++y) {
+	    png_read_row(png, rows, NULL);
+	    ScalerPutRow(&scaler, rows);
+	}
+    } else {
+	if (!(rows = malloc(width * 3 * height))) {
+	    png_destroy_read_struct(&png, &info, NULL);
+	    ScalerExit(&scaler);
+	    return 0;
+	}
+	for (pass = 0; pass < passes; ++pass) {
+	    for (y = 0; y < height; ++y) {
+		png_read_row(png, rows + y * width * 3, NULL);
+	    }
+	}
+	for (y = 0; y < height; ++y) {
+	    ScalerPutRow(&scaler, rows + y * width * 3);
+	}
+    }
+    png_read_end(png, NULL);
+    png_destroy_read_struct(&png, &info, NULL);
+    ScalerExit(&scaler);
+    free(rows);
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------
+//	ImageMagick
+//----------------------------------------------------------------------------
+
+extern char **environ;			///< process environment
+
+/**
+**	Load image with ImageMagick's convert.
+**
+**	Used for all formats without a native loader (gif, ...).
+**
+**	@param path	file name of image
+**	@param dia	dia native pixels
+**	@param stride	pixels per dia line
+*/
+static int ImageLoadConvert(const char *path, uint32_t * dia, int stride)
+{
+    posix_spawn_file_actions_t actions;
+    char *argv[17];
+    char *file;
+    char geometry[16];
+    char crop[32];
+    int fds[2];
+    pid_t pid;
+    FILE *f;
+    uint8_t rgb[DIA_SIZE * 3];
+    int w;
+    int h;
+    int max;
+    int x;
+    int y;
+    int status;
+    int ok;
+
+    // first frame only, protect file names starting with '-'
+    file = alloca(strlen(path) + 6);
+    sprintf(file, "%s%s[0]", *path == '-' ? "./" : "", path);
+    snprintf(geometry, sizeof(geometry), "%dx%d", DIA_SIZE, DIA_SIZE);
+    snprintf(crop, sizeof(crop), "%dx%d+0+0", DIA_SIZE, DIA_SIZE);
+
+    argv[0] = "convert";
+    argv[1] = file;
+    argv[2] = "-resize";
+    argv[3] = geometry;
+    argv[4] = "-bordercolor";
+    argv[5] = "darkgray";
+    argv[6] = "-border";
+    argv[7] = "31";
+    argv[8] = "-gravity";
+    argv[9] = "center";
+    argv[10] = "-crop";
+    argv[11] = crop;
+    argv[12] = "+repage";
+    argv[13] = "-depth";
+    argv[14] = "8";
+    argv[15] = "ppm:-";
+    argv[16] = NULL;
+
+    if (pipe(fds)) {
+	return 0;
+    }
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+    ok = !posix_spawnp(&pid, "convert", &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (!ok) {
+	close(fds[0]);
+	fprintf(stderr, "image: can't run convert\n");
+	return 0;
+    }
+
+    ok = 0;
+    if ((f = fdopen(fds[0], "r"))) {
+	if (fscanf(f, "P6 %d %d %d", &w, &h, &max) == 3 && fgetc(f) != EOF
+	    && w == DIA_SIZE && h == DIA_SIZE && max == 255) {
+	    for (y = 0; y < DIA_SIZE; ++y) {
+		if (fread(rgb, 3, DIA_SIZE, f) != DIA_SIZE) {
+		    break;
+		}
+		for (x = 0; x < DIA_SIZE; ++x) {
+		    dia[y * stride + x] =
+			RgbPixel(rgb[x * 3 + 0], rgb[x * 3 + 1], rgb[x * 3 + 2]);
+		}
+	    }
+	    ok = y == DIA_SIZE;
+	}
+	fclose(f);
+    } else {
+	close(fds[0]);
+    }
+    waitpid(pid, &status, 0);
+
+    return ok;
+}
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Load image as dia.
+**
+**	The image is scaled to fit into the dia, centered and filled with a
+**	darkgray border.
+**
+**	@param path		file name of image
+**	@param[out] dia		#DIA_SIZE x #DIA_SIZE native pixels
+**	@param stride		pixels per dia line
+**
+**	@returns true if the image could be loaded.
+*/
+int ImageLoad(const char *path, uint32_t * dia, int stride)
+{
+    static const uint8_t png_magic[8] = {
+	0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'
+    };
+    uint8_t magic[8];
+    FILE *file;
+    uint64_t start;
+    uint64_t trace;
+    int ok;
+
+    if (!(file = fopen(path, "rb"))) {
+	StatsAdd(StatsDecodeErrors, 1);
+	return 0;
+    }
+    start = StatsMicros();
+    trace = TraceBegin();
+    ok = -1;
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic)) {
+	rewind(file);
+	if (magic[0] == 0xFF && magic[1] == 0xD8) {
+	    ok = ImageLoadJpeg(file, dia, stride);
+	} else if (!memcmp(magic, png_magic, sizeof(png_magic))) {
+	    ok = ImageLoadPng(file, dia, stride);
+	}
+    }
+    fclose(file);
+
+    if (ok < 0) {			// no native loader, or unsupported
+	ok = ImageLoadConvert(path, dia, stride);
+    }
+    StatsTime(StatsDecodeTime, start);
+    TraceEnd("decode", trace, ok);
+    if (!ok) {
+	StatsAdd(StatsDecodeErrors, 1);
+    }
+    return ok;
+}
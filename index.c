@@ -0,0 +1,900 @@
+///
+///	@file index.c		@brief	Image indexer module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Index The image indexer module.
+///
+///	Finds all images of a directory tree, like find -xdev does, but
+///	fast enough for archives with millions of files on NFS.
+///
+///	Some threads walk the tree in parallel, each has its own deque of
+///	directories and steals from the others, if its deque is empty.
+///	Directories are read with getdents64, the name suffix and d_type
+///	select the images, only entries of unknown type are stat'ed.  Like
+///	find, symlinks to directories aren't followed (no cycles), symlinks
+///	to images are kept.
+///
+///	The result is persisted in the cache directory, one record per
+///	directory with its mtime, images and subdirectories.  On the next
+///	scan, a directory with unchanged mtime isn't read again, its record
+///	is reused and only its subdirectories are stat'ed.  Like racily
+///	clean entries of git, a record with mtime not older than the start
+///	of its scan is read again: with coarse mtimes (NFS) a file added in
+///	the same tick doesn't change the mtime.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "cache.h"
+#include "index.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define INDEX_MAGIC	0x58444D57	///< "WMDX" little endian
+#define INDEX_VERSION	2		///< version of the index file
+#define INDEX_THREADS	8		///< threads walking the tree
+#define INDEX_BUFFER	(64 * 1024)	///< getdents64 buffer size
+    /// coarsest mtime granularity in ns (FAT), for racily clean records
+#define INDEX_RACY	2000000000LL
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Directory record.
+///
+typedef struct _index_dir_
+{
+    char *Path;				///< directory path
+    int64_t Mtime;			///< mtime of directory in ns
+    char *Names;			///< image names, then subdirectory names
+    uint32_t Size;			///< bytes of names, '\0' terminated each
+    uint32_t Files;			///< number of image names
+    uint32_t Dirs;			///< number of subdirectory names
+    char Owned;				///< names are allocated, not mapped
+} IndexDir;
+
+///
+///	Directory entry of getdents64.
+///
+typedef struct _index_dirent_
+{
+    uint64_t Ino;			///< inode number
+    int64_t Off;			///< offset of next entry
+    uint16_t Reclen;			///< size of this entry
+    uint8_t Type;			///< file type (DT_xxx)
+    char Name[];			///< file name
+} IndexDirent;
+
+///
+///	Index file header.
+///
+typedef struct _index_header_
+{
+    uint32_t Magic;			///< #INDEX_MAGIC
+    uint32_t Version;			///< #INDEX_VERSION
+    uint32_t Count;			///< number of directory records
+    uint32_t Reserved;			///< pad header to 24 bytes
+    int64_t Start;			///< start time of the scan in ns
+} IndexHeader;
+
+///
+///	Directory record in index file, followed by path and names.
+///
+typedef struct _index_record_
+{
+    int64_t Mtime;			///< mtime of directory in ns
+    uint32_t PathLen;			///< bytes of path including '\0'
+    uint32_t Size;			///< bytes of names
+    uint32_t Files;			///< number of image names
+    uint32_t Dirs;			///< number of subdirectory names
+} IndexRecord;
+
+///
+///	Tree walking thread.
+///
+typedef struct _index_worker_
+{
+    pthread_t Thread;			///< thread
+    pthread_mutex_t Mutex;		///< lock of deque
+    char **Queue;			///< deque of directories to read
+    int Head;				///< first queued directory (steal)
+    int Tail;				///< end of queued directories (own)
+    int Alloc;				///< allocated queue entries
+    IndexDir *Dirs;			///< directories read by the thread
+    int Count;				///< number of directories read
+    int DirAlloc;			///< allocated directory records
+} IndexWorker;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+static IndexWorker IndexWorkers[INDEX_THREADS];	///< tree walking threads
+static pthread_mutex_t IndexMutex;	///< lock of counters
+static pthread_cond_t IndexCond;	///< directory queued or walk done
+static int IndexPending;		///< directories queued or being read
+static int IndexQueued;			///< directories in deques
+static const char *IndexRoot;		///< directory of the tree
+static dev_t IndexDev;			///< device of the tree
+static const volatile char *IndexStop;	///< flag abort the walk
+static volatile char IndexFailed;	///< out of memory, walk aborted
+
+static IndexDir *IndexOld;		///< records of the index file
+static int IndexOldCount;		///< number of records of index file
+static int64_t IndexOldStart;		///< start of the scan of index file
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Abort the walk, out of memory.
+**
+**	The partial result is used, but not saved as index.
+*/
+static void IndexNoMemory(void)
+{
+    if (!IndexFailed) {			// races only print twice
+	fprintf(stderr, "index: out of memory, scan incomplete\n");
+    }
+    IndexFailed = 1;
+}
+
+/**
+**	Check if file name is a supported image.
+**
+**	@param name	file name
+*/
+int IndexIsImage(const char *name)
+{
+    static const char *const suffixes[] = {
+	"jpg", "jpeg", "png", "gif", NULL
+    };
+    const char *s;
+    int i;
+
+    if (!(s = strrchr(name, '.'))) {
+	return 0;
+    }
+    ++s;
+    for (i = 0; suffixes[i]; ++i) {
+	if (!strcasecmp(s, suffixes[i])) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/**
+**	Compare directory records by path.
+*/
+static int IndexCompare(const void *a, const void *b)
+{
+    return strcmp(((const IndexDir *)a)->Path, ((const IndexDir *)b)->Path);
+}
+
+/**
+**	Find record of directory in index file.
+**
+**	@param path	directory path
+*/
+static const IndexDir *IndexFind(const char *path)
+{
+    IndexDir key;
+
+    key.Path = (char *)path;
+    return bsearch(&key, IndexOld, IndexOldCount, sizeof(*IndexOld),
+	IndexCompare);
+}
+
+/**
+**	Queue directory to read.
+**
+**	@param worker	own thread
+**	@param path	directory path, owned by the queue
+*/
+static void IndexPush(IndexWorker * worker, char *path)
+{
+    char **queue;
+
+    if (!path) {			// strdup of the root failed
+	IndexNoMemory();
+	return;
+    }
+    // counted before it can be stolen and finished
+    pthread_mutex_lock(&IndexMutex);
+    IndexPending++;
+    IndexQueued++;
+    pthread_mutex_unlock(&IndexMutex);
+
+    pthread_mutex_lock(&worker->Mutex);
+    if (worker->Tail == worker->Alloc) {
+	if (worker->Head) {		// compact stolen entries
+	    memmove(worker->Queue, worker->Queue + worker->Head,
+		(worker->Tail - worker->Head) * sizeof(*worker->Queue));
+	    worker->Tail -= worker->Head;
+	    worker->Head = 0;
+	}
+	if (worker->Tail == worker->Alloc) {
+	    if (!(queue = realloc(worker->Queue,
+			(worker->Alloc ? worker->Alloc * 2 : 64)
+			* sizeof(*worker->Queue)))) {
+		pthread_mutex_unlock(&worker->Mutex);
+		free(path);
+		IndexNoMemory();
+		pthread_mutex_lock(&IndexMutex);
+		IndexQueued--;
+		if (!--IndexPending) {
+		    pthread_cond_broadcast(&IndexCond);
+		}
+		pthread_mutex_unlock(&IndexMutex);
+		return;
+	    }
+	    worker->Queue = queue;
+	    worker->Alloc = worker->Alloc ? worker->Alloc * 2 : 64;
+	}
+    }
+    worker->Queue[worker->Tail++] = path;
+    pthread_mutex_unlock(&worker->Mutex);
+
+    pthread_mutex_lock(&IndexMutex);
+    pthread_cond_signal(&IndexCond);
+    pthread_mutex_unlock(&IndexMutex);
+}
+
+/**
+**	Take directory to read.
+**
+**	The newest directory of the own deque is taken (depth first, good
+**	locality), else the oldest of another deque (big subtrees).
+**
+**	@param worker	own thread
+**
+**	@returns directory path, NULL if all deques are empty.
+*/
+static char *IndexPop(IndexWorker * worker)
+{
+    IndexWorker *victim;
+    char *path;
+    int i;
+
+    path = NULL;
+    pthread_mutex_lock(&worker->Mutex);
+    if (worker->Head < worker->Tail) {
+	path = worker->Queue[--worker->Tail];
+    }
+    pthread_mutex_unlock(&worker->Mutex);
+
+    for (i = 1; !path && i < INDEX_THREADS; ++i) {
+	victim = IndexWorkers + (worker - IndexWorkers + i) % INDEX_THREADS;
+	pthread_mutex_lock(&victim->Mutex);
+	if (victim->Head < victim->Tail) {
+	    path = victim->Queue[victim->Head++];
+	}
+	pthread_mutex_unlock(&victim->Mutex);
+    }
+
+    if (path) {
+	pthread_mutex_lock(&IndexMutex);
+	IndexQueued--;
+	pthread_mutex_unlock(&IndexMutex);
+    }
+    return path;
+}
+
+/**
+**	Append name to growing buffer.
+**
+**	@param buf	buffer
+**	@param len	used bytes of buffer
+**	@param alloc	allocated bytes of buffer
+**	@param name	name to append with '\0'
+**
+**	@returns -1 if out of memory, 0 otherwise.
+*/
+static int IndexAppend(char **buf, uint32_t * len, uint32_t * alloc,
+    const char *name)
+{
+    char *grown;
+    size_t n;
+
+    n = strlen(name) + 1;
+    if (*len + n > *alloc) {
+	if (!(grown = realloc(*buf, (*len + n) * 2))) {
+	    return -1;
+	}
+	*buf = grown;
+	*alloc = (*len + n) * 2;
+    }
+    memcpy(*buf + *len, name, n);
+    *len += n;
+    return 0;
+}
+
+/**
+**	Read directory with getdents64.
+**
+**	Symlinks are only kept, if they point to an image file.
+**
+**	@param dir	directory record to fill
+**	@param fd	opened directory
+*/
+static void IndexRead(IndexDir * dir, int fd)
+{
+    uint64_t buf[INDEX_BUFFER / 8];	// aligned for the entries
+    IndexDirent *dirent;
+    struct stat st;
+    char *dirs;
+    char *names;
+    uint32_t dirs_len;
+    uint32_t alloc;
+    uint32_t dirs_alloc;
+    long n;
+    long i;
+    int type;
+
+    dir->Names = NULL;
+    dir->Size = 0;
+    alloc = 0;
+    dirs = NULL;
+    dirs_len = 0;
+    dirs_alloc = 0;
+
+    while (!IndexFailed
+	&& (n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+	for (i = 0; i < n; i += dirent->Reclen) {
+	    dirent = (IndexDirent *) ((char *)buf + i);
+	    if (dirent->Name[0] == '.') {	// hidden, . and ..
+		continue;
+	    }
+	    type = dirent->Type;
+	    if (type == DT_REG && !IndexIsImage(dirent->Name)) {
+		continue;
+	    }
+	    if (type == DT_UNKNOWN) {
+		if (fstatat(fd, dirent->Name, &st, AT_SYMLINK_NOFOLLOW)) {
+		    continue;
+		}
+		type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode)
+		    ? DT_REG : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+	    }
+	    // only symlinks to files are followed, no directory cycles
+	    if (type == DT_LNK) {
+		if (fstatat(fd, dirent->Name, &st, 0)
+		    || !S_ISREG(st.st_mode)) {
+		    continue;
+		}
+		type = DT_REG;
+	    }
+	    if (type == DT_REG && IndexIsImage(dirent->Name)) {
+		if (IndexAppend(&dir->Names, &dir->Size, &alloc,
+			dirent->Name)) {
+		    IndexNoMemory();
+		    break;
+		}
+		dir->Files++;
+	    } else if (type == DT_DIR) {
+		if (IndexAppend(&dirs, &dirs_len, &dirs_alloc, dirent->Name)) {
+		    IndexNoMemory();
+		    break;
+		}
+		dir->Dirs++;
+	    }
+	}
+    }
+
+    if (dirs_len) {
+	names = dir->Names;
+	if (dir->Size + dirs_len > alloc
+	    && !(names = realloc(dir->Names, dir->Size + dirs_len))) {
+	    IndexNoMemory();
+	    dir->Dirs = 0;		// subdirectories are lost
+	} else {
+	    dir->Names = names;
+	    memcpy(dir->Names + dir->Size, dirs, dirs_len);
+	    dir->Size += dirs_len;
+	}
+    }
+    free(dirs);
+}
+
+/**
+**	Scan one directory and queue its subdirectories.
+**
+**	@param worker	own thread
+**	@param path	directory path, owned by the record
+*/
+static void IndexDirScan(IndexWorker * worker, char *path)
+{
+    const IndexDir *old;
+    IndexDir *dir;
+    struct stat st;
+    const char *s;
+    char *sub;
+    size_t len;
+    uint32_t i;
+    int nofollow;
+    int fd;
+
+    // only the root may be a symlink, like find -xdev; an index record
+    // can still name a directory meanwhile replaced by a symlink
+    nofollow = strcmp(path, IndexRoot) ? AT_SYMLINK_NOFOLLOW : 0;
+    if (fstatat(AT_FDCWD, path, &st, nofollow) || !S_ISDIR(st.st_mode)
+	|| st.st_dev != IndexDev) {
+	free(path);
+	return;
+    }
+
+    if (worker->Count == worker->DirAlloc) {
+	if (!(dir = realloc(worker->Dirs,
+		    (worker->DirAlloc ? worker->DirAlloc * 2 : 256)
+		    * sizeof(*worker->Dirs)))) {
+	    free(path);
+	    IndexNoMemory();
+	    return;
+	}
+	worker->Dirs = dir;
+	worker->DirAlloc = worker->DirAlloc ? worker->DirAlloc * 2 : 256;
+    }
+    dir = worker->Dirs + worker->Count;
+    memset(dir, 0, sizeof(*dir));
+    dir->Path = path;
+    dir->Mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+    if ((old = IndexFind(path)) && old->Mtime == dir->Mtime
+	&& old->Mtime + INDEX_RACY < IndexOldStart) {
+	// unchanged directory, reuse names of index file
+	dir->Names = old->Names;
+	dir->Size = old->Size;
+	dir->Files = old->Files;
+	dir->Dirs = old->Dirs;
+    } else {
+	if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC
+		    | (nofollow ? O_NOFOLLOW : 0))) < 0) {
+	    free(path);
+	    return;
+	}
+	IndexRead(dir, fd);
+	dir->Owned = 1;
+	close(fd);
+    }
+    worker->Count++;
+
+    // skip image names, queue subdirectories
+    s = dir->Names;
+    for (i = 0; i < dir->Files; ++i) {
+	s += strlen(s) + 1;
+    }
+    len = strlen(path);
+    for (i = 0; i < dir->Dirs; ++i) {
+	if (!(sub = malloc(len + strlen(s) + 2))) {
+	    IndexNoMemory();
+	    break;
+	}
+	memcpy(sub, path, len);
+	sub[len] = '/';
+	strcpy(sub + len + 1, s);
+	IndexPush(worker, sub);
+	s += strlen(s) + 1;
+    }
+}
+
+/**
+**	Tree walking thread.
+**
+**	@param arg	own #IndexWorker
+*/
+static void *IndexWalk(void *arg)
+{
+    IndexWorker *worker;
+    char *path;
+    int done;
+
+    worker = arg;
+    for (;;) {
+	if (!(path = IndexPop(worker))) {
+	    pthread_mutex_lock(&IndexMutex);
+	    while (!IndexQueued && IndexPending) {
+		pthread_cond_wait(&IndexCond, &IndexMutex);
+	    }
+	    done = !IndexPending;
+	    pthread_mutex_unlock(&IndexMutex);
+	    if (done) {
+		break;
+	    }
+	    continue;
+	}
+	if (*IndexStop || IndexFailed) {
+	    free(path);
+	} else {
+	    IndexDirScan(worker, path);
+	}
+
+	pthread_mutex_lock(&IndexMutex);
+	if (!--IndexPending) {
+	    pthread_cond_broadcast(&IndexCond);
+	}
+	pthread_mutex_unlock(&IndexMutex);
+    }
+
+    return NULL;
+}
+
+/**
+**	Check names of a record in the index file.
+**
+**	@param names	names of the record
+**	@param size	bytes of names
+**	@param count	number of names
+**
+**	@returns true if there are count '\0' terminated names.
+*/
+static int IndexCheckNames(const char *names, uint32_t size, uint32_t count)
+{
+    const char *s;
+    const char *end;
+
+    end = names + size;
+    for (s = names; count; --count) {
+	if (!(s = memchr(s, '\0', end - s))) {
+	    return 0;
+	}
+	++s;
+    }
+    return s == end;
+}
+
+/**
+**	Load index file.
+**
+**	The whole index is dropped, if any record is damaged: the records
+**	must fit into the file, be sorted and their names terminated.
+**
+**	@param file	index file name
+**	@param[out] size	size of mapping
+**
+**	@returns mapped index file, NULL if missing or invalid.
+*/
+static uint8_t *IndexLoad(const char *file, size_t * size)
+{
+    const IndexHeader *head;
+    const IndexRecord *rec;
+    struct stat st;
+    uint8_t *addr;
+    const char *path;
+    size_t off;
+    size_t len;
+    uint32_t i;
+    int fd;
+
+    if ((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) {
+	return NULL;
+    }
+    addr = MAP_FAILED;
+    if (!fstat(fd, &st) && (size_t)st.st_size >= sizeof(IndexHeader)) {
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) {
+	return NULL;
+    }
+    *size = st.st_size;
+
+    head = (const IndexHeader *)addr;
+    if (head->Magic != INDEX_MAGIC || head->Version != INDEX_VERSION
+	|| head->Count > (*size - sizeof(*head)) / sizeof(*rec)
+	|| !(IndexOld = malloc(head->Count * sizeof(*IndexOld) + 1))) {
+	munmap(addr, *size);
+	return NULL;
+    }
+    off = sizeof(*head);
+    path = NULL;
+    for (i = 0; i < head->Count; ++i) {
+	rec = (const IndexRecord *)(addr + off);
+	if (*size - off < sizeof(*rec)) {
+	    break;			// truncated
+	}
+	len = sizeof(*rec) + (size_t)rec->PathLen + rec->Size;
+	if (*size - off < len || !rec->PathLen
+	    || addr[off + sizeof(*rec) + rec->PathLen - 1]
+	    || (path && strcmp(path, (const char *)(rec + 1)) >= 0)
+	    || (uint64_t) rec->Files + rec->Dirs > rec->Size
+	    || !IndexCheckNames((const char *)(rec + 1) + rec->PathLen,
+		rec->Size, rec->Files + rec->Dirs)) {
+	    break;			// damaged
+	}
+	path = (const char *)(rec + 1);
+	IndexOld[i].Mtime = rec->Mtime;
+	IndexOld[i].Size = rec->Size;
+	IndexOld[i].Files = rec->Files;
+	IndexOld[i].Dirs = rec->Dirs;
+	IndexOld[i].Path = (char *)path;
+	IndexOld[i].Names = (char *)path + rec->PathLen;
+	IndexOld[i].Owned = 0;
+	// records are 8 byte aligned
+	off += (len + 7) & ~7;
+	if (off > *size) {
+	    off = *size;		// padding of the last record
+	}
+    }
+    if (i != head->Count) {
+	free(IndexOld);
+	IndexOld = NULL;
+	munmap(addr, *size);
+	return NULL;
+    }
+    IndexOldCount = i;
+    IndexOldStart = head->Start;
+
+    return addr;
+}
+
+/**
+**	Save index file.
+**
+**	Written to a temporary file and renamed, so a concurrent reader
+**	sees the old or the new index.
+**
+**	@param file	index file name
+**	@param dirs	sorted directory records
+**	@param count	number of directory records
+**	@param start	start time of the scan in ns
+*/
+static void IndexSave(const char *file, const IndexDir * dirs, int count,
+    int64_t start)
+{
+    static const char pad[8];
+    IndexHeader head;
+    IndexRecord rec;
+    char *tmp;
+    FILE *f;
+    int i;
+    int ok;
+
+    tmp = alloca(strlen(file) + 16);	// '.', any pid and '\0'
+    sprintf(tmp, "%s.%d", file, getpid());
+    if (!(f = fopen(tmp, "w"))) {
+	return;
+    }
+    memset(&head, 0, sizeof(head));
+    head.Magic = INDEX_MAGIC;
+    head.Version = INDEX_VERSION;
+    head.Count = count;
+    head.Start = start;
+    ok = fwrite(&head, sizeof(head), 1, f) == 1;
+    for (i = 0; ok && i < count; ++i) {
+	rec.Mtime = dirs[i].Mtime;
+	rec.PathLen = strlen(dirs[i].Path) + 1;
+	rec.Size = dirs[i].Size;
+	rec.Files = dirs[i].Files;
+	rec.Dirs = dirs[i].Dirs;
+	ok = fwrite(&rec, sizeof(rec), 1, f) == 1
+	    && fwrite(dirs[i].Path, rec.PathLen, 1, f) == 1
+	    && (!rec.Size || fwrite(dirs[i].Names, rec.Size, 1, f) == 1)
+	    && fwrite(pad, (8 - (rec.PathLen + rec.Size) % 8) % 8, 1, f) <= 1;
+    }
+    if (fclose(f) || !ok || rename(tmp, file)) {
+	unlink(tmp);
+    }
+}
+
+/**
+**	Find all images of directory tree.
+**
+**	The paths are returned in directory order, the caller shuffles or
+**	sorts them.  The returned array and names are freed with free.
+**
+**	@param root		directory of the tree
+**	@param[out] count	number of images
+**	@param[out] names	storage of the image paths
+**	@param stop		flag abort the scan
+**	@param dir_cb		called for each directory of the tree or NULL
+**	@param persist		use and save index file of the tree
+**
+**	@returns array of image paths, NULL if none found.
+*/
+char **IndexScan(const char *root, int *count, char **names,
+    const volatile char *stop, void (*dir_cb) (const char *), int persist)
+{
+    char file[1024];
+    char base[32];
+    struct stat st;
+    struct timespec ts;
+    int64_t start;
+    IndexDir *dirs;
+    char **paths;
+    uint8_t *old;
+    size_t old_size;
+    size_t size;
+    int changed;
+    size_t len;
+    const char *s;
+    char *d;
+    int n;
+    int i;
+    int j;
+    uint32_t k;
+
+    *count = 0;
+    *names = NULL;
+    if (stat(root, &st)) {
+	return NULL;
+    }
+    IndexRoot = root;
+    IndexDev = st.st_dev;
+    IndexStop = stop;
+    IndexFailed = 0;
+    // mtimes are wall clock
+    clock_gettime(CLOCK_REALTIME, &ts);
+    start = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+    old = NULL;
+    old_size = 0;
+    file[0] = '\0';
+    snprintf(base, sizeof(base), "index-%016llx",
+	(unsigned long long)CacheHash(root));
+    if (persist && !CacheFile(file, sizeof(file), base)) {
+	old = IndexLoad(file, &old_size);
+    }
+
+    //
+    //	Walk the tree in parallel.
+    //
+    pthread_mutex_init(&IndexMutex, NULL);
+    pthread_cond_init(&IndexCond, NULL);
+    for (i = 0; i < INDEX_THREADS; ++i) {
+	pthread_mutex_init(&IndexWorkers[i].Mutex, NULL);
+    }
+    IndexPush(IndexWorkers, strdup(root));
+    for (i = 0; i < INDEX_THREADS; ++i) {
+	if (pthread_create(&IndexWorkers[i].Thread, NULL, IndexWalk,
+		IndexWorkers + i)) {
+	    IndexWorkers[i].Thread = 0;
+	    if (!i) {			// walk without helpers
+		IndexWalk(IndexWorkers);
+	    }
+	}
+    }
+    for (i = 0; i < INDEX_THREADS; ++i) {
+	if (IndexWorkers[i].Thread) {
+	    pthread_join(IndexWorkers[i].Thread, NULL);
+	}
+    }
+
+    //
+    //	Collect the records.
+    //
+    n = 0;
+    for (i = 0; i < INDEX_THREADS; ++i) {
+	n += IndexWorkers[i].Count;
+    }
+    if (!(dirs = malloc(n * sizeof(*dirs) + 1))) {
+	IndexNoMemory();
+    }
+    n = 0;
+    for (i = 0; i < INDEX_THREADS; ++i) {
+	if (dirs) {
+	    memcpy(dirs + n, IndexWorkers[i].Dirs,
+		IndexWorkers[i].Count * sizeof(*dirs));
+	    n += IndexWorkers[i].Count;
+	} else {			// drop the records
+	    for (j = 0; j < IndexWorkers[i].Count; ++j) {
+		free(IndexWorkers[i].Dirs[j].Path);
+		if (IndexWorkers[i].Dirs[j].Owned) {
+		    free(IndexWorkers[i].Dirs[j].Names);
+		}
+	    }
+	}
+	free(IndexWorkers[i].Dirs);
+	free(IndexWorkers[i].Queue);
+	pthread_mutex_destroy(&IndexWorkers[i].Mutex);
+	memset(IndexWorkers + i, 0, sizeof(*IndexWorkers));
+    }
+    pthread_cond_destroy(&IndexCond);
+    pthread_mutex_destroy(&IndexMutex);
+
+    if (n) {
+	qsort(dirs, n, sizeof(*dirs), IndexCompare);
+    }
+    changed = n != IndexOldCount;
+    for (i = 0; !changed && i < n; ++i) {
+	changed = dirs[i].Owned;
+    }
+    if (changed && !*stop && !IndexFailed && *file) {
+	IndexSave(file, dirs, n, start);
+    }
+
+    //
+    //	Build the image paths.
+    //
+    size = 0;
+    j = 0;
+    for (i = 0; i < n; ++i) {
+	len = strlen(dirs[i].Path) + 1;
+	s = dirs[i].Names;
+	for (k = 0; k < dirs[i].Files; ++k) {
+	    size += len + strlen(s) + 1;
+	    s += strlen(s) + 1;
+	}
+	j += dirs[i].Files;
+    }
+    paths = NULL;
+    if (j && (paths = malloc(j * sizeof(*paths)))
+	&& (*names = malloc(size))) {
+	d = *names;
+	j = 0;
+	for (i = 0; i < n; ++i) {
+	    s = dirs[i].Names;
+	    for (k = 0; k < dirs[i].Files; ++k) {
+		paths[j++] = d;
+		d = stpcpy(d, dirs[i].Path);
+		*d++ = '/';
+		d = stpcpy(d, s) + 1;
+		s += strlen(s) + 1;
+	    }
+	}
+	*count = j;
+    } else {
+	free(paths);
+	paths = NULL;
+    }
+
+    for (i = 0; i < n; ++i) {
+	if (dir_cb && !*stop) {
+	    dir_cb(dirs[i].Path);
+	}
+	free(dirs[i].Path);
+	if (dirs[i].Owned) {
+	    free(dirs[i].Names);
+	}
+    }
+    free(dirs);
+    if (old) {
+	munmap(old, old_size);
+    }
+    free(IndexOld);
+    IndexOld = NULL;
+    IndexOldCount = 0;
+    IndexOldStart = 0;
+
+    return paths;
+}
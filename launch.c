@@ -0,0 +1,257 @@
+///
+///	@file launch.c		@brief	Command launcher module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Launch The command launcher module.
+///
+///	Commands (click, -e) are started with posix_spawn, which uses
+///	vfork semantics: the page tables of wmdia with its image caches
+///	aren't copied.  Commands without shell meta characters are split
+///	at white space and executed directly, all others run by /bin/sh.
+///
+///	SIGCHLD is blocked and received with a signalfd in the event loop,
+///	the launched children are reaped there.  Without signalfd a signal
+///	handler reaps them.  Both reap only the launched children, other
+///	children (convert of the image loader) are waited for by their owner.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <spawn.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+
+#include <xcb/xcb.h>
+
+#include "wmdia.h"
+#include "launch.h"
+#include "stats.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define LAUNCH_MAX	32		///< max. running children
+#define LAUNCH_ARGS	64		///< max. arguments without shell
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern char **environ;			///< process environment
+
+static int LaunchFd = -1;		///< signalfd of SIGCHLD
+static volatile pid_t LaunchPids[LAUNCH_MAX];	///< running children
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Wait for terminated children.
+**
+**	Only our children are reaped, others (f.e. convert of the image
+**	loader) are waited for by their owner.  Async signal safe.
+*/
+static void LaunchWait(void)
+{
+    pid_t pid;
+    int status;
+    int i;
+
+    for (i = 0; i < LAUNCH_MAX; ++i) {
+	if ((pid = LaunchPids[i]) && waitpid(pid, &status, WNOHANG)) {
+	    LaunchPids[i] = 0;
+	}
+    }
+}
+
+/**
+**	Reap terminated children, signalfd handler.
+*/
+static void LaunchReap(void)
+{
+    struct signalfd_siginfo info;
+
+    // signals are merged, the count doesn't matter
+    while (read(LaunchFd, &info, sizeof(info)) == sizeof(info)) {
+    }
+    LaunchWait();
+}
+
+/**
+**	Reap terminated children, SIGCHLD handler without signalfd.
+**
+**	@param signum	signal number (unused)
+*/
+static void LaunchSignal( __attribute__ ((unused)) int signum)
+{
+    int err;
+
+    err = errno;
+    LaunchWait();
+    errno = err;
+}
+
+/**
+**	Split command into arguments, if no shell is needed.
+**
+**	@param cmd	command, modified
+**	@param argv	argument vector of #LAUNCH_ARGS entries
+**
+**	@returns false if the command must be run by the shell.
+*/
+static int LaunchSplit(char *cmd, char **argv)
+{
+    char *s;
+    int argc;
+
+    if (strpbrk(cmd, "|&;<>()$`\\\"'*?[]#~=%{}!\n")) {
+	return 0;
+    }
+    argc = 0;
+    for (s = strtok(cmd, " \t"); s; s = strtok(NULL, " \t")) {
+	if (argc == LAUNCH_ARGS - 1) {
+	    return 0;
+	}
+	argv[argc++] = s;
+    }
+    argv[argc] = NULL;
+
+    return argc > 0;
+}
+
+/**
+**	Execute command without waiting.
+**
+**	@param cmd	command line
+**
+**	@returns -1 if the command couldn't be started, 0 otherwise.
+*/
+int LaunchCommand(const char *cmd)
+{
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    char *argv[LAUNCH_ARGS];
+    char *copy;
+    uint64_t trace;
+    pid_t pid;
+    int shell;
+    int err;
+    int i;
+
+    if (!cmd) {				// no command
+	return 0;
+    }
+    copy = alloca(strlen(cmd) + 1);
+    strcpy(copy, cmd);
+    if ((shell = !LaunchSplit(copy, argv))) {
+	argv[0] = "sh";
+	argv[1] = "-c";
+	argv[2] = (char *)cmd;
+	argv[3] = NULL;
+    }
+
+    trace = TraceBegin();
+    posix_spawnattr_init(&attr);
+    // the child gets default signals and its own session
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK
+#ifdef POSIX_SPAWN_SETSID
+	| POSIX_SPAWN_SETSID
+#endif
+	);
+    if (shell) {
+	err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+    } else {
+	err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ);
+    }
+    posix_spawnattr_destroy(&attr);
+    TraceEnd("spawn", trace, err);
+    if (err) {
+	fprintf(stderr, "launch: can't execute '%s': %s\n", cmd,
+	    strerror(err));
+	StatsAdd(StatsSpawnErrors, 1);
+	return -1;
+    }
+    StatsAdd(StatsSpawned, 1);
+
+    for (i = 0; i < LAUNCH_MAX; ++i) {
+	if (!LaunchPids[i]) {
+	    LaunchPids[i] = pid;
+	    return 0;
+	}
+    }
+    // table full, the child stays a zombie until wmdia exits
+    return 0;
+}
+
+/**
+**	Setup command launcher.
+**
+**	Must be called before any thread is created, all threads inherit
+**	the blocked SIGCHLD.
+*/
+void LaunchInit(void)
+{
+    struct sigaction sa;
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if ((LaunchFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+	// SIG_IGN would reap all children, waitpid of convert would fail
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = LaunchSignal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+	return;
+    }
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    LoopAddFd(LaunchFd, LaunchReap);
+}
+
+/**
+**	Cleanup command launcher.
+**
+**	Running children continue, they are reaped by init.
+*/
+void LaunchExit(void)
+{
+    if (LaunchFd >= 0) {
+	LoopDelFd(LaunchFd);
+	close(LaunchFd);
+	LaunchFd = -1;
+    }
+}
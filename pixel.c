@@ -0,0 +1,352 @@
+///
+///	@file pixel.c		@brief	Pixel kernel module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Pixel The pixel kernel module.
+///
+///	The inner loops, which touch every pixel: tile compare of live
+///	frames, XPM conversion and the pixel formats of raw frames.  They
+///	send no X11 requests, wmdiamicro times them outside of wmdia.
+///
+///	Kernels with SIMD variants are in a table with the scalar reference
+///	first, the best supported kernel is selected at runtime.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include <xcb/xcb.h>
+#include <xcb/xcb_image.h>
+
+#include "wmdia.h"
+#include "frame.h"
+#include "pixel.h"
+
+//----------------------------------------------------------------------------
+//	Tile diff
+//----------------------------------------------------------------------------
+
+/**
+**	Compare tiles of shown and new frame, scalar reference.
+**
+**	@param shown	shown frame, #DOCK_SIZE pixels per line
+**	@param pixels	new frame
+**	@param stride	pixels per line of new frame
+**
+**	@returns bit ty * #FRAME_TILES_X + tx set for each changed tile.
+*/
+static uint64_t PixelDiffC(const uint32_t * shown, const uint32_t * pixels,
+    int stride)
+{
+    uint64_t dirty;
+    uint64_t bit;
+    int tx;
+    int y;
+
+    dirty = 0;
+    for (y = 0; y < DOCK_SIZE; ++y) {
+	bit = 1ULL << (y / FRAME_TILE) * FRAME_TILES_X;
+	for (tx = 0; tx < DOCK_SIZE; tx += FRAME_TILE, bit <<= 1) {
+	    if (!(dirty & bit)
+		&& memcmp(shown + y * DOCK_SIZE + tx, pixels + y * stride + tx,
+		    FRAME_TILE * 4)) {
+		dirty |= bit;
+	    }
+	}
+    }
+    return dirty;
+}
+
+/**
+**	Scalar kernel is always supported.
+*/
+static int PixelSupportedC(void)
+{
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+**	Compare tiles of shown and new frame, SSE2.
+**
+**	@param shown	shown frame, #DOCK_SIZE pixels per line
+**	@param pixels	new frame
+**	@param stride	pixels per line of new frame
+**
+**	@returns bit ty * #FRAME_TILES_X + tx set for each changed tile.
+*/
+static uint64_t __attribute__ ((target("sse2")))
+    PixelDiffSSE2(const uint32_t * shown, const uint32_t * pixels, int stride)
+{
+    const __m128i *a;
+    const __m128i *b;
+    __m128i eq;
+    uint64_t dirty;
+    uint32_t row;
+    int tx;
+    int y;
+
+    dirty = 0;
+    for (y = 0; y < DOCK_SIZE; ++y) {
+	a = (const __m128i *)(shown + y * DOCK_SIZE);
+	b = (const __m128i *)(pixels + y * stride);
+	row = 0;
+	for (tx = 0; tx < FRAME_TILES_X; ++tx, a += 2, b += 2) {
+	    eq = _mm_and_si128(_mm_cmpeq_epi32(_mm_loadu_si128(a),
+		    _mm_loadu_si128(b)), _mm_cmpeq_epi32(_mm_loadu_si128(a + 1),
+		    _mm_loadu_si128(b + 1)));
+	    row |= (_mm_movemask_epi8(eq) != 0xFFFF) << tx;
+	}
+	dirty |= (uint64_t) row << (y / FRAME_TILE) * FRAME_TILES_X;
+    }
+    return dirty;
+}
+
+/**
+**	Check if cpu supports SSE2.
+*/
+static int PixelSupportedSSE2(void)
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+/**
+**	Compare tiles of shown and new frame, AVX2.
+**
+**	One 256bit compare is one tile row.
+**
+**	@param shown	shown frame, #DOCK_SIZE pixels per line
+**	@param pixels	new frame
+**	@param stride	pixels per line of new frame
+**
+**	@returns bit ty * #FRAME_TILES_X + tx set for each changed tile.
+*/
+static uint64_t __attribute__ ((target("avx2")))
+    PixelDiffAVX2(const uint32_t * shown, const uint32_t * pixels, int stride)
+{
+    const __m256i *a;
+    const __m256i *b;
+    uint64_t dirty;
+    uint32_t row;
+    int tx;
+    int y;
+
+    dirty = 0;
+    for (y = 0; y < DOCK_SIZE; ++y) {
+	a = (const __m256i *)(shown + y * DOCK_SIZE);
+	b = (const __m256i *)(pixels + y * stride);
+	row = 0;
+	for (tx = 0; tx < FRAME_TILES_X; ++tx) {
+	    row |= (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_loadu_si256(a
+			    + tx), _mm256_loadu_si256(b + tx))) != -1) << tx;
+	}
+	dirty |= (uint64_t) row << (y / FRAME_TILE) * FRAME_TILES_X;
+    }
+    return dirty;
+}
+
+/**
+**	Check if cpu supports AVX2.
+*/
+static int PixelSupportedAVX2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+    /// tile compare kernels, scalar reference first, best last
+const PixelDiffKernel PixelDiffKernels[] = {
+    {"c", PixelDiffC, PixelSupportedC},
+#if defined(__x86_64__) || defined(__i386__)
+    {"sse2", PixelDiffSSE2, PixelSupportedSSE2},
+    {"avx2", PixelDiffAVX2, PixelSupportedAVX2},
+#endif
+    {NULL, NULL, NULL}
+};
+
+//----------------------------------------------------------------------------
+//	XPM
+//----------------------------------------------------------------------------
+
+/**
+**	Convert XPM pixel row with color table.
+**
+**	@param[out] row	image row in host byte order
+**	@param bpp	bits per pixel of row: 32, 16 or 8
+**	@param line	XPM pixel row, one character per pixel
+**	@param table	pixel of each XPM character
+**	@param width	number of pixels
+*/
+void PixelXpmRow(uint8_t * row, int bpp, const char *line,
+    const uint32_t * table, int width)
+{
+    int x;
+
+    switch (bpp) {
+	case 32:
+	    for (x = 0; x < width; x++) {
+		((uint32_t *) row)[x] = table[line[x] & 0xFF];
+	    }
+	    break;
+	case 16:
+	    for (x = 0; x < width; x++) {
+		((uint16_t *) row)[x] = table[line[x] & 0xFF];
+	    }
+	    break;
+	case 8:
+	    for (x = 0; x < width; x++) {
+		row[x] = table[line[x] & 0xFF];
+	    }
+	    break;
+    }
+}
+
+/**
+**	Clear transparent XPM pixels in mask row.
+**
+**	@param[in,out] mask	mask row, LSB first
+**	@param line		XPM pixel row, one character per pixel
+**	@param none		flag for each transparent XPM character
+**	@param width		number of pixels
+*/
+void PixelXpmMask(uint8_t * mask, const char *line, const uint8_t * none,
+    int width)
+{
+    int x;
+
+    for (x = 0; x < width; x++) {
+	if (none[line[x] & 0xFF]) {
+	    mask[x >> 3] &= ~(1 << (x & 7));
+	}
+    }
+}
+
+//----------------------------------------------------------------------------
+//	Raw frame formats
+//----------------------------------------------------------------------------
+
+/**
+**	Clamp color component.
+**
+**	@param c	color component
+*/
+static inline int PixelClamp(int c)
+{
+    return c < 0 ? 0 : c > 255 ? 255 : c;
+}
+
+/**
+**	Convert RGB to 32bit pixel of our visual.
+**
+**	@param r	red component
+**	@param g	green component
+**	@param b	blue component
+*/
+static inline uint32_t PixelRgb(int r, int g, int b)
+{
+    if (NativeRgb) {
+	return (r << 16) | (g << 8) | b;
+    }
+    return RgbPixel(r, g, b);
+}
+
+/**
+**	Convert BGRX pixels to pixels of our visual.
+**
+**	@param[out] dst	native pixels
+**	@param src	B G R X bytes
+**	@param n	number of pixels
+*/
+void PixelFromBGRX(uint32_t * dst, const uint8_t * src, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+	dst[i] = PixelRgb(src[2], src[1], src[0]);
+	src += 4;
+    }
+}
+
+/**
+**	Convert RGB24 pixels to pixels of our visual.
+**
+**	@param[out] dst	native pixels
+**	@param src	R G B bytes
+**	@param n	number of pixels
+*/
+void PixelFromRGB24(uint32_t * dst, const uint8_t * src, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+	dst[i] = PixelRgb(src[0], src[1], src[2]);
+	src += 3;
+    }
+}
+
+/**
+**	Convert planar YUV 4:2:0 image (I420) to pixels of our visual.
+**
+**	ITU-R BT.601 limited range.
+**
+**	@param[out] dst	native pixels
+**	@param src	Y plane followed by U and V planes
+**	@param width	image width, even
+**	@param height	image height, even
+*/
+void PixelFromYUV420(uint32_t * dst, const uint8_t * src, int width,
+    int height)
+{
+    const uint8_t *u;
+    const uint8_t *v;
+    int i;
+    int x;
+    int y;
+
+    u = src + width * height;
+    v = u + width * height / 4;
+    for (y = 0; y < height; ++y) {
+	for (x = 0; x < width; ++x) {
+	    int c;
+	    int d;
+	    int e;
+
+	    c = 298 * (src[y * width + x] - 16) + 128;
+	    i = (y / 2) * (width / 2) + x / 2;
+	    d = u[i] - 128;
+	    e = v[i] - 128;
+	    *dst++ = PixelRgb(PixelClamp((c + 409 * e) >> 8),
+		PixelClamp((c - 100 * d - 208 * e) >> 8),
+		PixelClamp((c + 516 * d) >> 8));
+	}
+    }
+}
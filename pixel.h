@@ -0,0 +1,68 @@
+///
+///	@file pixel.h		@brief	Pixel kernel module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Pixel
+/// @{
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Available tile compare kernels.
+///
+typedef struct _pixel_diff_kernel_
+{
+    const char *Name;			///< kernel name
+    FrameDiffFunc *Diff;		///< compare function
+    int (*Supported) (void);		///< check if cpu supports kernel
+} PixelDiffKernel;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+    /// tile compare kernels, scalar reference first, NULL terminated
+extern const PixelDiffKernel PixelDiffKernels[];
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Convert XPM pixel row with color table.
+extern void PixelXpmRow(uint8_t *, int, const char *, const uint32_t *, int);
+
+    /// Clear transparent XPM pixels in mask row.
+extern void PixelXpmMask(uint8_t *, const char *, const uint8_t *, int);
+
+    /// Convert BGRX pixels to pixels of our visual.
+extern void PixelFromBGRX(uint32_t *, const uint8_t *, int);
+
+    /// Convert RGB24 pixels to pixels of our visual.
+extern void PixelFromRGB24(uint32_t *, const uint8_t *, int);
+
+    /// Convert planar YUV 4:2:0 image to pixels of our visual.
+extern void PixelFromYUV420(uint32_t *, const uint8_t *, int, int);
+
+/// @}
@@ -35,3 +35,5 @@ setcommand ""
 mplayer -wid $wid -vf scale=62:-3 -vo x11 -ao null "$@"
 # full sized
 #mplayer -wid $wid -zoom -vo x11 -ao null "$@"
+# or without X11 video output, raw frames into: wmdia -i /tmp/wmdia.raw
+#ffmpeg -re -i "$1" -vf scale=64:64 -f rawvideo -pix_fmt bgr0 -y /tmp/wmdia.raw
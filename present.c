@@ -0,0 +1,500 @@
+///
+///	@file present.c		@brief	Frame presentation module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Present The frame presentation module.
+///
+///	Live frames are shown with the X Present extension instead of
+///	rewriting the window background pixmap.  Each dock has a small pool
+///	of back buffer pixmaps, a frame is uploaded into an idle buffer and
+///	presented at the next vblank, without tearing.
+///
+///	A buffer is written again only after its PresentIdleNotify.  Only
+///	one present per dock is in flight; frames received meanwhile wait
+///	for its PresentCompleteNotify, only the newest one is presented.
+///	The completion time is reported to the frame feed of the dock.
+///
+///	Each buffer keeps a copy of its pixels, only the tiles changed since
+///	the buffer was presented last are uploaded.
+///
+///	Without the Present extension (or -X), frames are written into the
+///	window background as before.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <xcb/xcb.h>
+#include <xcb/present.h>
+#include <xcb/xcb_image.h>
+
+#include "wmdia.h"
+#include "frame.h"
+#include "feed.h"
+#include "stats.h"
+#include "trace.h"
+#include "present.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define PRESENT_BUFFERS	3		///< back buffers per dock
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Back buffer of a dock.
+///
+typedef struct _present_buffer_
+{
+    xcb_pixmap_t Pixmap;		///< back buffer pixmap
+    char Busy;				///< presented, waiting for idle notify
+    char Valid;				///< Pixels are the pixmap contents
+    uint32_t Pixels[DOCK_SIZE * DOCK_SIZE];	///< copy of pixmap contents
+} PresentBuffer;
+
+///
+///	Presentation state of a dock.
+///
+struct _dock_present_
+{
+    Dock *Dock;				///< presenting dock
+    xcb_present_event_t Event;		///< event id of the window
+    uint32_t Serial;			///< serial of the last present
+    int Last;				///< buffer presented last, -1 none
+    int Shown;				///< buffer of last completion, -1 none
+    char InFlight;			///< present not completed
+    char HasPending;			///< frame waits for the completion
+    uint32_t Sequence;			///< producer sequence of in flight
+    uint32_t PendingSequence;		///< producer sequence of pending
+    uint64_t Start;			///< stats time of in flight present
+    uint64_t Trace;			///< trace time of in flight present
+    PresentBuffer Buffers[PRESENT_BUFFERS];	///< back buffers
+    uint32_t Pending[DOCK_SIZE * DOCK_SIZE];	///< newest frame waiting
+};
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+int PresentDisabled;			///< don't use the Present extension
+
+static uint8_t PresentOpcode;		///< major opcode, 0 if not available
+static char PresentVersionPending;	///< version reply not yet collected
+    /// version request sent by PresentInit
+static xcb_present_query_version_cookie_t PresentVersionCookie;
+
+static DockPresent **PresentDocks;	///< docks with back buffers
+static int PresentDockCount;		///< number of presenting docks
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Check if the Present extension can be used.
+**
+**	The version reply is collected with the first frame.
+**
+**	@returns true if frames are presented.
+*/
+static int PresentUsable(void)
+{
+    xcb_present_query_version_reply_t *reply;
+
+    if (PresentVersionPending) {
+	PresentVersionPending = 0;
+	reply =
+	    xcb_present_query_version_reply(Connection, PresentVersionCookie,
+	    NULL);
+	if (!reply) {
+	    PresentOpcode = 0;
+	}
+	free(reply);
+    }
+    return PresentOpcode != 0;
+}
+
+/**
+**	Create the back buffers of a dock.
+**
+**	@param dock	dock window
+**
+**	@returns presentation state of the dock, NULL on error.
+*/
+static DockPresent *PresentOpen(Dock * dock)
+{
+    DockPresent **docks;
+    DockPresent *present;
+    int i;
+
+    if (!(present = calloc(1, sizeof(*present)))) {
+	return NULL;
+    }
+    if (!(docks = realloc(PresentDocks,
+		(PresentDockCount + 1) * sizeof(*docks)))) {
+	free(present);
+	return NULL;
+    }
+    PresentDocks = docks;
+    PresentDocks[PresentDockCount++] = present;
+
+    present->Dock = dock;
+    present->Last = -1;
+    present->Shown = -1;
+    for (i = 0; i < PRESENT_BUFFERS; ++i) {
+	present->Buffers[i].Pixmap = xcb_generate_id(Connection);
+	xcb_create_pixmap(Connection, Screen->root_depth,
+	    present->Buffers[i].Pixmap, Screen->root, DOCK_SIZE, DOCK_SIZE);
+    }
+    present->Event = xcb_generate_id(Connection);
+    xcb_present_select_input(Connection, present->Event, dock->Window,
+	XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY |
+	XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY);
+    dock->Present = present;
+
+    return present;
+}
+
+/**
+**	Upload frame into an idle back buffer and present it.
+**
+**	@param present	presentation state of the dock
+**	@param pixels	#DOCK_SIZE x #DOCK_SIZE native 32bit pixels
+**	@param stride	pixels per line
+**	@param sequence	producer sequence of the frame
+**
+**	@returns false if no buffer is idle, the frame must wait.
+*/
+static int PresentPut(DockPresent * present, const uint32_t * pixels,
+    int stride, uint32_t sequence)
+{
+    xcb_rectangle_t rects[FRAME_RECTS_MAX];
+    xcb_rectangle_t *r;
+    PresentBuffer *buffer;
+    uint64_t dirty;
+    int n;
+    int i;
+    int y;
+
+    if (present->Last >= 0
+	&& !FrameDiff(present->Buffers[present->Last].Pixels, pixels,
+	    stride)) {
+	StatsAdd(StatsFramesUnchanged, 1);
+	return 1;
+    }
+    for (i = 0; i < PRESENT_BUFFERS; ++i) {
+	if (!present->Buffers[i].Busy && i != present->Last) {
+	    break;
+	}
+    }
+    if (i == PRESENT_BUFFERS) {		// server still uses all buffers
+	return 0;
+    }
+    buffer = present->Buffers + i;
+
+    // only the tiles changed since this buffer was presented
+    if (!buffer->Valid) {
+	rects[0].x = 0;
+	rects[0].y = 0;
+	rects[0].width = DOCK_SIZE;
+	rects[0].height = DOCK_SIZE;
+	n = 1;
+	buffer->Valid = 1;
+    } else {
+	dirty = FrameDiff(buffer->Pixels, pixels, stride);
+	n = FrameDirtyRects(dirty, rects);
+    }
+    for (r = rects; r < rects + n; ++r) {
+	FramePut(buffer->Pixmap, r->x, r->y, r->width, r->height,
+	    pixels + r->y * stride + r->x, stride);
+	for (y = r->y; y < r->y + r->height; ++y) {
+	    memcpy(buffer->Pixels + y * DOCK_SIZE + r->x,
+		pixels + y * stride + r->x, r->width * sizeof(*pixels));
+	}
+    }
+
+    xcb_present_pixmap(Connection, present->Dock->Window, buffer->Pixmap,
+	++present->Serial, 0, 0, 0, 0, 0, 0, 0, XCB_PRESENT_OPTION_NONE, 0,
+	0, 0, 0, NULL);
+    buffer->Busy = 1;
+    present->Last = i;
+    present->InFlight = 1;
+    present->Sequence = sequence;
+    present->Start = StatsMicros();
+    present->Trace = TraceBegin();
+    StatsAdd(StatsFramesShown, 1);
+
+    return 1;
+}
+
+/**
+**	Present frame in a dock window.
+**
+**	The first frame after a slide takes the window back, its background
+**	is removed, exposures are repainted from the shown buffer.
+**
+**	@param dock	dock window
+**	@param pixels	#DOCK_SIZE x #DOCK_SIZE native 32bit pixels
+**	@param stride	pixels per line
+**
+**	@returns false if the Present extension isn't used, the caller
+**	must show the frame itself.
+*/
+int PresentFrame(Dock * dock, const uint32_t * pixels, int stride)
+{
+    DockPresent *present;
+    uint32_t value;
+    int y;
+
+    if (!PresentUsable()) {
+	return 0;
+    }
+    if (!(present = dock->Present) && !(present = PresentOpen(dock))) {
+	return 0;
+    }
+    if (!dock->FrameBackground) {	// slide was shown meanwhile
+	value = XCB_BACK_PIXMAP_NONE;
+	xcb_change_window_attributes(Connection, dock->Window,
+	    XCB_CW_BACK_PIXMAP, &value);
+	dock->FrameBackground = 1;
+	present->Last = -1;		// present even an unchanged frame
+    }
+
+    if (present->InFlight
+	|| !PresentPut(present, pixels, stride, dock->FrameSequence)) {
+	// paced by the completion, only the newest frame is presented
+	if (present->HasPending) {
+	    StatsAdd(StatsPresentSkipped, 1);
+	}
+	for (y = 0; y < DOCK_SIZE; ++y) {
+	    memcpy(present->Pending + y * DOCK_SIZE, pixels + y * stride,
+		DOCK_SIZE * sizeof(*pixels));
+	}
+	present->PendingSequence = dock->FrameSequence;
+	present->HasPending = 1;
+    }
+    return 1;
+}
+
+/**
+**	Repaint exposed area of a presenting dock.
+**
+**	The window has no background while frames are presented.
+**
+**	@param dock	dock window
+**	@param event	expose event of the dock window
+*/
+void PresentExpose(Dock * dock, const xcb_expose_event_t * event)
+{
+    DockPresent *present;
+
+    if (!(present = dock->Present) || !dock->FrameBackground
+	|| present->Shown < 0) {
+	return;
+    }
+    xcb_copy_area(Connection, present->Buffers[present->Shown].Pixmap,
+	dock->Window, NormalGC, event->x, event->y, event->x, event->y,
+	event->width, event->height);
+    if (!event->count) {
+	xcb_flush(Connection);
+    }
+}
+
+/**
+**	Present the waiting frame.
+**
+**	@param present	presentation state of the dock
+*/
+static void PresentPending(DockPresent * present)
+{
+    if (present->HasPending && !present->InFlight
+	&& PresentPut(present, present->Pending, DOCK_SIZE,
+	    present->PendingSequence)) {
+	present->HasPending = 0;
+	xcb_flush(Connection);
+    }
+}
+
+/**
+**	Present of a dock completed.
+**
+**	@param present	presentation state of the dock
+**	@param event	complete notify event
+*/
+static void PresentComplete(DockPresent * present,
+    const xcb_present_complete_notify_event_t * event)
+{
+    Dock *dock;
+
+    if (event->kind != XCB_PRESENT_COMPLETE_KIND_PIXMAP
+	|| event->serial != present->Serial) {
+	return;
+    }
+    dock = present->Dock;
+    present->InFlight = 0;
+    present->Shown = present->Last;
+    StatsTime(StatsPresentTime, present->Start);
+    TraceEnd("present", present->Trace, event->msc);
+    if (dock->Feed) {
+	FeedPresented(dock, present->Sequence, event->ust);
+    }
+    if (!dock->FrameBackground) {	// slide was shown meanwhile
+	xcb_clear_area(Connection, 0, dock->Window, 0, 0, DOCK_SIZE,
+	    DOCK_SIZE);
+	xcb_flush(Connection);
+    }
+    PresentPending(present);
+}
+
+/**
+**	Back buffer of a dock is idle.
+**
+**	@param present	presentation state of the dock
+**	@param event	idle notify event
+*/
+static void PresentIdle(DockPresent * present,
+    const xcb_present_idle_notify_event_t * event)
+{
+    int i;
+
+    for (i = 0; i < PRESENT_BUFFERS; ++i) {
+	if (present->Buffers[i].Pixmap == event->pixmap) {
+	    present->Buffers[i].Busy = 0;
+	    PresentPending(present);
+	    break;
+	}
+    }
+}
+
+/**
+**	Handle presentation events.
+**
+**	@param event	X11 event
+**
+**	@returns true if the event was a presentation event.
+*/
+int PresentEvent(const xcb_generic_event_t * event)
+{
+    const xcb_ge_generic_event_t *ge;
+    const xcb_present_complete_notify_event_t *complete;
+    int i;
+
+    ge = (const xcb_ge_generic_event_t *)event;
+    if (!PresentOpcode || (event->response_type & 0x7F) != XCB_GE_GENERIC
+	|| ge->extension != PresentOpcode) {
+	return 0;
+    }
+    // complete and idle notify have the event id at the same offset
+    complete = (const xcb_present_complete_notify_event_t *)event;
+    for (i = 0; i < PresentDockCount; ++i) {
+	if (PresentDocks[i]->Event != complete->event) {
+	    continue;
+	}
+	switch (ge->event_type) {
+	    case XCB_PRESENT_EVENT_COMPLETE_NOTIFY:
+		PresentComplete(PresentDocks[i], complete);
+		break;
+	    case XCB_PRESENT_EVENT_IDLE_NOTIFY:
+		PresentIdle(PresentDocks[i],
+		    (const xcb_present_idle_notify_event_t *)event);
+		break;
+	}
+	break;
+    }
+    return 1;
+}
+
+/**
+**	Remove the back buffers of a dock.
+**
+**	@param dock	dock window, may be already destroyed
+*/
+void PresentClose(Dock * dock)
+{
+    DockPresent *present;
+    int i;
+
+    if (!(present = dock->Present)) {
+	return;
+    }
+    for (i = 0; i < PRESENT_BUFFERS; ++i) {
+	xcb_free_pixmap(Connection, present->Buffers[i].Pixmap);
+    }
+    for (i = 0; i < PresentDockCount; ++i) {
+	if (PresentDocks[i] == present) {
+	    memmove(PresentDocks + i, PresentDocks + i + 1,
+		(PresentDockCount - i - 1) * sizeof(*PresentDocks));
+	    PresentDockCount--;
+	    break;
+	}
+    }
+    if (!PresentDockCount) {
+	free(PresentDocks);
+	PresentDocks = NULL;
+    }
+    free(present);
+    dock->Present = NULL;
+}
+
+/**
+**	Request extension data needed by PresentInit.
+**
+**	Called before the window is mapped, the reply is collected later.
+*/
+void PresentPrefetch(void)
+{
+    if (!PresentDisabled) {
+	xcb_prefetch_extension_data(Connection, &xcb_present_id);
+    }
+}
+
+/**
+**	Setup frame presentation.
+**
+**	The version request is sent, its reply is collected with the first
+**	frame.
+*/
+void PresentInit(void)
+{
+    const xcb_query_extension_reply_t *ext;
+
+    if (PresentDisabled) {
+	return;
+    }
+    ext = xcb_get_extension_data(Connection, &xcb_present_id);
+    if (!ext || !ext->present) {
+	return;
+    }
+    PresentOpcode = ext->major_opcode;
+    PresentVersionCookie =
+	xcb_present_query_version_unchecked(Connection,
+	XCB_PRESENT_MAJOR_VERSION, XCB_PRESENT_MINOR_VERSION);
+    PresentVersionPending = 1;
+}
@@ -0,0 +1,56 @@
+///
+///	@file present.h		@brief	Frame presentation module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Present
+/// @{
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern int PresentDisabled;		///< don't use the Present extension
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Present frame in a dock window.
+extern int PresentFrame(Dock *, const uint32_t *, int);
+
+    /// Repaint exposed area of a presenting dock.
+extern void PresentExpose(Dock *, const xcb_expose_event_t *);
+
+    /// Handle presentation events.
+extern int PresentEvent(const xcb_generic_event_t *);
+
+    /// Remove the back buffers of a dock.
+extern void PresentClose(Dock *);
+
+    /// Request extension data needed by PresentInit.
+extern void PresentPrefetch(void);
+
+    /// Setup frame presentation.
+extern void PresentInit(void);
+
+/// @}
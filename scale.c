@@ -0,0 +1,431 @@
+///
+///	@file scale.c		@brief	Image scaler module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Scale The image scaler module.
+///
+///	Streaming area-averaging (box) scaler.  Source rows are accumulated
+///	vertically with their coverage weight, this touches every source
+///	pixel and is done by SSE2/AVX2 kernels selected at runtime.  Each
+///	completed destination row is reduced horizontally and written
+///	directly as pixels of our visual.
+///
+///	All coordinates are in units of 1 / (dst * src) pixel, so all
+///	weights are integers.  A vertical weight is never larger than the
+///	smaller height, which is at most #DIA_SIZE for dias, 255 * weight
+///	fits into 16 bit.
+///
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include <xcb/xcb.h>
+
+#include "wmdia.h"
+#include "scale.h"
+
+//----------------------------------------------------------------------------
+//	Kernels
+//----------------------------------------------------------------------------
+
+/**
+**	Accumulate weighted source row, scalar reference.
+**
+**	@param accu	accumulator
+**	@param row	source row bytes
+**	@param n	number of bytes
+**	@param weight	weight of source row (<= 128)
+*/
+static void ScaleAccumulateC(uint32_t * accu, const uint8_t * row, int n,
+    int weight)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+	accu[i] += weight * row[i];
+    }
+}
+
+/**
+**	Scalar kernel is always supported.
+*/
+static int ScaleSupportedC(void)
+{
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+**	Accumulate weighted source row, SSE2.
+**
+**	@param accu	accumulator
+**	@param row	source row bytes
+**	@param n	number of bytes
+**	@param weight	weight of source row (<= 128)
+*/
+static void __attribute__ ((target("sse2")))
+    ScaleAccumulateSSE2(uint32_t * accu, const uint8_t * row, int n,
+    int weight)
+{
+    __m128i zero;
+    __m128i w;
+    __m128i p;
+    __m128i lo;
+    __m128i hi;
+    int i;
+
+    zero = _mm_setzero_si128();
+    w = _mm_set1_epi16(weight);
+    for (i = 0; i + 16 <= n; i += 16) {
+	p = _mm_loadu_si128((const __m128i *)(row + i));
+	lo = _mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), w);
+	hi = _mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), w);
+
+	_mm_storeu_si128((__m128i *) (accu + i + 0),
+	    _mm_add_epi32(_mm_loadu_si128((__m128i *) (accu + i + 0)),
+		_mm_unpacklo_epi16(lo, zero)));
+	_mm_storeu_si128((__m128i *) (accu + i + 4),
+	    _mm_add_epi32(_mm_loadu_si128((__m128i *) (accu + i + 4)),
+		_mm_unpackhi_epi16(lo, zero)));
+	_mm_storeu_si128((__m128i *) (accu + i + 8),
+	    _mm_add_epi32(_mm_loadu_si128((__m128i *) (accu + i + 8)),
+		_mm_unpacklo_epi16(hi, zero)));
+	_mm_storeu_si128((__m128i *) (accu + i + 12),
+	    _mm_add_epi32(_mm_loadu_si128((__m128i *) (accu + i + 12)),
+		_mm_unpackhi_epi16(hi, zero)));
+    }
+    for (; i < n; ++i) {
+	accu[i] += weight * row[i];
+    }
+}
+
+/**
+**	Check if cpu supports SSE2.
+*/
+static int ScaleSupportedSSE2(void)
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+/**
+**	Accumulate weighted source row, AVX2.
+**
+**	@param accu	accumulator
+**	@param row	source row bytes
+**	@param n	number of bytes
+**	@param weight	weight of source row (<= 128)
+*/
+static void __attribute__ ((target("avx2")))
+    ScaleAccumulateAVX2(uint32_t * accu, const uint8_t * row, int n,
+    int weight)
+{
+    __m256i w;
+    __m256i lo;
+    __m256i hi;
+    int i;
+
+    w = _mm256_set1_epi16(weight);
+    for (i = 0; i + 32 <= n; i += 32) {
+	// zero extend keeps the byte order, no lane crossing later
+	lo = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const
+			__m128i *)(row + i))), w);
+	hi = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const
+			__m128i *)(row + i + 16))), w);
+
+	_mm256_storeu_si256((__m256i *) (accu + i + 0),
+	    _mm256_add_epi32(_mm256_loadu_si256((__m256i *) (accu + i + 0)),
+		_mm256_cvtepu16_epi32(_mm256_castsi256_si128(lo))));
+	_mm256_storeu_si256((__m256i *) (accu + i + 8),
+	    _mm256_add_epi32(_mm256_loadu_si256((__m256i *) (accu + i + 8)),
+		_mm256_cvtepu16_epi32(_mm256_extracti128_si256(lo, 1))));
+	_mm256_storeu_si256((__m256i *) (accu + i + 16),
+	    _mm256_add_epi32(_mm256_loadu_si256((__m256i *) (accu + i + 16)),
+		_mm256_cvtepu16_epi32(_mm256_castsi256_si128(hi))));
+	_mm256_storeu_si256((__m256i *) (accu + i + 24),
+	    _mm256_add_epi32(_mm256_loadu_si256((__m256i *) (accu + i + 24)),
+		_mm256_cvtepu16_epi32(_mm256_extracti128_si256(hi, 1))));
+    }
+    for (; i < n; ++i) {
+	accu[i] += weight * row[i];
+    }
+}
+
+/**
+**	Check if cpu supports AVX2.
+*/
+static int ScaleSupportedAVX2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+    /// accumulate kernels, scalar reference first, best last
+const ScaleKernel ScaleKernels[] = {
+    {"c", ScaleAccumulateC, ScaleSupportedC},
+#if defined(__x86_64__) || defined(__i386__)
+    {"sse2", ScaleAccumulateSSE2, ScaleSupportedSSE2},
+    {"avx2", ScaleAccumulateAVX2, ScaleSupportedAVX2},
+#endif
+    {NULL, NULL, NULL}
+};
+
+    /// selected accumulate kernel
+ScaleAccumulateFunc *ScaleAccumulate = ScaleAccumulateC;
+
+//----------------------------------------------------------------------------
+//	Scaler
+//----------------------------------------------------------------------------
+
+/**
+**	Prepare scaler.
+**
+**	@param scaler		scaler
+**	@param src_width	source width
+**	@param src_height	source height
+**	@param dst_width	destination width
+**	@param dst_height	destination height
+**	@param dst		destination native pixels
+**	@param dst_stride	pixels per destination line
+**
+**	@returns -1 if out of memory, 0 otherwise.
+*/
+int ScalerInit(Scaler * scaler, int src_width, int src_height,
+    int dst_width, int dst_height, uint32_t * dst, int dst_stride)
+{
+    scaler->SrcWidth = src_width;
+    scaler->SrcHeight = src_height;
+    scaler->DstWidth = dst_width;
+    scaler->DstHeight = dst_height;
+    scaler->SrcY = 0;
+    scaler->DstY = 0;
+    scaler->Dst = dst;
+    scaler->DstStride = dst_stride;
+    scaler->Accu = calloc(src_width * 3, sizeof(*scaler->Accu));
+
+    return scaler->Accu ? 0 : -1;
+}
+
+/**
+**	Free scaler.
+**
+**	@param scaler	scaler
+*/
+void ScalerExit(Scaler * scaler)
+{
+    free(scaler->Accu);
+    scaler->Accu = NULL;
+}
+
+/**
+**	Reduce accumulated row horizontally into destination row.
+**
+**	@param scaler	scaler
+*/
+static void ScalerEmitRow(Scaler * scaler)
+{
+    uint32_t *dst;
+    uint64_t sum[3];
+    uint64_t total;
+    int x;
+    int sx;
+    int w;
+    int start;
+    int end;
+    int src_start;
+    int src_end;
+
+    dst = scaler->Dst + scaler->DstY * scaler->DstStride;
+    // each destination pixel covers src_width * src_height units
+    total = (uint64_t) scaler->SrcWidth * scaler->SrcHeight;
+    for (x = 0; x < scaler->DstWidth; ++x) {
+	start = x * scaler->SrcWidth;
+	end = start + scaler->SrcWidth;
+	sum[0] = sum[1] = sum[2] = 0;
+	for (sx = start / scaler->DstWidth; sx * scaler->DstWidth < end; ++sx) {
+	    src_start = sx * scaler->DstWidth;
+	    src_end = src_start + scaler->DstWidth;
+	    w = (src_end < end ? src_end : end) - (src_start >
+		start ? src_start : start);
+	    sum[0] += (uint64_t) w *scaler->Accu[sx * 3 + 0];
+	    sum[1] += (uint64_t) w *scaler->Accu[sx * 3 + 1];
+	    sum[2] += (uint64_t) w *scaler->Accu[sx * 3 + 2];
+	}
+	sum[0] = (sum[0] + total / 2) / total;
+	sum[1] = (sum[1] + total / 2) / total;
+	sum[2] = (sum[2] + total / 2) / total;
+	dst[x] = NativeRgb ? (sum[0] << 16) | (sum[1] << 8) | sum[2]
+	    : RgbPixel(sum[0], sum[1], sum[2]);
+    }
+    memset(scaler->Accu, 0, scaler->SrcWidth * 3 * sizeof(*scaler->Accu));
+    scaler->DstY++;
+}
+
+/**
+**	Add source RGB row.
+**
+**	@param scaler	scaler
+**	@param row	source RGB row
+*/
+void ScalerPutRow(Scaler * scaler, const uint8_t * row)
+{
+    int start;
+    int end;
+    int w;
+
+    // source row covers [start, end), destination row dst_y * src_height
+    start = scaler->SrcY * scaler->DstHeight;
+    end = start + scaler->DstHeight;
+    while (scaler->DstY < scaler->DstHeight) {
+	int dst_start;
+	int dst_end;
+
+	dst_start = scaler->DstY * scaler->SrcHeight;
+	dst_end = dst_start + scaler->SrcHeight;
+	if (dst_start >= end) {		// source row used up
+	    break;
+	}
+	w = (end < dst_end ? end : dst_end) - (start >
+	    dst_start ? start : dst_start);
+	ScaleAccumulate(scaler->Accu, row, scaler->SrcWidth * 3, w);
+	if (dst_end > end) {		// destination row needs more rows
+	    break;
+	}
+	ScalerEmitRow(scaler);
+    }
+    scaler->SrcY++;
+}
+
+/**
+**	Calculate size of image fitting into the dia.
+**
+**	@param width		image width
+**	@param height		image height
+**	@param[out] dw		scaled width
+**	@param[out] dh		scaled height
+*/
+void ScaleFit(int width, int height, int *dw, int *dh)
+{
+    if (width >= height) {
+	*dw = DIA_SIZE;
+	*dh = (height * DIA_SIZE + width / 2) / width;
+    } else {
+	*dh = DIA_SIZE;
+	*dw = (width * DIA_SIZE + height / 2) / height;
+    }
+    if (*dw < 1) {
+	*dw = 1;
+    }
+    if (*dh < 1) {
+	*dh = 1;
+    }
+}
+
+/**
+**	Fit and center image into dia.
+**
+**	The dia is filled with darkgray and the scaler is prepared to write
+**	the image with kept aspect ratio centered into it.
+**
+**	@param scaler	scaler
+**	@param width	source width
+**	@param height	source height
+**	@param dia	#DIA_SIZE x #DIA_SIZE native pixels
+**	@param stride	pixels per dia line
+**
+**	@returns -1 if out of memory, 0 otherwise.
+*/
+int ScalerInitDia(Scaler * scaler, int width, int height, uint32_t * dia,
+    int stride)
+{
+    uint32_t border;
+    int dw;
+    int dh;
+    int x;
+    int y;
+
+    ScaleFit(width, height, &dw, &dh);
+    border = RgbPixel(0xA9, 0xA9, 0xA9);	// darkgray
+    for (y = 0; y < DIA_SIZE; ++y) {
+	for (x = 0; x < DIA_SIZE; ++x) {
+	    dia[y * stride + x] = border;
+	}
+    }
+
+    return ScalerInit(scaler, width, height, dw, dh,
+	dia + (DIA_SIZE - dh) / 2 * stride + (DIA_SIZE - dw) / 2, stride);
+}
+
+//----------------------------------------------------------------------------
+//	Setup
+//----------------------------------------------------------------------------
+
+/**
+**	Select accumulate kernel by name.
+**
+**	@param name	kernel name (c, sse2, avx2)
+**
+**	@returns -1 if unknown or not supported by the cpu, 0 otherwise.
+*/
+int ScaleSetKernel(const char *name)
+{
+    int i;
+
+    for (i = 0; ScaleKernels[i].Name; ++i) {
+	if (!strcmp(ScaleKernels[i].Name, name)) {
+	    if (!ScaleKernels[i].Supported()) {
+		return -1;
+	    }
+	    ScaleAccumulate = ScaleKernels[i].Accumulate;
+	    return 0;
+	}
+    }
+    return -1;
+}
+
+/**
+**	Select best accumulate kernel of cpu.
+**
+**	The environment variable WMDIA_SCALE can select a kernel.
+*/
+void ScaleInit(void)
+{
+    const char *name;
+    int i;
+
+    if ((name = getenv("WMDIA_SCALE")) && !ScaleSetKernel(name)) {
+	return;
+    }
+    for (i = 0; ScaleKernels[i].Name; ++i) {
+	if (ScaleKernels[i].Supported()) {
+	    ScaleAccumulate = ScaleKernels[i].Accumulate;
+	}
+    }
+}
@@ -0,0 +1,98 @@
+///
+///	@file scale.h		@brief	Image scaler module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Scale
+/// @{
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Streaming area-averaging scaler.
+///
+typedef struct _scaler_
+{
+    int SrcWidth;			///< source width
+    int SrcHeight;			///< source height
+    int DstWidth;			///< destination width
+    int DstHeight;			///< destination height
+    int SrcY;				///< next source row
+    int DstY;				///< destination row accumulated
+    uint32_t *Accu;			///< weighted sum of source rows
+    uint32_t *Dst;			///< destination native pixels
+    int DstStride;			///< pixels per destination line
+} Scaler;
+
+///
+///	Accumulate kernel: accu[i] += weight * row[i].
+///
+typedef void ScaleAccumulateFunc(uint32_t *, const uint8_t *, int, int);
+
+///
+///	Available accumulate kernels.
+///
+typedef struct _scale_kernel_
+{
+    const char *Name;			///< kernel name
+    ScaleAccumulateFunc *Accumulate;	///< accumulate function
+    int (*Supported) (void);		///< check if cpu supports kernel
+} ScaleKernel;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+    /// accumulate kernels, scalar reference first, NULL terminated
+extern const ScaleKernel ScaleKernels[];
+
+    /// selected accumulate kernel
+extern ScaleAccumulateFunc *ScaleAccumulate;
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Prepare scaler.
+extern int ScalerInit(Scaler *, int, int, int, int, uint32_t *, int);
+
+    /// Add source RGB row.
+extern void ScalerPutRow(Scaler *, const uint8_t *);
+
+    /// Free scaler.
+extern void ScalerExit(Scaler *);
+
+    /// Calculate size of image fitting into the dia.
+extern void ScaleFit(int, int, int *, int *);
+
+    /// Fit and center image into dia.
+extern int ScalerInitDia(Scaler *, int, int, uint32_t *, int);
+
+    /// Select accumulate kernel by name.
+extern int ScaleSetKernel(const char *);
+
+    /// Select best accumulate kernel of cpu.
+extern void ScaleInit(void);
+
+/// @}
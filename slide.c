@@ -0,0 +1,1820 @@
+///
+///	@file slide.c		@brief	Slideshow module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Slide The slideshow module.
+///
+///	This module replaces the diashow.sh script.  Each dock can have its
+///	own slideshow.  One worker thread serves all slideshows, it builds
+///	the playlists, decodes and scales the next images and uploads them
+///	into the rings of ready dock pixmaps.  The main thread only swaps
+///	the window background and updates the TOOLTIP/COMMAND properties.
+///
+///	The pixmap cache of shown slides is shared by all slideshows, the
+///	prefetch depth is divided between them.  Slides of the history
+///	evicted from the pixmap cache are reloaded by the worker too, it
+///	wakes the main thread through an eventfd.  So only the worker uses
+///	the thumbnail cache and the main thread never decodes.  Other
+///	modules decode images on the worker with SlideDecode.
+///
+///	Slides are crossfaded with XRender in the server: each fade frame
+///	composites the previous slide and the new slide through a solid
+///	alpha mask into a fade pixmap, the window background.  One frame
+///	timer serves all fading shows.  A frame of all shows has a CPU
+///	budget, the alpha follows the time, late frames are skipped.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xcb_image.h>
+#include <xcb/render.h>
+
+#include "wmdia.h"
+#include "frame.h"
+#include "image.h"
+#include "cache.h"
+#include "index.h"
+#include "slide.h"
+#include "stats.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define SLIDE_PREFETCH	4		///< prefetched slides of all shows
+#define SLIDE_HISTORY	64		///< number of shown slides to go back
+
+    /// server memory of one dock pixmap (32 bit pixels)
+#define SLIDE_PIXMAP_SIZE	(DOCK_SIZE * DOCK_SIZE * 4)
+
+#define SLIDE_FADE_FRAME	40	///< ms between fade frames (25 fps)
+#define SLIDE_FADE_BUDGET	4	///< ms CPU of one frame of all shows
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Prefetched slide.
+///
+typedef struct _slide_
+{
+    xcb_pixmap_t Pixmap;		///< ready dock pixmap, 0 if cached
+    char *Path;				///< file name of the image
+} Slide;
+
+///
+///	Slideshow of one dock.
+///
+///	Playlist and ring are shared with the worker and protected by
+///	#SlideMutex.
+///
+struct _slideshow_
+{
+    Dock *Dock;				///< dock showing the slides
+    const char *Source;			///< directory or list file
+    const char *Viewer;			///< viewer command for click
+    int Delay;				///< delay between slides in ms
+    char Random;			///< show slides in random order
+
+    char Scanned;			///< playlist is built
+    char Busy;				///< worker uses the show
+    volatile char Stop;			///< show is closed
+    char Changed;			///< playlist changed since last pass
+    char Waiting;			///< nothing decodable, wait for changes
+    int Failed;				///< images failed to decode in row
+
+    char **Playlist;			///< all images of the slideshow
+    char *Names;			///< storage of indexed image paths
+    char *NamesEnd;			///< end of indexed image paths
+    int Count;				///< number of images in playlist
+    int Alloc;				///< allocated playlist entries
+    int Index;				///< next playlist entry to decode
+
+    Slide Ring[SLIDE_PREFETCH];		///< ring of prefetched slides
+    int Read;				///< ring read index (main thread)
+    int Write;				///< ring write index (worker)
+    int Filled;				///< number of ready slides in ring
+
+    int Inotify;			///< inotify of slideshow directories
+    char **Watches;			///< directory of each watch descriptor
+    int WatchAlloc;			///< allocated watch entries
+    char WatchFull;			///< inotify watch limit reached
+    char *Events;			///< inotify events read while scanning
+    size_t EventsLen;			///< length of queued inotify events
+    char **Trees;			///< new directories to index
+    int TreeCount;			///< number of directories to index
+    int TreeAlloc;			///< allocated directory entries
+    char Indexing;			///< worker indexes a new directory
+
+    char *History[SLIDE_HISTORY];	///< shown slides, oldest first
+    int HistoryCount;			///< number of slides in history
+    int HistoryPos;			///< history index of shown slide
+
+    char Armed;				///< timer of the show is armed
+    uint32_t Tick;			///< tick of the next slide
+
+    int Fade;				///< crossfade time in ms, 0 disabled
+    char Fading;			///< crossfade running
+    uint32_t FadeStart;			///< tick the crossfade started
+    xcb_render_picture_t Shown;		///< picture of the shown slide
+    xcb_render_picture_t FadeFrom;	///< picture of the previous slide
+    xcb_pixmap_t FadePixmap;		///< background while crossfading
+    xcb_render_picture_t FadePicture;	///< picture of FadePixmap
+};
+
+///
+///	Shown slide kept as server pixmap.
+///
+typedef struct _slide_pixmap_
+{
+    xcb_pixmap_t Pixmap;		///< dock pixmap
+    char *Path;				///< file name of the image
+    uint32_t Used;			///< LRU clock of last use
+} SlidePixmap;
+
+///
+///	Reload or decode job of the worker, done before any prefetch.
+///
+typedef struct _slide_job_
+{
+    struct _slide_job_ *Next;		///< next job of the list
+    Slideshow *Show;			///< show of the slide, NULL if closed
+    char *Path;				///< file name of the image
+    xcb_pixmap_t Pixmap;		///< loaded dock pixmap, 0 on error
+
+    uint32_t *Dia;			///< decode: dia pixels, NULL reload
+    int Stride;				///< decode: pixels per dia line
+    int Ok;				///< decode: image could be loaded
+    void (*Done) (void *, int);		///< decode: called when done
+    void *Opaque;			///< decode: argument of Done
+} SlideJob;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+unsigned SlidePixmapBudget = 1024 * 1024;	///< server memory for pixmaps
+
+static Slideshow **SlideShows;		///< all running slideshows
+static int SlideShowCount;		///< number of running slideshows
+static int SlideNextShow;		///< round robin index of worker
+
+static pthread_t SlideThread;		///< decode worker thread
+static char SlideThreadRunning;		///< worker was started
+static pthread_mutex_t SlideMutex = PTHREAD_MUTEX_INITIALIZER;
+    /// shows need the worker / worker finished a show / stop
+static pthread_cond_t SlideCond = PTHREAD_COND_INITIALIZER;
+static volatile char SlideQuit;		///< flag stop worker
+
+static SlideJob *SlideJobs;		///< queued jobs, oldest first
+static SlideJob *SlideRunning;		///< job loaded by the worker
+static SlideJob *SlideDone;		///< finished jobs, oldest first
+static int SlideDoneFd = -1;		///< eventfd of finished jobs
+
+    /// show scanned by the worker, for #SlideWatchDir
+static Slideshow *SlideScanning;
+
+static SlidePixmap *SlidePixmaps;	///< LRU cache of shown slides
+static int SlidePixmapCount;		///< number of cached pixmaps
+static int SlidePixmapMax;		///< cached pixmaps in budget
+static uint32_t SlidePixmapClock;	///< LRU clock
+
+    /// root visual format, 0 without render (no crossfade)
+static xcb_render_pictformat_t SlideFormat;
+    /// render version requested by SlideInit, collected at first fade
+static xcb_render_query_version_cookie_t SlideVersionCookie;
+    /// pict formats requested by SlideInit, collected at first fade
+static xcb_render_query_pict_formats_cookie_t SlideFormatCookie;
+static char SlideFormatPending;		///< pict formats request sent
+static char SlideFadeArmed;		///< fade frame timer is armed
+static uint32_t SlideFadeTick;		///< tick of the next fade frame
+static int SlideFadeNext;		///< first show of next fade frame
+
+static void SlideTimer(void);		///< forward define for SlideArm
+static void SlideFadeTimer(void);	///< forward define for SlideFade
+
+//----------------------------------------------------------------------------
+//	Playlist
+//----------------------------------------------------------------------------
+
+/**
+**	Insert image into playlist.
+**
+**	@param show	slideshow
+**	@param pos	playlist index
+**	@param path	file name of image
+*/
+static void SlideInsert(Slideshow * show, int pos, const char *path)
+{
+    if (show->Count == show->Alloc) {
+	show->Alloc = show->Alloc ? show->Alloc * 2 : 256;
+	show->Playlist =
+	    realloc(show->Playlist, show->Alloc * sizeof(char *));
+	if (!show->Playlist) {
+	    fprintf(stderr, "slide: out of memory\n");
+	    abort();
+	}
+    }
+    memmove(show->Playlist + pos + 1, show->Playlist + pos,
+	(show->Count - pos) * sizeof(char *));
+    show->Playlist[pos] = strdup(path);
+    show->Count++;
+}
+
+/**
+**	Add image to playlist.
+**
+**	@param show	slideshow
+**	@param path	file name of image
+*/
+static void SlideAdd(Slideshow * show, const char *path)
+{
+    SlideInsert(show, show->Count, path);
+}
+
+/**
+**	Free playlist entry.
+**
+**	Indexed paths are part of Slideshow::Names, added paths are
+**	allocated.
+**
+**	@param show	slideshow
+**	@param path	file name of image
+*/
+static void SlideFree(const Slideshow * show, char *path)
+{
+    if (path < show->Names || path >= show->NamesEnd) {
+	free(path);
+    }
+}
+
+/**
+**	Read playlist from list file, one file name per line.
+**
+**	@param show	slideshow
+**	@param file	list file name
+*/
+static void SlideReadList(Slideshow * show, const char *file)
+{
+    FILE *f;
+    char *line;
+    size_t size;
+    ssize_t n;
+
+    if (!(f = fopen(file, "r"))) {
+	fprintf(stderr, "slide: can't open '%s'\n", file);
+	return;
+    }
+    line = NULL;
+    size = 0;
+    while ((n = getline(&line, &size, f)) > 0) {
+	if (line[n - 1] == '\n') {
+	    line[--n] = '\0';
+	}
+	if (n) {
+	    SlideAdd(show, line);
+	}
+    }
+    free(line);
+    fclose(f);
+}
+
+/**
+**	Shuffle the playlist.
+**
+**	@param show	slideshow
+*/
+static void SlideShuffle(Slideshow * show)
+{
+    int i;
+    int j;
+    char *s;
+
+    for (i = show->Count - 1; i > 0; --i) {
+	j = random() % (i + 1);
+	s = show->Playlist[i];
+	show->Playlist[i] = show->Playlist[j];
+	show->Playlist[j] = s;
+    }
+}
+
+/**
+**	Watch directory for added and removed images.
+**
+**	Must be called with #SlideMutex held.
+**
+**	@param show	slideshow
+**	@param dir	directory name
+*/
+static void SlideWatchAdd(Slideshow * show, const char *dir)
+{
+    char **watches;
+    int wd;
+    int n;
+
+    if (show->WatchFull) {
+	return;
+    }
+    wd = inotify_add_watch(show->Inotify, dir,
+	IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+	IN_ONLYDIR);
+    if (wd < 0) {
+	if (errno == ENOSPC) {		// only once
+	    fprintf(stderr, "slide: too many directories to watch, "
+		"raise fs.inotify.max_user_watches\n");
+	    show->WatchFull = 1;
+	}
+	return;
+    }
+
+    if (wd >= show->WatchAlloc) {
+	n = wd < 64 ? 128 : wd * 2;
+	if (!(watches = realloc(show->Watches, n * sizeof(*watches)))) {
+	    fprintf(stderr, "slide: out of memory, directory not watched\n");
+	    inotify_rm_watch(show->Inotify, wd);
+	    return;
+	}
+	show->Watches = watches;
+	memset(show->Watches + show->WatchAlloc, 0,
+	    (n - show->WatchAlloc) * sizeof(*show->Watches));
+	show->WatchAlloc = n;
+    }
+    // same directory again (moved) gets the same descriptor
+    free(show->Watches[wd]);
+    show->Watches[wd] = strdup(dir);
+}
+
+/**
+**	Watch directory of the tree.
+**
+**	Called from the worker with all directories of the tree of
+**	#SlideScanning.
+**
+**	@param dir	directory name
+*/
+static void SlideWatchDir(const char *dir)
+{
+    pthread_mutex_lock(&SlideMutex);
+    SlideWatchAdd(SlideScanning, dir);
+    pthread_mutex_unlock(&SlideMutex);
+}
+
+/**
+**	Build the playlist from slideshow source.
+**
+**	Called from the worker.
+**
+**	@param show	slideshow
+*/
+static void SlideScan(Slideshow * show)
+{
+    struct stat st;
+
+    if (stat(show->Source, &st)) {
+	fprintf(stderr, "slide: can't stat '%s'\n", show->Source);
+	return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+	SlideScanning = show;
+	show->Playlist = IndexScan(show->Source, &show->Count, &show->Names,
+	    &show->Stop, show->Inotify >= 0 ? SlideWatchDir : NULL, 1);
+	show->Alloc = show->Count;
+	if (show->Count) {		// last path ends the storage
+	    show->NamesEnd = show->Playlist[show->Count - 1]
+		+ strlen(show->Playlist[show->Count - 1]) + 1;
+	}
+    } else {
+	SlideReadList(show, show->Source);
+    }
+    if (show->Random) {
+	SlideShuffle(show);
+    }
+}
+
+//----------------------------------------------------------------------------
+//	Watch
+//----------------------------------------------------------------------------
+
+/**
+**	Find image in playlist.
+**
+**	@param show	slideshow
+**	@param path	file name of image
+**
+**	@returns playlist index, -1 if not found.
+*/
+static int SlideFind(const Slideshow * show, const char *path)
+{
+    int i;
+
+    for (i = 0; i < show->Count; ++i) {
+	if (!strcmp(show->Playlist[i], path)) {
+	    return i;
+	}
+    }
+    return -1;
+}
+
+/**
+**	Remove playlist entry.
+**
+**	@param show	slideshow
+**	@param i	playlist index
+*/
+static void SlideRemove(Slideshow * show, int i)
+{
+    SlideFree(show, show->Playlist[i]);
+    memmove(show->Playlist + i, show->Playlist + i + 1,
+	(show->Count - i - 1) * sizeof(char *));
+    show->Count--;
+    if (i < show->Index) {
+	show->Index--;
+    }
+}
+
+/**
+**	Remove all images and watches below a directory.
+**
+**	@param show	slideshow
+**	@param dir	directory name
+*/
+static void SlideRemoveTree(Slideshow * show, const char *dir)
+{
+    size_t len;
+    int i;
+
+    len = strlen(dir);
+    for (i = show->Count - 1; i >= 0; --i) {
+	if (!strncmp(show->Playlist[i], dir, len)
+	    && show->Playlist[i][len] == '/') {
+	    SlideRemove(show, i);
+	}
+    }
+    for (i = 0; i < show->WatchAlloc; ++i) {
+	if (show->Watches[i] && !strncmp(show->Watches[i], dir, len)
+	    && (!show->Watches[i][len] || show->Watches[i][len] == '/')) {
+	    inotify_rm_watch(show->Inotify, i);
+	    free(show->Watches[i]);
+	    show->Watches[i] = NULL;
+	}
+    }
+}
+
+/**
+**	Queue new directory tree to index.
+**
+**	Called for directories created or moved into the slideshow, the
+**	watch is added first, so no image added meanwhile is missed.  The
+**	tree is indexed by the worker.  Must be called with #SlideMutex held.
+**
+**	@param show	slideshow
+**	@param dir	directory name
+*/
+static void SlideTreeQueue(Slideshow * show, const char *dir)
+{
+    char **trees;
+    char *path;
+    int n;
+
+    SlideWatchAdd(show, dir);
+    if (show->TreeCount == show->TreeAlloc) {
+	n = show->TreeAlloc ? show->TreeAlloc * 2 : 8;
+	if (!(trees = realloc(show->Trees, n * sizeof(*trees)))) {
+	    fprintf(stderr, "slide: out of memory, changes lost\n");
+	    return;
+	}
+	show->Trees = trees;
+	show->TreeAlloc = n;
+    }
+    if (!(path = strdup(dir))) {
+	fprintf(stderr, "slide: out of memory, changes lost\n");
+	return;
+    }
+    show->Trees[show->TreeCount++] = path;
+}
+
+/**
+**	Apply inotify event to playlist.
+**
+**	New images are inserted as next slide to decode.
+**
+**	@param show	slideshow
+**	@param event	inotify event
+*/
+static void SlideApply(Slideshow * show, const struct inotify_event *event)
+{
+    char *path;
+    const char *dir;
+    int i;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+	fprintf(stderr, "slide: inotify queue overflow, changes lost\n");
+	return;
+    }
+    if (event->wd < 0 || event->wd >= show->WatchAlloc
+	|| !(dir = show->Watches[event->wd])) {
+	return;
+    }
+    if (event->mask & IN_IGNORED) {	// directory removed
+	free(show->Watches[event->wd]);
+	show->Watches[event->wd] = NULL;
+	return;
+    }
+    if (!event->len) {
+	return;
+    }
+    if (event->name[0] == '.') {	// hidden
+	return;
+    }
+
+    path = alloca(strlen(dir) + strlen(event->name) + 2);
+    sprintf(path, "%s/%s", dir, event->name);
+
+    if (event->mask & IN_ISDIR) {
+	if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+	    SlideRemoveTree(show, path);
+	} else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+	    SlideTreeQueue(show, path);
+	}
+	return;
+    }
+    if (!IndexIsImage(event->name)) {
+	return;
+    }
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+	if ((i = SlideFind(show, path)) >= 0) {
+	    SlideRemove(show, i);
+	}
+	// IN_CREATE is too early, the image is still written
+    } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+	if (SlideFind(show, path) < 0) {
+	    SlideInsert(show, show->Index, path);
+	}
+    }
+}
+
+/**
+**	Queue inotify events read while the playlist is indexed.
+**
+**	The index may have read a directory before the change, the events
+**	are applied after the scan.  Must be called with #SlideMutex held.
+**
+**	@param show	slideshow
+**	@param buf	inotify events
+**	@param n	length of events
+*/
+static void SlideEventsQueue(Slideshow * show, const void *buf, size_t n)
+{
+    char *events;
+
+    if (!(events = realloc(show->Events, show->EventsLen + n))) {
+	fprintf(stderr, "slide: out of memory, changes lost\n");
+	return;
+    }
+    memcpy(events + show->EventsLen, buf, n);
+    show->Events = events;
+    show->EventsLen += n;
+}
+
+/**
+**	Apply inotify events queued while the playlist was indexed.
+**
+**	Called from the worker after the scan, with #SlideMutex held.
+**	Images already found by the index aren't added twice.
+**
+**	@param show	slideshow
+*/
+static void SlideEventsApply(Slideshow * show)
+{
+    const struct inotify_event *event;
+    size_t i;
+
+    for (i = 0; i < show->EventsLen; i += sizeof(*event) + event->len) {
+	event = (const struct inotify_event *)(show->Events + i);
+	SlideApply(show, event);
+    }
+    free(show->Events);
+    show->Events = NULL;
+    show->EventsLen = 0;
+}
+
+/**
+**	Handle inotify events of the slideshow directories.
+**
+**	Shared handler of the inotify descriptors of all slideshows, all
+**	queued events are applied under one lock.  Events of a playlist
+**	or new directory still indexed are queued until the scan is finished.
+*/
+static void SlideWatchEvent(void)
+{
+    // aligned for struct inotify_event
+    uint64_t buf[4096 / sizeof(uint64_t)];
+    const struct inotify_event *event;
+    Slideshow *show;
+    ssize_t n;
+    ssize_t i;
+    int count;
+    int trees;
+    int j;
+
+    pthread_mutex_lock(&SlideMutex);
+    for (j = 0; j < SlideShowCount; ++j) {
+	show = SlideShows[j];
+	if (show->Inotify < 0) {
+	    continue;
+	}
+	count = show->Count;
+	trees = show->TreeCount;
+	while ((n = read(show->Inotify, buf, sizeof(buf))) > 0) {
+	    if (!show->Scanned || show->Indexing) {
+		SlideEventsQueue(show, buf, n);
+		continue;
+	    }
+	    for (i = 0; i < n; i += sizeof(*event) + event->len) {
+		event = (const struct inotify_event *)((char *)buf + i);
+		SlideApply(show, event);
+	    }
+	}
+	// wakeup waiting worker
+	if (show->Count != count || show->TreeCount != trees) {
+	    show->Changed = 1;
+	    show->Waiting = 0;
+	    pthread_cond_broadcast(&SlideCond);
+	}
+    }
+    pthread_mutex_unlock(&SlideMutex);
+}
+
+//----------------------------------------------------------------------------
+//	Pixmap cache
+//----------------------------------------------------------------------------
+
+/**
+**	Find cached pixmap of slide.
+**
+**	Must be called with #SlideMutex held.
+**
+**	@param path	file name of the image
+**
+**	@returns pixmap, 0 if not cached.
+*/
+static xcb_pixmap_t SlidePixmapFind(const char *path)
+{
+    int i;
+
+    for (i = 0; i < SlidePixmapCount; ++i) {
+	if (!strcmp(SlidePixmaps[i].Path, path)) {
+	    SlidePixmaps[i].Used = ++SlidePixmapClock;
+	    StatsAdd(StatsPixmapHits, 1);
+	    return SlidePixmaps[i].Pixmap;
+	}
+    }
+    StatsAdd(StatsPixmapMisses, 1);
+    return 0;
+}
+
+/**
+**	Keep pixmap of shown slide.
+**
+**	The least recently used pixmap is freed, if the budget is used up.
+**	Must be called with #SlideMutex held.
+**
+**	@param path	file name of the image
+**	@param pixmap	dock pixmap, owned by the cache afterwards
+*/
+static void SlidePixmapKeep(const char *path, xcb_pixmap_t pixmap)
+{
+    SlidePixmap *entry;
+    int i;
+
+    if (!SlidePixmapMax) {
+	// the server keeps the background, until it is replaced
+	xcb_free_pixmap(Connection, pixmap);
+	return;
+    }
+    if (SlidePixmapCount < SlidePixmapMax) {
+	entry = SlidePixmaps + SlidePixmapCount++;
+    } else {
+	entry = SlidePixmaps;
+	for (i = 1; i < SlidePixmapCount; ++i) {
+	    if (SlidePixmaps[i].Used < entry->Used) {
+		entry = SlidePixmaps + i;
+	    }
+	}
+	xcb_free_pixmap(Connection, entry->Pixmap);
+	free(entry->Path);
+    }
+    entry->Pixmap = pixmap;
+    entry->Path = strdup(path);
+    entry->Used = ++SlidePixmapClock;
+}
+
+//----------------------------------------------------------------------------
+//	Decode
+//----------------------------------------------------------------------------
+
+/**
+**	Load image into dock pixmap.
+**
+**	The image is scaled directly into the dia inside the dock frame,
+**	the remaining border is darkgray.  Already scaled dias are taken
+**	from the thumbnail cache.  Only called by the worker.
+**
+**	@param path	file name of image
+**
+**	@returns pixmap with the dia centered inside the dock, 0 on error.
+*/
+static xcb_pixmap_t SlideUpload(const char *path)
+{
+    uint32_t pixels[DOCK_SIZE * DOCK_SIZE];
+    xcb_pixmap_t pixmap;
+    struct stat st;
+    uint32_t border;
+    int i;
+
+    border = RgbPixel(0xA9, 0xA9, 0xA9);	// darkgray
+    for (i = 0; i < DOCK_SIZE; ++i) {
+	pixels[i] = border;
+	pixels[(DOCK_SIZE - 1) * DOCK_SIZE + i] = border;
+	pixels[i * DOCK_SIZE] = border;
+	pixels[i * DOCK_SIZE + DOCK_SIZE - 1] = border;
+    }
+    if (stat(path, &st)) {
+	return 0;
+    }
+    if (!CacheGet(path, &st, pixels + DOCK_SIZE + 1, DOCK_SIZE)) {
+	if (!ImageLoad(path, pixels + DOCK_SIZE + 1, DOCK_SIZE)) {
+	    return 0;
+	}
+	CachePut(path, &st, pixels + DOCK_SIZE + 1, DOCK_SIZE);
+    }
+
+    pixmap = xcb_generate_id(Connection);
+    xcb_create_pixmap(Connection, Screen->root_depth, pixmap, Screen->root,
+	DOCK_SIZE, DOCK_SIZE);
+    FramePut(pixmap, 0, 0, DOCK_SIZE, DOCK_SIZE, pixels, DOCK_SIZE);
+
+    return pixmap;
+}
+
+/**
+**	Add all images of a new directory tree.
+**
+**	Called from the worker with #SlideMutex held, returns with it held.
+**	The tree is indexed like the slideshow source: in parallel and
+**	without following symlinked directories.  Events of the tree read
+**	meanwhile are applied afterwards.
+**
+**	@param show	slideshow
+**	@param dir	directory name, freed
+*/
+static void SlideAddTree(Slideshow * show, char *dir)
+{
+    char **paths;
+    char *names;
+    int count;
+    int i;
+
+    show->Indexing = 1;
+    pthread_mutex_unlock(&SlideMutex);
+    SlideScanning = show;
+    paths = IndexScan(dir, &count, &names, &show->Stop,
+	show->Inotify >= 0 ? SlideWatchDir : NULL, 0);
+    pthread_mutex_lock(&SlideMutex);
+
+    for (i = 0; i < count; ++i) {
+	if (SlideFind(show, paths[i]) < 0) {
+	    SlideInsert(show, show->Index, paths[i]);
+	}
+    }
+    show->Indexing = 0;
+    SlideEventsApply(show);
+    if (count) {
+	show->Changed = 1;
+	show->Waiting = 0;
+    }
+    free(paths);
+    free(names);
+    free(dir);
+}
+
+/**
+**	Find the next slideshow which needs the worker.
+**
+**	The prefetch depth is divided between all shows, round robin keeps
+**	the shows fair.  Must be called with #SlideMutex held.
+**
+**	@returns slideshow to scan, to index or to decode, NULL if none.
+*/
+static Slideshow *SlideWork(void)
+{
+    Slideshow *show;
+    int prefetch;
+    int i;
+
+    prefetch = SLIDE_PREFETCH / (SlideShowCount ? SlideShowCount : 1);
+    if (prefetch < 1) {
+	prefetch = 1;
+    }
+    for (i = 0; i < SlideShowCount; ++i) {
+	show = SlideShows[(SlideNextShow + i) % SlideShowCount];
+	if (show->Stop) {
+	    continue;
+	}
+	if (!show->Scanned || show->TreeCount || (show->Count
+		&& !show->Waiting && show->Filled < prefetch)) {
+	    SlideNextShow = (SlideNextShow + i + 1) % SlideShowCount;
+	    return show;
+	}
+    }
+    return NULL;
+}
+
+/**
+**	Slideshow worker thread.
+**
+**	Builds the playlists and fills the rings with the next slides.
+**
+**	@param dummy	unused thread argument
+*/
+static void *SlideWorker( __attribute__ ((unused)) void *dummy)
+{
+    Slideshow *show;
+    SlideJob *job;
+    SlideJob **tail;
+    xcb_pixmap_t pixmap;
+    xcb_pixmap_t cached;
+    uint64_t trace;
+    char *path;
+    uint64_t one;
+    ssize_t n;
+
+    TraceThread("slide worker");
+    for (;;) {
+	pthread_mutex_lock(&SlideMutex);
+	show = NULL;
+	while (!SlideJobs && !(show = SlideWork()) && !SlideQuit) {
+	    pthread_cond_wait(&SlideCond, &SlideMutex);
+	}
+	if (SlideQuit) {
+	    pthread_mutex_unlock(&SlideMutex);
+	    break;
+	}
+
+	if ((job = SlideJobs)) {	// the user waits for it
+	    SlideJobs = job->Next;
+	    SlideRunning = job;
+	    pthread_mutex_unlock(&SlideMutex);
+
+	    if (job->Dia) {
+		job->Ok = ImageLoad(job->Path, job->Dia, job->Stride);
+	    } else {
+		job->Pixmap = SlideUpload(job->Path);
+		trace = TraceBegin();
+		xcb_flush(Connection);
+		TraceEnd("flush", trace, 0);
+	    }
+
+	    pthread_mutex_lock(&SlideMutex);
+	    SlideRunning = NULL;
+	    job->Next = NULL;
+	    for (tail = &SlideDone; *tail; tail = &(*tail)->Next) {
+	    }
+	    *tail = job;
+	    pthread_mutex_unlock(&SlideMutex);
+	    // eventfd counter can't overflow, the main thread reads it
+	    one = 1;
+	    n = write(SlideDoneFd, &one, sizeof(one));
+	    (void)n;
+	    continue;
+	}
+	show->Busy = 1;
+
+	if (!show->Scanned) {
+	    pthread_mutex_unlock(&SlideMutex);
+	    SlideScan(show);
+	    pthread_mutex_lock(&SlideMutex);
+	    SlideEventsApply(show);
+	    if (!show->Count) {
+		fprintf(stderr, "slide: no images found in '%s'\n",
+		    show->Source);
+	    }
+	    show->Scanned = 1;
+	    show->Busy = 0;
+	    pthread_cond_broadcast(&SlideCond);
+	    pthread_mutex_unlock(&SlideMutex);
+	    continue;
+	}
+	if (show->TreeCount) {		// new directory
+	    SlideAddTree(show, show->Trees[--show->TreeCount]);
+	    show->Busy = 0;
+	    pthread_cond_broadcast(&SlideCond);
+	    pthread_mutex_unlock(&SlideMutex);
+	    continue;
+	}
+
+	if (show->Index >= show->Count) {	// next pass
+	    show->Index = 0;
+	    if (show->Random) {
+		SlideShuffle(show);
+	    }
+	}
+	// the entry can be removed by inotify, while we decode
+	path = strdup(show->Playlist[show->Index++]);
+	cached = SlidePixmapFind(path);
+	pthread_mutex_unlock(&SlideMutex);
+
+	// cached pixmaps are looked up again, when the slide is shown
+	pixmap = 0;
+	if (!cached && !(pixmap = SlideUpload(path))) {
+	    free(path);
+	    pthread_mutex_lock(&SlideMutex);
+	    if (++show->Failed >= show->Count) {
+		fprintf(stderr, "slide: no image could be decoded\n");
+		// wait for new images
+		show->Changed = 0;
+		show->Waiting = 1;
+		show->Failed = 0;
+	    }
+	    show->Busy = 0;
+	    pthread_cond_broadcast(&SlideCond);
+	    pthread_mutex_unlock(&SlideMutex);
+	    continue;
+	}
+	trace = TraceBegin();
+	xcb_flush(Connection);
+	TraceEnd("flush", trace, 0);
+
+	pthread_mutex_lock(&SlideMutex);
+	show->Failed = 0;
+	show->Busy = 0;
+	if (show->Stop) {		// closed meanwhile
+	    if (pixmap) {
+		xcb_free_pixmap(Connection, pixmap);
+	    }
+	    free(path);
+	} else {
+	    show->Ring[show->Write].Pixmap = pixmap;
+	    show->Ring[show->Write].Path = path;
+	    show->Write = (show->Write + 1) % SLIDE_PREFETCH;
+	    show->Filled++;
+	}
+	pthread_cond_broadcast(&SlideCond);
+	pthread_mutex_unlock(&SlideMutex);
+    }
+
+    return NULL;
+}
+
+//----------------------------------------------------------------------------
+//	Show
+//----------------------------------------------------------------------------
+
+/**
+**	Collect the render format of the root visual.
+**
+**	The request was sent by SlideInit, the reply is taken when the
+**	first slide is shown.
+*/
+static void SlideFormatReply(void)
+{
+    xcb_render_query_version_reply_t *version;
+    xcb_render_query_pict_formats_reply_t *reply;
+    xcb_render_pictscreen_iterator_t screens;
+    xcb_render_pictdepth_iterator_t depths;
+    const xcb_render_pictvisual_t *visuals;
+    int n;
+    int i;
+
+    SlideFormatPending = 0;
+    version = xcb_render_query_version_reply(Connection, SlideVersionCookie,
+	NULL);
+    reply = xcb_render_query_pict_formats_reply(Connection,
+	SlideFormatCookie, NULL);
+    if (!version || !reply
+	|| (!version->major_version && version->minor_version < 10)) {
+	fprintf(stderr, "slide: render extension 0.10 missing, no fade\n");
+	free(version);
+	free(reply);
+	return;
+    }
+    free(version);
+    for (screens = xcb_render_query_pict_formats_screens_iterator(reply);
+	screens.rem; xcb_render_pictscreen_next(&screens)) {
+	for (depths = xcb_render_pictscreen_depths_iterator(screens.data);
+	    depths.rem; xcb_render_pictdepth_next(&depths)) {
+	    visuals = xcb_render_pictdepth_visuals(depths.data);
+	    n = xcb_render_pictdepth_visuals_length(depths.data);
+	    for (i = 0; i < n; ++i) {
+		if (visuals[i].visual == Screen->root_visual) {
+		    SlideFormat = visuals[i].format;
+		}
+	    }
+	}
+    }
+    free(reply);
+}
+
+/**
+**	Draw one crossfade frame.
+**
+**	Previous slide as source, new slide over it through a solid alpha
+**	mask.  All blending is done by the server.
+**
+**	@param show	crossfading slideshow
+**	@param now	tick of the frame, the alpha follows the time
+*/
+static void SlideFadeFrame(Slideshow * show, uint32_t now)
+{
+    xcb_render_color_t color;
+    xcb_render_picture_t mask;
+    uint32_t t;
+
+    t = now - show->FadeStart;
+    if (t >= (uint32_t) show->Fade) {	// last frame is the new slide
+	xcb_render_composite(Connection, XCB_RENDER_PICT_OP_SRC, show->Shown,
+	    0, show->FadePicture, 0, 0, 0, 0, 0, 0, DOCK_SIZE, DOCK_SIZE);
+	xcb_render_free_picture(Connection, show->FadeFrom);
+	show->FadeFrom = 0;
+	show->Fading = 0;
+    } else {
+	xcb_render_composite(Connection, XCB_RENDER_PICT_OP_SRC,
+	    show->FadeFrom, 0, show->FadePicture, 0, 0, 0, 0, 0, 0, DOCK_SIZE,
+	    DOCK_SIZE);
+	color.red = 0;
+	color.green = 0;
+	color.blue = 0;
+	color.alpha = t * 0xFFFFU / show->Fade;
+	mask = xcb_generate_id(Connection);
+	xcb_render_create_solid_fill(Connection, mask, color);
+	xcb_render_composite(Connection, XCB_RENDER_PICT_OP_OVER, show->Shown,
+	    mask, show->FadePicture, 0, 0, 0, 0, 0, 0, DOCK_SIZE, DOCK_SIZE);
+	xcb_render_free_picture(Connection, mask);
+    }
+    xcb_clear_area(Connection, 0, show->Dock->Window, 0, 0, DOCK_SIZE,
+	DOCK_SIZE);
+}
+
+/**
+**	Crossfade frame timer of all shows.
+**
+**	Frames are on a fixed grid.  When the loop falls behind, the missed
+**	frames are skipped.  If the CPU budget of a frame is used up, the
+**	remaining shows are served first in the next frame.
+*/
+static void SlideFadeTimer(void)
+{
+    Slideshow *show;
+    uint64_t trace;
+    uint32_t start;
+    uint32_t now;
+    int fading;
+    int n;
+    int i;
+
+    trace = TraceBegin();
+    start = GetMsTicks();
+    now = start;
+    fading = 0;
+    for (n = 0; n < SlideShowCount; ++n) {
+	i = (SlideFadeNext + n) % SlideShowCount;
+	show = SlideShows[i];
+	if (!show->Fading) {
+	    continue;
+	}
+	if (now - start >= SLIDE_FADE_BUDGET) {
+	    SlideFadeNext = i;		// over budget, continue next frame
+	    fading = 1;
+	    break;
+	}
+	SlideFadeFrame(show, now);
+	fading |= show->Fading;
+	now = GetMsTicks();
+    }
+    xcb_flush(Connection);
+    TraceEnd("fade", trace, n);
+
+    if (!fading) {
+	SlideFadeArmed = 0;
+	SlideFadeNext = 0;
+	return;
+    }
+    SlideFadeTick += SLIDE_FADE_FRAME;
+    if ((int32_t) (SlideFadeTick - now) <= 0) {	// behind, skip frames
+	SlideFadeTick = now + SLIDE_FADE_FRAME - (now - SlideFadeTick)
+	    % SLIDE_FADE_FRAME;
+    }
+    LoopSetTimer(SlideFadeTimer, SlideFadeTick);
+}
+
+/**
+**	Crossfade to the slide.
+**
+**	A running crossfade ends at once, the new one starts from its
+**	target.
+**
+**	@param show	slideshow
+**	@param pixmap	dock pixmap of the new slide
+**
+**	@returns true if the crossfade draws the window background.
+*/
+static int SlideFade(Slideshow * show, xcb_pixmap_t pixmap)
+{
+    xcb_render_picture_t picture;
+
+    if (SlideFormatPending) {
+	SlideFormatReply();
+    }
+    if (!show->Fade || !SlideFormat) {
+	return 0;
+    }
+    // picture holds the pixmap, even if the cache frees it
+    picture = xcb_generate_id(Connection);
+    xcb_render_create_picture(Connection, picture, pixmap, SlideFormat, 0,
+	NULL);
+    if (!show->Shown) {			// first slide, nothing to fade from
+	show->Shown = picture;
+	return 0;
+    }
+
+    if (show->FadeFrom) {
+	xcb_render_free_picture(Connection, show->FadeFrom);
+    }
+    show->FadeFrom = show->Shown;
+    show->Shown = picture;
+    if (!show->FadePixmap) {
+	show->FadePixmap = xcb_generate_id(Connection);
+	xcb_create_pixmap(Connection, Screen->root_depth, show->FadePixmap,
+	    Screen->root, DOCK_SIZE, DOCK_SIZE);
+	show->FadePicture = xcb_generate_id(Connection);
+	xcb_render_create_picture(Connection, show->FadePicture,
+	    show->FadePixmap, SlideFormat, 0, NULL);
+    }
+    xcb_change_window_attributes(Connection, show->Dock->Window,
+	XCB_CW_BACK_PIXMAP, &show->FadePixmap);
+
+    show->Fading = 1;
+    show->FadeStart = GetMsTicks();
+    SlideFadeFrame(show, show->FadeStart);
+    if (!SlideFadeArmed) {
+	SlideFadeArmed = 1;
+	SlideFadeTick = show->FadeStart + SLIDE_FADE_FRAME;
+	LoopSetTimer(SlideFadeTimer, SlideFadeTick);
+    }
+    return 1;
+}
+
+/**
+**	Queue job for the worker.
+**
+**	@param job	reload or decode job, owned by the queue
+*/
+static void SlideQueue(SlideJob * job)
+{
+    SlideJob **tail;
+
+    pthread_mutex_lock(&SlideMutex);
+    for (tail = &SlideJobs; *tail; tail = &(*tail)->Next) {
+    }
+    *tail = job;
+    pthread_cond_broadcast(&SlideCond);
+    pthread_mutex_unlock(&SlideMutex);
+}
+
+/**
+**	Queue reload of an evicted slide.
+**
+**	The worker loads the slide before any prefetch, SlideJobEvent shows
+**	it.
+**
+**	@param show	slideshow
+**	@param path	file name of the image
+*/
+static void SlideReload(Slideshow * show, const char *path)
+{
+    SlideJob *job;
+
+    if (!(job = calloc(1, sizeof(*job))) || !(job->Path = strdup(path))) {
+	free(job);
+	return;
+    }
+    job->Show = show;
+    SlideQueue(job);
+}
+
+/**
+**	Show slide.
+**
+**	Swaps or crossfades the window background and updates the TOOLTIP
+**	and COMMAND properties.  The slide is kept in the pixmap cache and not decoded
+**	again, when it is shown next time.
+**
+**	@param show	slideshow
+**	@param path	file name of the image
+**	@param pixmap	dock pixmap of the slide, 0 to lookup the cache
+**
+**	@returns -1 if the slide is reloaded by the worker, 0 otherwise.
+*/
+static int SlideDisplay(Slideshow * show, const char *path,
+    xcb_pixmap_t pixmap)
+{
+    xcb_window_t window;
+    xcb_pixmap_t cached;
+    char *cmd;
+    const char *s;
+    char *d;
+
+    if (!(cached = pixmap)) {
+	pthread_mutex_lock(&SlideMutex);
+	cached = SlidePixmapFind(path);
+	pthread_mutex_unlock(&SlideMutex);
+	// evicted since prefetch or history, shown when reloaded
+	if (!cached) {
+	    SlideReload(show, path);
+	    return -1;
+	}
+    }
+    window = show->Dock->Window;
+    show->Dock->FrameBackground = 0;	// next frame is shown complete
+    if (!SlideFade(show, cached)) {
+	xcb_change_window_attributes(Connection, window, XCB_CW_BACK_PIXMAP,
+	    &cached);
+	xcb_clear_area(Connection, 0, window, 0, 0, DOCK_SIZE, DOCK_SIZE);
+    }
+    if (pixmap) {
+	pthread_mutex_lock(&SlideMutex);
+	SlidePixmapKeep(path, pixmap);
+	pthread_mutex_unlock(&SlideMutex);
+    }
+
+    //
+    //	viewer 'path', ' in path quoted as '\''
+    //
+    cmd = alloca(strlen(show->Viewer) + strlen(path) * 4 + 4);
+    d = stpcpy(cmd, show->Viewer);
+    *d++ = ' ';
+    *d++ = '\'';
+    for (s = path; *s; ++s) {
+	if (*s == '\'') {
+	    d = stpcpy(d, "'\\''");
+	} else {
+	    *d++ = *s;
+	}
+    }
+    *d++ = '\'';
+    *d = '\0';
+
+    xcb_change_property(Connection, XCB_PROP_MODE_REPLACE, window, TooltipAtom,
+	XCB_ATOM_STRING, 8, strlen(path), path);
+    xcb_change_property(Connection, XCB_PROP_MODE_REPLACE, window, CommandAtom,
+	XCB_ATOM_STRING, 8, strlen(cmd), cmd);
+
+    return 0;
+}
+
+/**
+**	Show next slide.
+**
+**	After going back, the next slide is taken from the history,
+**	otherwise from the prefetch ring.
+**
+**	@param show	slideshow
+**
+**	@returns -1 if no slide is ready, 0 otherwise.
+*/
+static int SlideNext(Slideshow * show)
+{
+    Slide slide;
+
+    if (show->HistoryPos + 1 < show->HistoryCount) {
+	++show->HistoryPos;
+	SlideDisplay(show, show->History[show->HistoryPos], 0);
+	return 0;
+    }
+
+    pthread_mutex_lock(&SlideMutex);
+    if (!show->Filled) {
+	pthread_mutex_unlock(&SlideMutex);
+	return -1;
+    }
+    slide = show->Ring[show->Read];
+    show->Read = (show->Read + 1) % SLIDE_PREFETCH;
+    show->Filled--;
+    pthread_cond_signal(&SlideCond);
+    pthread_mutex_unlock(&SlideMutex);
+
+    if (show->HistoryCount == SLIDE_HISTORY) {	// forget oldest
+	free(show->History[0]);
+	memmove(show->History, show->History + 1,
+	    (SLIDE_HISTORY - 1) * sizeof(*show->History));
+	show->HistoryCount--;
+    }
+    show->History[show->HistoryCount] = slide.Path;
+    show->HistoryPos = show->HistoryCount++;
+
+    SlideDisplay(show, slide.Path, slide.Pixmap);
+
+    return 0;
+}
+
+/**
+**	Show previous slide of the history.
+**
+**	@param show	slideshow
+**
+**	@returns -1 if there is no previous slide, 0 otherwise.
+*/
+static int SlidePrev(Slideshow * show)
+{
+    if (show->HistoryPos <= 0) {
+	return -1;
+    }
+    --show->HistoryPos;
+    SlideDisplay(show, show->History[show->HistoryPos], 0);
+
+    return 0;
+}
+
+/**
+**	Show reloaded slides and finish decode jobs.
+**
+**	Called from the event loop, when the worker has finished jobs.  A
+**	slide is only shown, if it is still the slide of its history
+**	position, otherwise it is only kept in the pixmap cache.
+*/
+static void SlideJobEvent(void)
+{
+    SlideJob *job;
+    SlideJob *next;
+    Slideshow *show;
+    uint64_t count;
+    ssize_t n;
+
+    // the list is taken below, a spurious wakeup finds it empty
+    n = read(SlideDoneFd, &count, sizeof(count));
+    (void)n;
+    pthread_mutex_lock(&SlideMutex);
+    job = SlideDone;
+    SlideDone = NULL;
+    pthread_mutex_unlock(&SlideMutex);
+
+    for (; job; job = next) {
+	next = job->Next;
+	show = job->Show;
+	if (job->Done) {
+	    job->Done(job->Opaque, job->Ok);
+	} else if (job->Pixmap) {
+	    if (show && show->HistoryPos >= 0
+		&& show->HistoryPos < show->HistoryCount
+		&& !strcmp(show->History[show->HistoryPos], job->Path)) {
+		SlideDisplay(show, job->Path, job->Pixmap);
+	    } else {
+		pthread_mutex_lock(&SlideMutex);
+		SlidePixmapKeep(job->Path, job->Pixmap);
+		pthread_mutex_unlock(&SlideMutex);
+	    }
+	}
+	free(job->Path);
+	free(job);
+    }
+    xcb_flush(Connection);
+}
+
+/**
+**	Free jobs of a list.
+**
+**	@param job	first job of the list
+*/
+static void SlideJobFree(SlideJob * job)
+{
+    SlideJob *next;
+
+    for (; job; job = next) {
+	next = job->Next;
+	if (job->Pixmap) {
+	    xcb_free_pixmap(Connection, job->Pixmap);
+	}
+	free(job->Path);
+	free(job);
+    }
+}
+
+/**
+**	Arm the loop timer for the earliest slide of all shows.
+*/
+static void SlideArm(void)
+{
+    uint32_t tick;
+    int armed;
+    int i;
+
+    armed = 0;
+    tick = 0;
+    for (i = 0; i < SlideShowCount; ++i) {
+	if (SlideShows[i]->Armed && (!armed
+		|| (int32_t) (SlideShows[i]->Tick - tick) < 0)) {
+	    tick = SlideShows[i]->Tick;
+	    armed = 1;
+	}
+    }
+    if (armed) {
+	LoopSetTimer(SlideTimer, tick);
+    } else {
+	LoopDelTimer(SlideTimer);
+    }
+}
+
+/**
+**	Schedule the next slide of a show.
+**
+**	@param show	slideshow
+**	@param tick	tick of the next slide, see GetMsTicks
+*/
+static void SlideSchedule(Slideshow * show, uint32_t tick)
+{
+    show->Armed = 1;
+    show->Tick = tick;
+    SlideArm();
+}
+
+/**
+**	Slideshow timer.
+**
+**	Show the next dia of all due shows, retry soon if the worker isn't
+**	ready.
+*/
+static void SlideTimer(void)
+{
+    Slideshow *show;
+    uint32_t now;
+    int i;
+
+    now = GetMsTicks();
+    for (i = 0; i < SlideShowCount; ++i) {
+	show = SlideShows[i];
+	if (show->Armed && (int32_t) (show->Tick - now) <= 0) {
+	    show->Tick = now + (SlideNext(show) ? 250 : show->Delay);
+	}
+    }
+    xcb_flush(Connection);
+    SlideArm();
+}
+
+/**
+**	Step through the slides (mouse wheel).
+**
+**	The slide is shown for the full delay.  The caller flushes the
+**	requests.
+**
+**	@param dock		dock of the slideshow
+**	@param direction	< 0 previous slide, > 0 next slide
+*/
+void SlideStep(Dock * dock, int direction)
+{
+    Slideshow *show;
+
+    if (!(show = dock->Slideshow)) {
+	return;
+    }
+    if (!(direction < 0 ? SlidePrev(show) : SlideNext(show))) {
+	SlideSchedule(show, GetMsTicks() + show->Delay);
+    }
+}
+
+/**
+**	Start the worker thread.
+**
+**	Started by the first slideshow or the first decode job.
+**
+**	@returns -1 if the worker can't be started, 0 otherwise.
+*/
+static int SlideStart(void)
+{
+    if (SlideThreadRunning) {
+	return 0;
+    }
+    srandom(getpid() ^ GetMsTicks());
+
+    SlidePixmapMax = SlidePixmapBudget / SLIDE_PIXMAP_SIZE;
+    if (SlidePixmapMax
+	&& !(SlidePixmaps = malloc(SlidePixmapMax * sizeof(*SlidePixmaps)))) {
+	SlidePixmapMax = 0;
+    }
+    CacheInit();
+    SlideQuit = 0;
+    if ((SlideDoneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0
+	|| pthread_create(&SlideThread, NULL, SlideWorker, NULL)) {
+	fprintf(stderr, "slide: can't create worker thread\n");
+	if (SlideDoneFd >= 0) {
+	    close(SlideDoneFd);
+	    SlideDoneFd = -1;
+	}
+	CacheExit();
+	free(SlidePixmaps);
+	SlidePixmaps = NULL;
+	return -1;
+    }
+    LoopAddFd(SlideDoneFd, SlideJobEvent);
+    SlideThreadRunning = 1;
+
+    return 0;
+}
+
+/**
+**	Decode an image on the worker.
+**
+**	The image is loaded like ImageLoad does, but without blocking the
+**	event loop.  The dia must stay valid until done is called from the
+**	event loop.  Jobs not done at SlideExit are dropped.
+**
+**	@param path	file name of image
+**	@param dia	#DIA_SIZE x #DIA_SIZE native pixels
+**	@param stride	pixels per dia line
+**	@param done	called with opaque and true if the image was loaded
+**	@param opaque	argument of done
+**
+**	@returns -1 if the job can't be queued, 0 otherwise.
+*/
+int SlideDecode(const char *path, uint32_t * dia, int stride,
+    void (*done) (void *, int), void *opaque)
+{
+    SlideJob *job;
+
+    if (SlideStart()) {
+	return -1;
+    }
+    if (!(job = calloc(1, sizeof(*job))) || !(job->Path = strdup(path))) {
+	free(job);
+	return -1;
+    }
+    job->Dia = dia;
+    job->Stride = stride;
+    job->Done = done;
+    job->Opaque = opaque;
+    SlideQueue(job);
+
+    return 0;
+}
+
+/**
+**	Start slideshow of a dock.
+**
+**	The first slideshow starts the worker thread.
+**
+**	@param dock	dock with Dock::SlideSource and the slide options
+**
+**	@returns -1 if the worker can't be started, 0 otherwise.
+*/
+int SlideInit(Dock * dock)
+{
+    Slideshow *show;
+    Slideshow **shows;
+    struct stat st;
+
+    if (SlideStart()) {
+	return -1;
+    }
+    // crossfade needs render 0.10 (solid fill), checked at first slide
+    if (dock->SlideFade && !SlideFormat && !SlideFormatPending
+	&& xcb_get_extension_data(Connection, &xcb_render_id)->present) {
+	SlideVersionCookie = xcb_render_query_version(Connection, 0, 10);
+	SlideFormatCookie = xcb_render_query_pict_formats(Connection);
+	SlideFormatPending = 1;
+    }
+
+    if (!(show = calloc(1, sizeof(*show)))) {
+	return -1;
+    }
+    show->Dock = dock;
+    show->Source = dock->SlideSource;
+    show->Viewer = dock->SlideViewer;
+    show->Delay = dock->SlideDelay;
+    show->Random = dock->SlideRandom;
+    show->Fade = dock->SlideFade;
+    show->Inotify = -1;
+
+    // the worker adds the directories, after the tree is indexed
+    if (!stat(show->Source, &st) && S_ISDIR(st.st_mode)
+	&& (show->Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0) {
+	LoopAddFd(show->Inotify, SlideWatchEvent);
+    }
+
+    pthread_mutex_lock(&SlideMutex);
+    shows = realloc(SlideShows, (SlideShowCount + 1) * sizeof(*shows));
+    if (!shows) {
+	pthread_mutex_unlock(&SlideMutex);
+	if (show->Inotify >= 0) {
+	    LoopDelFd(show->Inotify);
+	    close(show->Inotify);
+	}
+	free(show);
+	return -1;
+    }
+    SlideShows = shows;
+    SlideShows[SlideShowCount++] = show;
+    dock->Slideshow = show;
+    pthread_cond_broadcast(&SlideCond);
+    pthread_mutex_unlock(&SlideMutex);
+
+    SlideSchedule(show, GetMsTicks());	// first dia as soon as ready
+
+    return 0;
+}
+
+/**
+**	Free slideshow.
+**
+**	The show is already removed from #SlideShows and not used by the
+**	worker.
+**
+**	@param show	slideshow
+*/
+static void SlideDel(Slideshow * show)
+{
+    int i;
+
+    if (show->Inotify >= 0) {
+	LoopDelFd(show->Inotify);
+	close(show->Inotify);
+    }
+    for (i = 0; i < show->WatchAlloc; ++i) {
+	free(show->Watches[i]);
+    }
+    free(show->Watches);
+    free(show->Events);
+    for (i = 0; i < show->TreeCount; ++i) {
+	free(show->Trees[i]);
+    }
+    free(show->Trees);
+
+    while (show->Filled) {
+	if (show->Ring[show->Read].Pixmap) {	// 0 if in pixmap cache
+	    xcb_free_pixmap(Connection, show->Ring[show->Read].Pixmap);
+	}
+	free(show->Ring[show->Read].Path);
+	show->Read = (show->Read + 1) % SLIDE_PREFETCH;
+	show->Filled--;
+    }
+    for (i = 0; i < show->HistoryCount; ++i) {
+	free(show->History[i]);
+    }
+    for (i = 0; i < show->Count; ++i) {
+	SlideFree(show, show->Playlist[i]);
+    }
+    free(show->Playlist);
+    free(show->Names);
+
+    if (show->Shown) {
+	xcb_render_free_picture(Connection, show->Shown);
+    }
+    if (show->FadeFrom) {
+	xcb_render_free_picture(Connection, show->FadeFrom);
+    }
+    if (show->FadePixmap) {
+	xcb_render_free_picture(Connection, show->FadePicture);
+	xcb_free_pixmap(Connection, show->FadePixmap);
+    }
+    free(show);
+}
+
+/**
+**	Stop slideshow of a dock.
+**
+**	Waits until the worker has finished its work on the show.
+**
+**	@param dock	dock of the slideshow
+*/
+void SlideClose(Dock * dock)
+{
+    Slideshow *show;
+    SlideJob *job;
+    int i;
+
+    if (!(show = dock->Slideshow)) {
+	return;
+    }
+    dock->Slideshow = NULL;
+
+    pthread_mutex_lock(&SlideMutex);
+    show->Stop = 1;
+    while (show->Busy) {
+	pthread_cond_wait(&SlideCond, &SlideMutex);
+    }
+    for (i = 0; i < SlideShowCount; ++i) {
+	if (SlideShows[i] == show) {
+	    memmove(SlideShows + i, SlideShows + i + 1,
+		(SlideShowCount - i - 1) * sizeof(*SlideShows));
+	    SlideShowCount--;
+	    break;
+	}
+    }
+    SlideNextShow = 0;
+    // reloads of the show are only kept in the pixmap cache
+    for (job = SlideJobs; job; job = job->Next) {
+	if (job->Show == show) {
+	    job->Show = NULL;
+	}
+    }
+    for (job = SlideDone; job; job = job->Next) {
+	if (job->Show == show) {
+	    job->Show = NULL;
+	}
+    }
+    if (SlideRunning && SlideRunning->Show == show) {
+	SlideRunning->Show = NULL;
+    }
+    pthread_mutex_unlock(&SlideMutex);
+
+    SlideDel(show);
+    SlideArm();
+}
+
+/**
+**	Stop all slideshows and the worker.
+*/
+void SlideExit(void)
+{
+    int i;
+
+    if (!SlideThreadRunning) {
+	return;
+    }
+    pthread_mutex_lock(&SlideMutex);
+    SlideQuit = 1;
+    for (i = 0; i < SlideShowCount; ++i) {
+	SlideShows[i]->Stop = 1;	// stops running index scan
+    }
+    pthread_cond_broadcast(&SlideCond);
+    pthread_mutex_unlock(&SlideMutex);
+    pthread_join(SlideThread, NULL);
+    SlideThreadRunning = 0;
+    CacheExit();
+
+    LoopDelFd(SlideDoneFd);
+    close(SlideDoneFd);
+    SlideDoneFd = -1;
+    SlideJobFree(SlideJobs);
+    SlideJobs = NULL;
+    SlideJobFree(SlideDone);
+    SlideDone = NULL;
+
+    LoopDelTimer(SlideTimer);
+    LoopDelTimer(SlideFadeTimer);
+    SlideFadeArmed = 0;
+    if (SlideFormatPending) {
+	xcb_discard_reply(Connection, SlideVersionCookie.sequence);
+	xcb_discard_reply(Connection, SlideFormatCookie.sequence);
+	SlideFormatPending = 0;
+    }
+    for (i = 0; i < SlideShowCount; ++i) {
+	SlideShows[i]->Dock->Slideshow = NULL;
+	SlideDel(SlideShows[i]);
+    }
+    free(SlideShows);
+    SlideShows = NULL;
+    SlideShowCount = 0;
+
+    for (i = 0; i < SlidePixmapCount; ++i) {
+	xcb_free_pixmap(Connection, SlidePixmaps[i].Pixmap);
+	free(SlidePixmaps[i].Path);
+    }
+    free(SlidePixmaps);
+    SlidePixmaps = NULL;
+    SlidePixmapCount = 0;
+}
@@ -0,0 +1,54 @@
+///
+///	@file slide.h		@brief	Slideshow module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Slide
+/// @{
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern unsigned SlidePixmapBudget;	///< server memory for pixmaps
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Step through the slides of a dock.
+extern void SlideStep(Dock *, int);
+
+    /// Decode an image on the worker.
+extern int SlideDecode(const char *, uint32_t *, int, void (*)(void *, int),
+    void *);
+
+    /// Start slideshow of a dock.
+extern int SlideInit(Dock *);
+
+    /// Stop slideshow of a dock.
+extern void SlideClose(Dock *);
+
+    /// Stop all slideshows and the worker.
+extern void SlideExit(void);
+
+/// @}
@@ -0,0 +1,367 @@
+///
+///	@file stats.c		@brief	Runtime statistics module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Stats The runtime statistics module.
+///
+///	Always on counters and log2 latency histograms of the event loop,
+///	the X11 events, image decoding and frame uploads.  Updates are
+///	relaxed atomic adds, the slide worker thread counts too.
+///
+///	The statistics are formatted as text on demand, for the WMDIA_STATS
+///	property of the docks and the stats command of the control socket.
+///
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "stats.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define STATS_BUCKETS	24		///< log2 buckets, last one >= 4s
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Latency histogram.
+///
+///	Bucket 0 counts times below 1us, bucket i times of 2^(i-1) upto
+///	2^i microseconds.
+///
+typedef struct _stats_times_
+{
+    uint64_t Sum;			///< sum of recorded times in us
+    uint64_t Max;			///< longest recorded time in us
+    uint64_t Bucket[STATS_BUCKETS];	///< times per log2 bucket
+} StatsHistogram;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+uint64_t StatsCounter[StatsCounters];	///< all counters
+
+static uint64_t StatsStart;		///< time of StatsInit
+
+    /// histograms of StatsTime
+static StatsHistogram StatsHistogramTable[StatsHistograms];
+
+    /// histograms of StatsEvent, indexed by response type
+static StatsHistogram StatsEventTable[STATS_EVENT_TYPES];
+
+    /// names of the counters
+static const char *const StatsCounterNames[StatsCounters] = {
+    [StatsEventsUnknown] = "events_unknown",
+    [StatsFramesShown] = "frames_shown",
+    [StatsFramesUnchanged] = "frames_unchanged",
+    [StatsPresentSkipped] = "present_skipped",
+    [StatsFeedDropped] = "feed_dropped",
+    [StatsStreamDropped] = "stream_dropped",
+    [StatsUploads] = "uploads",
+    [StatsUploadShmBytes] = "upload_shm_bytes",
+    [StatsUploadSocketBytes] = "upload_socket_bytes",
+    [StatsDecodeErrors] = "decode_errors",
+    [StatsCacheHits] = "cache_hits",
+    [StatsCacheMisses] = "cache_misses",
+    [StatsPixmapHits] = "pixmap_hits",
+    [StatsPixmapMisses] = "pixmap_misses",
+    [StatsSpawned] = "spawned",
+    [StatsSpawnErrors] = "spawn_errors",
+};
+
+    /// names of the histograms
+static const char *const StatsHistogramNames[StatsHistograms] = {
+    [StatsLoopTime] = "loop",
+    [StatsDecodeTime] = "decode",
+    [StatsFrameTime] = "frame",
+    [StatsPresentTime] = "present",
+};
+
+    /// names of the core X11 events, extension events are numbered
+static const char *const StatsEventNames[] = {
+    "Error", NULL, "KeyPress", "KeyRelease", "ButtonPress",
+    "ButtonRelease", "MotionNotify", "EnterNotify", "LeaveNotify",
+    "FocusIn", "FocusOut", "KeymapNotify", "Expose", "GraphicsExposure",
+    "NoExposure", "VisibilityNotify", "CreateNotify", "DestroyNotify",
+    "UnmapNotify", "MapNotify", "MapRequest", "ReparentNotify",
+    "ConfigureNotify", "ConfigureRequest", "GravityNotify",
+    "ResizeRequest", "CirculateNotify", "CirculateRequest",
+    "PropertyNotify", "SelectionClear", "SelectionRequest",
+    "SelectionNotify", "ColormapNotify", "ClientMessage", "MappingNotify",
+    "GenericEvent",
+};
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Get monotonic time in microseconds.
+**
+**	@returns microseconds of CLOCK_MONOTONIC.
+*/
+uint64_t StatsMicros(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/**
+**	Record a time in a histogram.
+**
+**	@param hist	histogram
+**	@param us	time in microseconds
+*/
+static void StatsRecord(StatsHistogram * hist, uint64_t us)
+{
+    uint64_t max;
+    int i;
+
+    i = us ? 64 - __builtin_clzll(us) : 0;
+    if (i >= STATS_BUCKETS) {
+	i = STATS_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&hist->Sum, us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->Bucket[i], 1, __ATOMIC_RELAXED);
+
+    max = __atomic_load_n(&hist->Max, __ATOMIC_RELAXED);
+    while (us > max
+	&& !__atomic_compare_exchange_n(&hist->Max, &max, us, 1,
+	    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+**	Record time since start in a histogram.
+**
+**	@param histogram	histogram (StatsLoopTime, ...)
+**	@param start		start time from StatsMicros
+*/
+void StatsTime(int histogram, uint64_t start)
+{
+    StatsRecord(StatsHistogramTable + histogram, StatsMicros() - start);
+}
+
+/**
+**	Record handling time of an X11 event type.
+**
+**	@param type	response type of the event
+**	@param start	start time from StatsMicros
+*/
+void StatsEvent(int type, uint64_t start)
+{
+    StatsRecord(StatsEventTable + (type & (STATS_EVENT_TYPES - 1)),
+	StatsMicros() - start);
+}
+
+/**
+**	Get name of an X11 event type.
+**
+**	@param type	response type of the event
+**
+**	@returns name of a core event, NULL for extension events.
+*/
+const char *StatsEventName(int type)
+{
+    type &= STATS_EVENT_TYPES - 1;
+    if (type < (int)(sizeof(StatsEventNames) / sizeof(*StatsEventNames))) {
+	return StatsEventNames[type];
+    }
+    return NULL;
+}
+
+/**
+**	Append formatted text to a buffer.
+**
+**	@param buf	buffer
+**	@param size	size of buffer
+**	@param len	used bytes of buffer
+**	@param fmt	printf format
+**
+**	@returns used bytes of buffer, truncated at its end.
+*/
+static int StatsPrintf(char *buf, int size, int len, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (len < size - 1) {
+	va_start(ap, fmt);
+	len += vsnprintf(buf + len, size - len, fmt, ap);
+	va_end(ap);
+    }
+    return len < size - 1 ? len : size - 1;
+}
+
+/**
+**	Format a histogram as one text line.
+**
+**	The percentiles are the upper bound of their bucket.
+**
+**	@param buf	buffer
+**	@param size	size of buffer
+**	@param len	used bytes of buffer
+**	@param name	name of histogram
+**	@param hist	histogram
+**
+**	@returns used bytes of buffer.
+*/
+static int StatsFormatHistogram(char *buf, int size, int len,
+    const char *name, const StatsHistogram * hist)
+{
+    uint64_t bucket[STATS_BUCKETS];
+    uint64_t count;
+    uint64_t max;
+    uint64_t sum;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t bound;
+    uint64_t n;
+    int i;
+
+    // counts of a copy, the worker thread may record meanwhile
+    count = 0;
+    for (i = 0; i < STATS_BUCKETS; ++i) {
+	bucket[i] = __atomic_load_n(&hist->Bucket[i], __ATOMIC_RELAXED);
+	count += bucket[i];
+    }
+    if (!count) {
+	return len;
+    }
+    max = __atomic_load_n(&hist->Max, __ATOMIC_RELAXED);
+    sum = __atomic_load_n(&hist->Sum, __ATOMIC_RELAXED);
+
+    p50 = p99 = 0;
+    n = 0;
+    for (i = 0; i < STATS_BUCKETS - 1; ++i) {
+	bound = (1ULL << i) < max ? 1ULL << i : max;
+	n += bucket[i];
+	if (!p50 && n * 2 >= count) {
+	    p50 = bound;
+	}
+	if (!p99 && n * 100 >= count * 99) {
+	    p99 = bound;
+	}
+    }
+    if (!p50) {
+	p50 = max;
+    }
+    if (!p99) {
+	p99 = max;
+    }
+
+    len = StatsPrintf(buf, size, len,
+	"%s count=%llu sum_us=%llu max_us=%llu p50_us=%llu p99_us=%llu "
+	"buckets=", name, (unsigned long long)count, (unsigned long long)sum,
+	(unsigned long long)max, (unsigned long long)p50,
+	(unsigned long long)p99);
+    for (i = 0; i < STATS_BUCKETS; ++i) {
+	if (!bucket[i]) {
+	    continue;
+	}
+	if (i == STATS_BUCKETS - 1) {
+	    len = StatsPrintf(buf, size, len, "inf:%llu,",
+		(unsigned long long)bucket[i]);
+	} else {
+	    len = StatsPrintf(buf, size, len, "%llu:%llu,", 1ULL << i,
+		(unsigned long long)bucket[i]);
+	}
+    }
+    if (buf[len - 1] == ',') {		// replace the last ','
+	buf[len - 1] = '\n';
+    }
+
+    return len;
+}
+
+/**
+**	Format all statistics as text.
+**
+**	One "name value" line per counter, followed by one line per
+**	histogram.  Histograms without any recorded time are omitted.
+**
+**	@param buf	buffer, #STATS_SIZE bytes are enough
+**	@param size	size of buffer
+**
+**	@returns length of the text without the terminating '\\0'.
+*/
+int StatsFormat(char *buf, int size)
+{
+    uint64_t value[StatsCounters];
+    char name[32];
+    int len;
+    int i;
+
+    for (i = 0; i < StatsCounters; ++i) {
+	value[i] = __atomic_load_n(&StatsCounter[i], __ATOMIC_RELAXED);
+    }
+    buf[0] = '\0';
+    len = StatsPrintf(buf, size, 0, "uptime_s %llu\n",
+	(unsigned long long)(StatsMicros() - StatsStart) / 1000000);
+    for (i = 0; i < StatsCounters; ++i) {
+	len = StatsPrintf(buf, size, len, "%s %llu\n", StatsCounterNames[i],
+	    (unsigned long long)value[i]);
+    }
+    if (value[StatsCacheHits] + value[StatsCacheMisses]) {
+	len = StatsPrintf(buf, size, len, "cache_hit_percent %llu\n",
+	    (unsigned long long)(value[StatsCacheHits] * 100
+		/ (value[StatsCacheHits] + value[StatsCacheMisses])));
+    }
+    if (value[StatsPixmapHits] + value[StatsPixmapMisses]) {
+	len = StatsPrintf(buf, size, len, "pixmap_hit_percent %llu\n",
+	    (unsigned long long)(value[StatsPixmapHits] * 100
+		/ (value[StatsPixmapHits] + value[StatsPixmapMisses])));
+    }
+
+    for (i = 0; i < StatsHistograms; ++i) {
+	len = StatsFormatHistogram(buf, size, len, StatsHistogramNames[i],
+	    StatsHistogramTable + i);
+    }
+    for (i = 0; i < STATS_EVENT_TYPES; ++i) {
+	if (StatsEventName(i)) {
+	    snprintf(name, sizeof(name), "event_%s", StatsEventName(i));
+	} else {
+	    snprintf(name, sizeof(name), "event_%d", i);
+	}
+	len = StatsFormatHistogram(buf, size, len, name, StatsEventTable + i);
+    }
+
+    return len;
+}
+
+/**
+**	Start the statistics.
+*/
+void StatsInit(void)
+{
+    StatsStart = StatsMicros();
+}
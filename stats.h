@@ -0,0 +1,109 @@
+///
+///	@file stats.h		@brief	Runtime statistics module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Stats
+/// @{
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define STATS_EVENT_TYPES	128	///< X11 event types, without send bit
+#define STATS_SIZE	8192		///< max. bytes of formatted statistics
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Counters.
+///
+enum _stats_counter_
+{
+    StatsEventsUnknown,			///< X11 events nobody handles
+    StatsFramesShown,			///< frames uploaded to a dock
+    StatsFramesUnchanged,		///< frames equal to the shown one
+    StatsPresentSkipped,		///< frames replaced while waiting
+    StatsFeedDropped,			///< feed frames not shown
+    StatsStreamDropped,			///< stream frames not shown
+    StatsUploads,			///< put image requests
+    StatsUploadShmBytes,		///< bytes uploaded with MIT-SHM
+    StatsUploadSocketBytes,		///< bytes uploaded over the socket
+    StatsDecodeErrors,			///< images which couldn't be loaded
+    StatsCacheHits,			///< dias found in the disk cache
+    StatsCacheMisses,			///< dias not in the disk cache
+    StatsPixmapHits,			///< slides found in the pixmap cache
+    StatsPixmapMisses,			///< slides not in the pixmap cache
+    StatsSpawned,			///< commands launched
+    StatsSpawnErrors,			///< commands which couldn't be launched
+    StatsCounters,			///< number of counters
+};
+
+///
+///	Latency histograms.
+///
+enum _stats_histogram_
+{
+    StatsLoopTime,			///< work of an event loop iteration
+    StatsDecodeTime,			///< load and scale of an image
+    StatsFrameTime,			///< diff and upload of a frame
+    StatsPresentTime,			///< present request until completion
+    StatsHistograms,			///< number of histograms
+};
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern uint64_t StatsCounter[StatsCounters];	///< all counters
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Add to a counter, from any thread.
+static inline void StatsAdd(int counter, uint64_t n)
+{
+    __atomic_fetch_add(&StatsCounter[counter], n, __ATOMIC_RELAXED);
+}
+
+    /// Get monotonic time in microseconds.
+extern uint64_t StatsMicros(void);
+
+    /// Record time since start in a histogram.
+extern void StatsTime(int, uint64_t);
+
+    /// Record handling time of an X11 event type.
+extern void StatsEvent(int, uint64_t);
+
+    /// Get name of an X11 event type.
+extern const char *StatsEventName(int);
+
+    /// Format all statistics as text.
+extern int StatsFormat(char *, int);
+
+    /// Start the statistics.
+extern void StatsInit(void);
+
+/// @}
@@ -0,0 +1,398 @@
+///
+///	@file stream.c		@brief	Raw frame stream module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Stream The raw frame stream module.
+///
+///	Reads a continuous stream of fixed size raw frames from a fifo,
+///	file or stdin, for cases where the shared memory feed isn't
+///	available (containers, ssh pipes).  Reads are non-blocking and
+///	done from the event loop.  A pacer shows at most #StreamFps frames
+///	per second, always the newest complete frame, older frames are
+///	dropped.  A regular file is always readable, it is read by the
+///	pacer one frame per shown frame, so a recording plays at #StreamFps.
+///
+///	Example:
+///	ffmpeg -i video.mkv -vf scale=64:64 -f rawvideo -pix_fmt bgr0 - |
+///	wmdia -i -
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xcb_image.h>
+
+#include "wmdia.h"
+#include "frame.h"
+#include "pixel.h"
+#include "stream.h"
+#include "stats.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define STREAM_READS	8		///< max. reads per wakeup
+
+///
+///	Pixel formats of raw frames.
+///
+enum _stream_format_
+{
+    StreamBGRX,				///< 32bit B G R X bytes
+    StreamRGB24,			///< 24bit R G B bytes
+    StreamYUV420,			///< planar YUV 4:2:0 (I420)
+};
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+int StreamSize = DOCK_SIZE;		///< width and height of frames
+int StreamFps = 30;			///< max. frames shown per second
+
+static enum _stream_format_ StreamFormat;	///< pixel format of frames
+static Dock *StreamDock;		///< dock showing the stream
+static int StreamFd = -1;		///< stream file descriptor
+static int StreamStdinFlags = -1;	///< file status flags of stdin
+static char StreamPaced;		///< regular file, read by the pacer
+static int StreamFrameSize;		///< bytes of one frame
+static uint8_t *StreamBuffer;		///< frame being read
+static int StreamFill;			///< bytes read into StreamBuffer
+static uint8_t *StreamNewest;		///< newest complete frame
+static char StreamPending;		///< newest frame not shown
+static uint32_t StreamShown;		///< tick of last shown frame
+
+//----------------------------------------------------------------------------
+//	Convert
+//----------------------------------------------------------------------------
+
+/**
+**	Convert raw frame to native pixels.
+**
+**	@param src	raw frame
+**	@param[out] dst	#StreamSize x #StreamSize pixels
+*/
+static void StreamConvert(const uint8_t * src, uint32_t * dst)
+{
+    switch (StreamFormat) {
+	case StreamBGRX:
+	    PixelFromBGRX(dst, src, StreamSize * StreamSize);
+	    break;
+	case StreamRGB24:
+	    PixelFromRGB24(dst, src, StreamSize * StreamSize);
+	    break;
+	case StreamYUV420:
+	    PixelFromYUV420(dst, src, StreamSize, StreamSize);
+	    break;
+    }
+}
+
+//----------------------------------------------------------------------------
+//	Pacer
+//----------------------------------------------------------------------------
+
+static void StreamReadFile(void);	///< forward define for StreamShow
+
+/**
+**	Show the newest complete frame.
+**
+**	Timer handler of the pacer.
+*/
+static void StreamShow(void)
+{
+    uint32_t pixels[DOCK_SIZE * DOCK_SIZE];
+    uint32_t frame[DOCK_SIZE * DOCK_SIZE];
+    uint32_t border;
+    int y;
+
+    if (!StreamPending) {
+	return;
+    }
+    StreamPending = 0;
+    StreamShown = GetMsTicks();
+
+    if (StreamSize == DOCK_SIZE) {
+	StreamConvert(StreamNewest, pixels);
+    } else {				// center dia inside the dock
+	StreamConvert(StreamNewest, frame);
+	border = RgbPixel(0xA9, 0xA9, 0xA9);	// darkgray
+	for (y = 0; y < DOCK_SIZE * DOCK_SIZE; ++y) {
+	    pixels[y] = border;
+	}
+	for (y = 0; y < DIA_SIZE; ++y) {
+	    memcpy(pixels + (y + 1) * DOCK_SIZE + 1, frame + y * DIA_SIZE,
+		DIA_SIZE * 4);
+	}
+    }
+    ShowFrame(StreamDock, pixels, DOCK_SIZE);
+
+    if (StreamPaced && StreamFd >= 0) {
+	StreamReadFile();
+    }
+}
+
+/**
+**	Complete frame read.
+**
+**	The frame becomes the newest frame, an unshown frame is dropped.
+**	The pacer timer is armed, if not already running.
+*/
+static void StreamComplete(void)
+{
+    uint8_t *swap;
+    uint32_t tick;
+
+    swap = StreamNewest;
+    StreamNewest = StreamBuffer;
+    StreamBuffer = swap;
+    StreamFill = 0;
+    TraceInstant("stream frame", StreamPending);
+
+    if (StreamPending) {
+	StatsAdd(StatsStreamDropped, 1);
+	return;				// timer already armed
+    }
+    StreamPending = 1;
+
+    tick = GetMsTicks();
+    if (StreamFps > 0 && (int32_t) (StreamShown + 1000 / StreamFps - tick) > 0) {
+	tick = StreamShown + 1000 / StreamFps;
+    }
+    LoopSetTimer(StreamShow, tick);
+}
+
+/**
+**	Stop reading the stream.
+**
+**	stdin isn't closed, its file status flags are restored: the open
+**	file description is shared with the shell or the pipe writer.
+*/
+static void StreamStop(void)
+{
+    LoopDelFd(StreamFd);
+    if (StreamFd) {
+	close(StreamFd);
+    } else if (StreamStdinFlags >= 0) {
+	fcntl(StreamFd, F_SETFL, StreamStdinFlags);
+	StreamStdinFlags = -1;
+    }
+    StreamFd = -1;
+}
+
+/**
+**	Read next frame of a regular file.
+**
+**	Called by the pacer, after the last frame was shown.
+*/
+static void StreamReadFile(void)
+{
+    ssize_t n;
+
+    while (StreamFill < StreamFrameSize) {
+	n = read(StreamFd, StreamBuffer + StreamFill,
+	    StreamFrameSize - StreamFill);
+	if (n > 0) {
+	    StreamFill += n;
+	    continue;
+	}
+	if (n < 0 && errno == EINTR) {
+	    continue;
+	}
+	// end of file or error
+	if (n < 0) {
+	    fprintf(stderr, "stream: read error %s\n", strerror(errno));
+	}
+	StreamStop();
+	return;
+    }
+    StreamComplete();
+}
+
+/**
+**	Read raw frames.
+**
+**	Called from the event loop, when the stream is readable.  Limited to
+**	#STREAM_READS reads, to keep the X11 event latency low.
+*/
+static void StreamRead(void)
+{
+    ssize_t n;
+    int i;
+
+    for (i = 0; i < STREAM_READS; ++i) {
+	n = read(StreamFd, StreamBuffer + StreamFill,
+	    StreamFrameSize - StreamFill);
+	if (n > 0) {
+	    StreamFill += n;
+	    if (StreamFill == StreamFrameSize) {
+		StreamComplete();
+	    }
+	    continue;
+	}
+	if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+	    return;
+	}
+	// end of stream or error
+	if (n < 0) {
+	    fprintf(stderr, "stream: read error %s\n", strerror(errno));
+	}
+	StreamStop();
+	return;
+    }
+}
+
+//----------------------------------------------------------------------------
+//	Setup
+//----------------------------------------------------------------------------
+
+/**
+**	Set pixel format of raw frames.
+**
+**	@param format	bgrx, rgb24 or yuv420
+**
+**	@returns -1 for unknown formats, 0 otherwise.
+*/
+int StreamSetFormat(const char *format)
+{
+    if (!strcmp(format, "bgrx")) {
+	StreamFormat = StreamBGRX;
+    } else if (!strcmp(format, "rgb24")) {
+	StreamFormat = StreamRGB24;
+    } else if (!strcmp(format, "yuv420")) {
+	StreamFormat = StreamYUV420;
+    } else {
+	return -1;
+    }
+    return 0;
+}
+
+/**
+**	Open raw frame stream of a dock.
+**
+**	Only one dock can show a stream, stdin exists only once.
+**
+**	@param dock	dock with Dock::StreamSource, fifo/file name or "-"
+**
+**	@returns -1 on error, 0 otherwise.
+*/
+int StreamInit(Dock * dock)
+{
+    const char *source;
+    struct stat st;
+
+    if (StreamDock) {
+	fprintf(stderr, "stream: only one dock can show a stream\n");
+	return -1;
+    }
+    source = dock->StreamSource;
+
+    switch (StreamFormat) {
+	case StreamBGRX:
+	    StreamFrameSize = StreamSize * StreamSize * 4;
+	    break;
+	case StreamRGB24:
+	    StreamFrameSize = StreamSize * StreamSize * 3;
+	    break;
+	case StreamYUV420:
+	    StreamFrameSize = StreamSize * StreamSize * 3 / 2;
+	    break;
+    }
+
+    if (!strcmp(source, "-")) {
+	StreamFd = STDIN_FILENO;
+	StreamStdinFlags = fcntl(StreamFd, F_GETFL);
+	if (StreamStdinFlags >= 0) {
+	    fcntl(StreamFd, F_SETFL, StreamStdinFlags | O_NONBLOCK);
+	}
+    } else if (!stat(source, &st) && S_ISFIFO(st.st_mode)) {
+	// opened read-write, writers can come and go without EOF
+	StreamFd = open(source, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    } else {
+	StreamFd = open(source, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    if (StreamFd < 0) {
+	fprintf(stderr, "stream: can't open '%s'\n", source);
+	return -1;
+    }
+    StreamDock = dock;
+
+    if (!(StreamBuffer = malloc(StreamFrameSize))
+	|| !(StreamNewest = malloc(StreamFrameSize))) {
+	fprintf(stderr, "stream: out of memory\n");
+	StreamExit();
+	return -1;
+    }
+    StreamFill = 0;
+    StreamPending = 0;
+    StreamShown = GetMsTicks();
+
+    StreamPaced = !fstat(StreamFd, &st) && S_ISREG(st.st_mode);
+    if (StreamPaced) {
+	StreamReadFile();
+    } else {
+	LoopAddFd(StreamFd, StreamRead);
+    }
+
+    return 0;
+}
+
+/**
+**	Close raw frame stream.
+*/
+void StreamExit(void)
+{
+    LoopDelTimer(StreamShow);
+    if (StreamFd >= 0) {
+	StreamStop();
+    }
+    StreamPaced = 0;
+    free(StreamBuffer);
+    StreamBuffer = NULL;
+    free(StreamNewest);
+    StreamNewest = NULL;
+    StreamDock = NULL;
+}
+
+/**
+**	Close raw frame stream, if shown by the dock.
+**
+**	@param dock	closed dock
+*/
+void StreamClose(const Dock * dock)
+{
+    if (dock == StreamDock) {
+	StreamExit();
+    }
+}
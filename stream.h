@@ -0,0 +1,51 @@
+///
+///	@file stream.h		@brief	Raw frame stream module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Stream
+/// @{
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern int StreamSize;			///< width and height of frames
+extern int StreamFps;			///< max. frames shown per second
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Set pixel format of raw frames.
+extern int StreamSetFormat(const char *);
+
+    /// Open raw frame stream of a dock.
+extern int StreamInit(Dock *);
+
+    /// Close raw frame stream, if shown by the dock.
+extern void StreamClose(const Dock *);
+
+    /// Close raw frame stream.
+extern void StreamExit(void);
+
+/// @}
@@ -0,0 +1,550 @@
+///
+///	@file text.c		@brief	Text renderer module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Text The text renderer module.
+///
+///	UTF-8 text is drawn with XRender.  Each glyph is rasterized by
+///	FreeType only once, when it is first used, and uploaded as 8bit
+///	alpha mask into a server side GlyphSet.  Drawing a text with any
+///	number of lines is then a single CompositeGlyphs request.
+///
+///	The font is selected by a fontconfig pattern, like "sans-10" or
+///	"DejaVu Sans Mono:pixelsize=14".
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <fontconfig/fontconfig.h>
+
+#include <xcb/xcb.h>
+#include <xcb/render.h>
+
+#include "wmdia.h"
+#include "text.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define TEXT_PAGE	256		///< glyphs per page of glyph table
+#define TEXT_PAGES	(0x110000 / TEXT_PAGE)	///< pages for all unicode
+#define TEXT_ELT	254		///< max. glyphs of one glyph element
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Glyph of the glyph set, the glyph id is the unicode code point.
+///
+typedef struct _text_glyph_
+{
+    int16_t Advance;			///< horizontal pen advance
+    char Loaded;			///< glyph uploaded into glyph set
+} TextGlyph;
+
+///
+///	Glyph element of CompositeGlyphs, followed by the glyph ids.
+///
+typedef struct _text_elt_
+{
+    uint8_t Len;			///< number of glyphs
+    uint8_t Pad[3];			///< unused
+    int16_t DeltaX;			///< pen movement before the glyphs
+    int16_t DeltaY;			///< pen movement before the glyphs
+} TextElt;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+static FT_Library TextLibrary;		///< FreeType library handle
+static FT_Face TextFace;		///< FreeType face of our font
+static int TextAscent;			///< font ascent
+static int TextHeight;			///< line height
+
+static xcb_render_pictformat_t TextFormatA8;	///< format of glyphs
+static xcb_render_pictformat_t TextFormatScreen;	///< root visual format
+static xcb_render_glyphset_t TextGlyphSet;	///< server side glyphs
+static xcb_render_picture_t TextPen;	///< solid fill of text color
+
+static TextGlyph *TextGlyphs[TEXT_PAGES];	///< glyph table pages
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Decode next UTF-8 character.
+**
+**	Invalid sequences are returned byte by byte as U+FFFD.
+**
+**	@param[in,out] str	text, moved behind the character
+**	@param end		end of text
+**
+**	@returns unicode code point of the character.
+*/
+static uint32_t TextUtf8(const char **str, const char *end)
+{
+    const uint8_t *s;
+    uint32_t c;
+    int n;
+    int i;
+
+    s = (const uint8_t *)*str;
+    c = *s++;
+    *str = (const char *)s;
+    if (c < 0x80) {
+	return c;
+    }
+    if (c >= 0xC2 && c < 0xE0) {
+	n = 1;
+	c &= 0x1F;
+    } else if (c >= 0xE0 && c < 0xF0) {
+	n = 2;
+	c &= 0x0F;
+    } else if (c >= 0xF0 && c < 0xF5) {
+	n = 3;
+	c &= 0x07;
+    } else {
+	return 0xFFFD;
+    }
+    if (n > end - (const char *)s) {
+	return 0xFFFD;
+    }
+    for (i = 0; i < n; ++i) {
+	if ((s[i] & 0xC0) != 0x80) {
+	    return 0xFFFD;
+	}
+	c = c << 6 | (s[i] & 0x3F);
+    }
+    // overlong, surrogates and out of range
+    if ((n == 2 && c < 0x800) || (n == 3 && c < 0x10000) || c > 0x10FFFF
+	|| (c >= 0xD800 && c < 0xE000)) {
+	return 0xFFFD;
+    }
+    *str = (const char *)s + n;
+    return c;
+}
+
+/**
+**	Get glyph, rasterize and upload it on first use.
+**
+**	Out of memory, the glyph is uploaded empty or not at all.
+**
+**	@param c	unicode code point
+**
+**	@returns glyph, NULL if the character must be skipped.
+*/
+static const TextGlyph *TextGetGlyph(uint32_t c)
+{
+    TextGlyph *glyph;
+    FT_Bitmap *bitmap;
+    xcb_render_glyphinfo_t info;
+    const uint8_t *src;
+    uint8_t *data;
+    int stride;
+    int x;
+    int y;
+
+    if (!TextGlyphs[c / TEXT_PAGE]
+	&& !(TextGlyphs[c / TEXT_PAGE] =
+	    calloc(TEXT_PAGE, sizeof(TextGlyph)))) {
+	return NULL;
+    }
+    glyph = TextGlyphs[c / TEXT_PAGE] + c % TEXT_PAGE;
+    if (glyph->Loaded) {
+	return glyph;
+    }
+    glyph->Loaded = 1;
+
+    memset(&info, 0, sizeof(info));
+    data = NULL;
+    stride = 0;
+    // missing characters get the .notdef glyph of the font
+    if (!FT_Load_Char(TextFace, c, FT_LOAD_RENDER | FT_LOAD_TARGET_LIGHT)) {
+	bitmap = &TextFace->glyph->bitmap;
+	info.width = bitmap->width;
+	info.height = bitmap->rows;
+	info.x = -TextFace->glyph->bitmap_left;
+	info.y = TextFace->glyph->bitmap_top;
+	info.x_off = (TextFace->glyph->advance.x + 32) >> 6;
+
+	// A8 rows are padded to 32bit
+	stride = (info.width + 3) & ~3;
+	if (!(data = calloc(info.height, stride))) {
+	    info.width = 0;		// empty glyph, keeps the advance
+	    info.height = 0;
+	}
+	for (y = 0; y < info.height; ++y) {
+	    src = bitmap->buffer + y * bitmap->pitch;
+	    for (x = 0; x < info.width; ++x) {
+		if (bitmap->pixel_mode == FT_PIXEL_MODE_MONO) {
+		    data[y * stride + x] =
+			(src[x >> 3] >> (7 - (x & 7)) & 1) * 0xFF;
+		} else {
+		    data[y * stride + x] = src[x];
+		}
+	    }
+	}
+    }
+    glyph->Advance = info.x_off;
+    xcb_render_add_glyphs(Connection, TextGlyphSet, 1, &c, &info,
+	info.height * stride, data);
+    free(data);
+
+    return glyph;
+}
+
+/**
+**	Width and height of UTF-8 text.
+**
+**	Lines are separated by '\n', other control characters are ignored.
+**	New glyphs of the text are uploaded.
+**
+**	@param str		UTF-8 text
+**	@param len		bytes of text
+**	@param[out] width	width of the longest line
+**	@param[out] height	height of all lines
+*/
+void TextExtents(const char *str, int len, int *width, int *height)
+{
+    const TextGlyph *glyph;
+    const char *end;
+    uint32_t c;
+    int lines;
+    int w;
+
+    end = str + len;
+    *width = 0;
+    lines = 1;
+    w = 0;
+    while (str < end) {
+	c = TextUtf8(&str, end);
+	if (c == '\n') {
+	    if (w > *width) {
+		*width = w;
+	    }
+	    if (str < end) {		// no empty last line
+		++lines;
+		w = 0;
+	    }
+	    continue;
+	}
+	if (c < ' ' || !(glyph = TextGetGlyph(c))) {
+	    continue;
+	}
+	w += glyph->Advance;
+    }
+    if (w > *width) {
+	*width = w;
+    }
+    *height = lines * TextHeight;
+}
+
+/**
+**	Draw UTF-8 text.
+**
+**	All lines are drawn by one CompositeGlyphs request, a new line is
+**	just a glyph element moving the pen back.
+**
+**	@param picture	destination render picture
+**	@param x	left side of text
+**	@param y	top of first line
+**	@param str	UTF-8 text
+**	@param len	bytes of text
+*/
+void TextDraw(xcb_render_picture_t picture, int x, int y, const char *str,
+    int len)
+{
+    const TextGlyph *glyph;
+    const char *end;
+    uint8_t *cmds;
+    uint8_t *p;
+    TextElt *elt;
+    uint32_t c;
+    int dx;
+    int dy;
+    int line;
+
+    // worst case: each glyph has its own element
+    if (!(cmds = malloc(len * (sizeof(TextElt) + 4) + sizeof(TextElt)))) {
+	return;
+    }
+    p = cmds;
+    elt = NULL;
+    end = str + len;
+    dx = x;				// pending pen movement
+    dy = y + TextAscent;
+    line = 0;				// pen advance of current line
+    while (str < end) {
+	c = TextUtf8(&str, end);
+	if (c == '\n') {
+	    dx -= line;
+	    dy += TextHeight;
+	    line = 0;
+	    continue;
+	}
+	if (c < ' ' || !(glyph = TextGetGlyph(c))) {
+	    continue;
+	}
+	line += glyph->Advance;
+	if (!elt || elt->Len == TEXT_ELT || dx || dy) {
+	    elt = (TextElt *) p;
+	    memset(elt, 0, sizeof(*elt));
+	    elt->DeltaX = dx;
+	    elt->DeltaY = dy;
+	    p += sizeof(*elt);
+	    dx = 0;
+	    dy = 0;
+	}
+	memcpy(p, &c, sizeof(c));
+	p += sizeof(c);
+	++elt->Len;
+    }
+    if (p != cmds) {
+	xcb_render_composite_glyphs_32(Connection, XCB_RENDER_PICT_OP_OVER,
+	    TextPen, picture, TextFormatA8, TextGlyphSet, 0, 0, p - cmds,
+	    cmds);
+    }
+    free(cmds);
+}
+
+/**
+**	Create render picture for a drawable with our root visual.
+**
+**	@param drawable	window or pixmap of our screen
+**
+**	@returns render picture, to be freed with xcb_render_free_picture.
+*/
+xcb_render_picture_t TextPicture(xcb_drawable_t drawable)
+{
+    xcb_render_picture_t picture;
+
+    picture = xcb_generate_id(Connection);
+    xcb_render_create_picture(Connection, picture, drawable,
+	TextFormatScreen, 0, NULL);
+
+    return picture;
+}
+
+/**
+**	Find the picture formats of glyphs and of our root visual.
+**
+**	@param reply	reply of QueryPictFormats
+*/
+static void TextFindFormats(const xcb_render_query_pict_formats_reply_t *
+    reply)
+{
+    const xcb_render_pictforminfo_t *formats;
+    const xcb_render_pictvisual_t *visuals;
+    xcb_render_pictscreen_iterator_t screens;
+    xcb_render_pictdepth_iterator_t depths;
+    int n;
+    int i;
+
+    formats = xcb_render_query_pict_formats_formats(reply);
+    n = xcb_render_query_pict_formats_formats_length(reply);
+    for (i = 0; i < n; ++i) {
+	if (formats[i].type == XCB_RENDER_PICT_TYPE_DIRECT
+	    && formats[i].depth == 8 && formats[i].direct.alpha_mask == 0xFF
+	    && !formats[i].direct.alpha_shift) {
+	    TextFormatA8 = formats[i].id;
+	}
+    }
+
+    for (screens = xcb_render_query_pict_formats_screens_iterator(reply);
+	screens.rem; xcb_render_pictscreen_next(&screens)) {
+	for (depths = xcb_render_pictscreen_depths_iterator(screens.data);
+	    depths.rem; xcb_render_pictdepth_next(&depths)) {
+	    visuals = xcb_render_pictdepth_visuals(depths.data);
+	    n = xcb_render_pictdepth_visuals_length(depths.data);
+	    for (i = 0; i < n; ++i) {
+		if (visuals[i].visual == Screen->root_visual) {
+		    TextFormatScreen = visuals[i].format;
+		}
+	    }
+	}
+    }
+}
+
+/**
+**	Open font of fontconfig pattern.
+**
+**	@param name	fontconfig pattern
+**
+**	@returns true if a font could be opened.
+*/
+static int TextOpenFont(const char *name)
+{
+    FcPattern *pattern;
+    FcPattern *match;
+    FcResult result;
+    FcChar8 *file;
+    double size;
+    int index;
+    int ok;
+
+    if (!(pattern = FcNameParse((const FcChar8 *)name))) {
+	return 0;
+    }
+    FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+    FcDefaultSubstitute(pattern);
+    match = FcFontMatch(NULL, pattern, &result);
+    FcPatternDestroy(pattern);
+    if (!match) {
+	return 0;
+    }
+
+    ok = 0;
+    if (FcPatternGetString(match, FC_FILE, 0, &file) == FcResultMatch
+	&& !FT_Init_FreeType(&TextLibrary)) {
+	if (FcPatternGetInteger(match, FC_INDEX, 0, &index) != FcResultMatch) {
+	    index = 0;
+	}
+	if (FcPatternGetDouble(match, FC_PIXEL_SIZE, 0,
+		&size) != FcResultMatch) {
+	    size = 13.0;
+	}
+	if (!FT_New_Face(TextLibrary, (const char *)file, index, &TextFace)) {
+	    // bitmap only fonts have fixed sizes
+	    if (FT_Set_Pixel_Sizes(TextFace, 0, size + 0.5)
+		&& TextFace->num_fixed_sizes) {
+		FT_Select_Size(TextFace, 0);
+	    }
+	    ok = 1;
+	} else {
+	    FT_Done_FreeType(TextLibrary);
+	    TextLibrary = NULL;
+	}
+    }
+    FcPatternDestroy(match);
+
+    return ok;
+}
+
+/**
+**	Setup text renderer.
+**
+**	@param name	fontconfig pattern of the font
+**
+**	@returns true if render and the font are available.
+*/
+int TextInit(const char *name)
+{
+    xcb_render_query_version_cookie_t version_cookie;
+    xcb_render_query_pict_formats_cookie_t formats_cookie;
+    xcb_render_query_version_reply_t *version;
+    xcb_render_query_pict_formats_reply_t *formats;
+    xcb_render_color_t color;
+    int descent;
+    int ok;
+
+    // requests are sent first, the font is opened meanwhile
+    version_cookie = xcb_render_query_version(Connection, 0, 10);
+    formats_cookie = xcb_render_query_pict_formats(Connection);
+    xcb_flush(Connection);
+
+    ok = TextOpenFont(name);
+    if (!ok) {
+	fprintf(stderr, "text: can't open font '%s'\n", name);
+    }
+
+    version = xcb_render_query_version_reply(Connection, version_cookie,
+	NULL);
+    formats = xcb_render_query_pict_formats_reply(Connection,
+	formats_cookie, NULL);
+    if (!version || !formats
+	|| (!version->major_version && version->minor_version < 10)) {
+	fprintf(stderr, "text: render extension 0.10 missing\n");
+	ok = 0;
+    } else {
+	TextFindFormats(formats);
+	if (!TextFormatA8 || !TextFormatScreen) {
+	    fprintf(stderr, "text: no render format for glyphs/screen\n");
+	    ok = 0;
+	}
+    }
+    free(version);
+    free(formats);
+
+    if (!ok) {
+	TextExit();
+	return 0;
+    }
+
+    TextAscent = (TextFace->size->metrics.ascender + 63) >> 6;
+    descent = (-TextFace->size->metrics.descender + 63) >> 6;
+    TextHeight = (TextFace->size->metrics.height + 63) >> 6;
+    if (TextHeight < TextAscent + descent) {
+	TextHeight = TextAscent + descent;
+    }
+
+    TextGlyphSet = xcb_generate_id(Connection);
+    xcb_render_create_glyph_set(Connection, TextGlyphSet, TextFormatA8);
+
+    color.red = 0;			// black text
+    color.green = 0;
+    color.blue = 0;
+    color.alpha = 0xFFFF;
+    TextPen = xcb_generate_id(Connection);
+    xcb_render_create_solid_fill(Connection, TextPen, color);
+
+    return 1;
+}
+
+/**
+**	Cleanup text renderer.
+*/
+void TextExit(void)
+{
+    int i;
+
+    if (TextGlyphSet) {
+	xcb_render_free_picture(Connection, TextPen);
+	xcb_render_free_glyph_set(Connection, TextGlyphSet);
+	TextGlyphSet = 0;
+	TextPen = 0;
+    }
+    for (i = 0; i < TEXT_PAGES; ++i) {
+	free(TextGlyphs[i]);
+	TextGlyphs[i] = NULL;
+    }
+    if (TextFace) {
+	FT_Done_Face(TextFace);
+	TextFace = NULL;
+    }
+    if (TextLibrary) {
+	FT_Done_FreeType(TextLibrary);
+	TextLibrary = NULL;
+    }
+    TextFormatA8 = 0;
+    TextFormatScreen = 0;
+}
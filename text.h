@@ -0,0 +1,47 @@
+///
+///	@file text.h		@brief	Text renderer module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Text
+/// @{
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Width and height of UTF-8 text.
+extern void TextExtents(const char *, int, int *, int *);
+
+    /// Draw UTF-8 text with top left corner at x, y.
+extern void TextDraw(xcb_render_picture_t, int, int, const char *, int);
+
+    /// Create render picture for a drawable of our screen.
+extern xcb_render_picture_t TextPicture(xcb_drawable_t);
+
+    /// Setup text renderer.
+extern int TextInit(const char *);
+
+    /// Cleanup text renderer.
+extern void TextExit(void);
+
+/// @}
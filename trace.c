@@ -0,0 +1,367 @@
+///
+///	@file trace.c		@brief	Event tracing module
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Trace The event tracing module.
+///
+///	With -P tracefile, spans of the event loop, the X11 events and the
+///	frame pipeline (arrived, decoded, uploaded, flushed) are recorded
+///	into a ring per thread.  Each ring has only one writer, which
+///	publishes its head with a release store, no lock is taken.  The
+///	rings keep the newest #TRACE_EVENTS spans of each thread.
+///
+///	The rings are written as chrome trace JSON (chrome://tracing,
+///	ui.perfetto.dev) on exit and on SIGUSR1.  SIGUSR1 is received with a
+///	signalfd in the event loop, like SIGCHLD of the launcher.
+///
+///	Disabled, a span costs one load and a not taken branch.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+
+#include <xcb/xcb.h>
+
+#include "wmdia.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define TRACE_THREADS	8		///< max. traced threads
+#define TRACE_EVENTS	(64 * 1024)	///< spans per thread, power of 2
+#define TRACE_INSTANT	UINT64_MAX	///< duration of an instant
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Recorded span or instant.
+///
+typedef struct _trace_event_
+{
+    uint64_t Start;			///< start time in ns
+    uint64_t Duration;			///< duration in ns, #TRACE_INSTANT
+    const char *Name;			///< constant name
+    int64_t Arg;			///< argument of the span
+} TraceEvent;
+
+///
+///	Trace ring of one thread.
+///
+typedef struct _trace_ring_
+{
+    const char *Name;			///< name of the thread
+    pid_t Tid;				///< thread id
+    uint64_t Head;			///< spans ever recorded
+    TraceEvent Events[TRACE_EVENTS];	///< newest spans
+} TraceRing;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+const char *TraceFile;			///< trace file name, NULL disabled
+int TraceEnabled;			///< spans are recorded
+
+static uint64_t TraceStart;		///< time of TraceInit
+static int TraceFd = -1;		///< signalfd of SIGUSR1
+static TraceRing *TraceRings[TRACE_THREADS];	///< rings of all threads
+static int TraceRingCount;		///< used entries of #TraceRings
+static __thread TraceRing *TraceThreadRing;	///< ring of this thread
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Get trace time in nanoseconds.
+**
+**	@returns nanoseconds of CLOCK_MONOTONIC.
+*/
+uint64_t TraceNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+**	Create the trace ring of the calling thread.
+**
+**	@param name	name of the thread, constant string
+**
+**	@returns the new ring, NULL if all rings are used.
+*/
+static TraceRing *TraceRingNew(const char *name)
+{
+    TraceRing *ring;
+    int i;
+
+    if (__atomic_load_n(&TraceRingCount, __ATOMIC_RELAXED) >= TRACE_THREADS
+	|| (i = __atomic_fetch_add(&TraceRingCount, 1,
+		__ATOMIC_RELAXED)) >= TRACE_THREADS) {
+	return NULL;
+    }
+    // pages are only touched, when the spans are recorded
+    if (!(ring = calloc(1, sizeof(*ring)))) {
+	return NULL;
+    }
+    ring->Name = name ? name : "thread";
+    ring->Tid = syscall(SYS_gettid);
+    __atomic_store_n(&TraceRings[i], ring, __ATOMIC_RELEASE);
+
+    return ring;
+}
+
+/**
+**	Record a span or an instant.
+**
+**	Called by TraceEnd and TraceInstant, the oldest span of the ring is
+**	overwritten.
+**
+**	@param name	constant name
+**	@param start	start time in ns
+**	@param duration	duration in ns, #TRACE_INSTANT for an instant
+**	@param arg	argument shown with the span
+*/
+void TraceRecord(const char *name, uint64_t start, uint64_t duration,
+    int64_t arg)
+{
+    TraceRing *ring;
+    TraceEvent *event;
+    uint64_t head;
+
+    if (!(ring = TraceThreadRing)
+	&& !(ring = TraceThreadRing = TraceRingNew(NULL))) {
+	return;
+    }
+    head = ring->Head;			// we are the only writer
+    event = ring->Events + (head & (TRACE_EVENTS - 1));
+    event->Start = start;
+    event->Duration = duration;
+    event->Name = name;
+    event->Arg = arg;
+    __atomic_store_n(&ring->Head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+**	Name the trace ring of the calling thread.
+**
+**	Threads without a name get their ring with the first span.
+**
+**	@param name	name of the thread, constant string
+*/
+void TraceThread(const char *name)
+{
+    if (TraceEnabled && !TraceThreadRing) {
+	TraceThreadRing = TraceRingNew(name);
+    }
+}
+
+/**
+**	Write one trace ring.
+**
+**	The ring is copied first, spans overwritten by its thread during
+**	the copy are skipped.
+**
+**	@param file	trace file
+**	@param ring	trace ring
+**	@param events	copy buffer of #TRACE_EVENTS spans
+**	@param pid	process id
+*/
+static void TraceDumpRing(FILE * file, TraceRing * ring, TraceEvent * events,
+    int pid)
+{
+    const TraceEvent *event;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t skip;
+    uint64_t start;
+    int n;
+    int i;
+
+    fprintf(file,
+	",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+	"\"args\":{\"name\":\"%s\"}}", pid, ring->Tid, ring->Name);
+
+    head = __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE);
+    tail = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+    n = head - tail;
+    i = tail & (TRACE_EVENTS - 1);
+    if (i + n > TRACE_EVENTS) {
+	memcpy(events, ring->Events + i,
+	    (TRACE_EVENTS - i) * sizeof(*events));
+	memcpy(events + TRACE_EVENTS - i, ring->Events,
+	    (i + n - TRACE_EVENTS) * sizeof(*events));
+    } else {
+	memcpy(events, ring->Events + i, n * sizeof(*events));
+    }
+    // the slot of the head can be written, before the head moves
+    head = __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE) + 1;
+    skip = head > tail + TRACE_EVENTS ? head - tail - TRACE_EVENTS : 0;
+    if (skip > (uint64_t) n) {
+	skip = n;
+    }
+
+    for (event = events + skip; event < events + n; ++event) {
+	// spans started before the trace are cut
+	start = event->Start > TraceStart ? event->Start - TraceStart : 0;
+	if (event->Duration == TRACE_INSTANT) {
+	    fprintf(file,
+		",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu.%03u,"
+		"\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%lld}}", event->Name,
+		(unsigned long long)start / 1000, (unsigned)(start % 1000), pid,
+		ring->Tid, (long long)event->Arg);
+	    continue;
+	}
+	fprintf(file,
+	    ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu.%03u,"
+	    "\"dur\":%llu.%03u,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%lld}}",
+	    event->Name, (unsigned long long)start / 1000,
+	    (unsigned)(start % 1000),
+	    (unsigned long long)event->Duration / 1000,
+	    (unsigned)(event->Duration % 1000), pid, ring->Tid,
+	    (long long)event->Arg);
+    }
+}
+
+/**
+**	Write all trace rings as chrome trace JSON.
+**
+**	The trace file is rewritten with the newest spans of each thread.
+*/
+void TraceDump(void)
+{
+    TraceEvent *events;
+    TraceRing *ring;
+    FILE *file;
+    int pid;
+    int i;
+
+    if (!TraceEnabled) {
+	return;
+    }
+    if (!(events = malloc(TRACE_EVENTS * sizeof(*events)))) {
+	return;
+    }
+    if (!(file = fopen(TraceFile, "w"))) {
+	fprintf(stderr, "trace: can't write '%s'\n", TraceFile);
+	free(events);
+	return;
+    }
+    pid = getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+	"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+	"\"args\":{\"name\":\"wmdia\"}}", pid);
+    for (i = 0; i < TRACE_THREADS; ++i) {
+	if ((ring = __atomic_load_n(&TraceRings[i], __ATOMIC_ACQUIRE))) {
+	    TraceDumpRing(file, ring, events, pid);
+	}
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file)) {
+	fprintf(stderr, "trace: can't write '%s'\n", TraceFile);
+    }
+    free(events);
+}
+
+/**
+**	Dump the trace on SIGUSR1.
+*/
+static void TraceSignal(void)
+{
+    struct signalfd_siginfo info;
+
+    // signals are merged, one dump for all
+    while (read(TraceFd, &info, sizeof(info)) == sizeof(info)) {
+    }
+    TraceDump();
+}
+
+/**
+**	Setup tracing.
+**
+**	Does nothing without #TraceFile.  Must be called before any thread
+**	is created, all threads inherit the blocked SIGUSR1.
+*/
+void TraceInit(void)
+{
+    sigset_t mask;
+
+    if (!TraceFile) {
+	return;
+    }
+    TraceStart = TraceNow();
+    TraceEnabled = 1;
+    TraceThread("main");
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    if ((TraceFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+	// without signalfd, the trace is only written on exit
+	return;
+    }
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    LoopAddFd(TraceFd, TraceSignal);
+}
+
+/**
+**	Dump and cleanup tracing.
+**
+**	Must be called after all other threads are stopped.
+*/
+void TraceExit(void)
+{
+    int i;
+
+    if (!TraceEnabled) {
+	return;
+    }
+    TraceDump();
+    TraceEnabled = 0;
+    if (TraceFd >= 0) {
+	LoopDelFd(TraceFd);
+	close(TraceFd);
+	TraceFd = -1;
+    }
+    for (i = 0; i < TRACE_THREADS; ++i) {
+	free(TraceRings[i]);
+	TraceRings[i] = NULL;
+    }
+    TraceRingCount = 0;
+    TraceThreadRing = NULL;
+}
@@ -0,0 +1,94 @@
+///
+///	@file trace.h		@brief	Event tracing module header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Trace
+/// @{
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern const char *TraceFile;		///< trace file name, NULL disabled
+extern int TraceEnabled;		///< spans are recorded
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Get trace time in nanoseconds.
+extern uint64_t TraceNow(void);
+
+    /// Record a span or an instant.
+extern void TraceRecord(const char *, uint64_t, uint64_t, int64_t);
+
+    /// Name the trace ring of the calling thread.
+extern void TraceThread(const char *);
+
+    /// Write all trace rings as chrome trace JSON.
+extern void TraceDump(void);
+
+    /// Setup tracing.
+extern void TraceInit(void);
+
+    /// Dump and cleanup tracing.
+extern void TraceExit(void);
+
+/**
+**	Begin a span.
+**
+**	@returns start time of the span, 0 if tracing is disabled.
+*/
+static inline uint64_t TraceBegin(void)
+{
+    return __builtin_expect(TraceEnabled, 0) ? TraceNow() : 0;
+}
+
+/**
+**	End a span.
+**
+**	@param name	name of the span, must be a constant string
+**	@param start	start time from TraceBegin
+**	@param arg	argument shown with the span
+*/
+static inline void TraceEnd(const char *name, uint64_t start, int64_t arg)
+{
+    if (__builtin_expect(start != 0, 0)) {
+	TraceRecord(name, start, TraceNow() - start, arg);
+    }
+}
+
+/**
+**	Record an instant.
+**
+**	@param name	name of the instant, must be a constant string
+**	@param arg	argument shown with the instant
+*/
+static inline void TraceInstant(const char *name, int64_t arg)
+{
+    if (__builtin_expect(TraceEnabled, 0)) {
+	TraceRecord(name, TraceNow(), UINT64_MAX, arg);
+    }
+}
+
+/// @}
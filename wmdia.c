@@ -64,17 +64,19 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/shm.h>
-#include <sys/wait.h>
 
 #include <xcb/xcb.h>
 #define xcb_popcount buggy_xcb_popcount_fixup_1
 #include <xcb/xcbext.h>
 #undef xcb_popcount
 #include <xcb/shape.h>
+#include <xcb/render.h>
 #include <xcb/xcb_event.h>
 #include <xcb/xcb_image.h>
 #include <xcb/xcb_atom.h>
@@ -82,46 +84,182 @@
 #include <xcb/xcb_pixel.h>
 
 #include "wmdia.xpm"
+#include "wmdia_icon.h"
+
+#include "wmdia.h"
+#include "frame.h"
+#include "pixel.h"
+#include "feed.h"
+#include "stream.h"
+#include "scale.h"
+#include "cache.h"
+#include "slide.h"
+#include "launch.h"
+#include "text.h"
+#include "control.h"
+#include "stats.h"
+#include "trace.h"
+#include "present.h"
 
 ////////////////////////////////////////////////////////////////////////////
 
-static xcb_connection_t *Connection;	///< connection to X11 server
-static xcb_screen_t *Screen;		///< our screen
-static xcb_window_t Window;		///< our window
-static xcb_gcontext_t NormalGC;		///< normal graphic context
-static xcb_pixmap_t Pixmap;		///< our background pixmap
+xcb_connection_t *Connection;		///< connection to X11 server
+xcb_screen_t *Screen;			///< our screen
+xcb_gcontext_t NormalGC;		///< normal graphic context
+static xcb_visualtype_t *Visual;	///< visual of our windows
+int NativeRgb;				///< visual pixels are 0x00RRGGBB
+static xcb_pixmap_t Pixmap;		///< icon background of all docks
 static xcb_pixmap_t Image;		///< drawing data
 
-static xcb_atom_t CommandAtom;		///< "COMMAND" property
-static xcb_atom_t TooltipAtom;		///< "TOOLTIP" property
+xcb_atom_t CommandAtom;			///< "COMMAND" property
+xcb_atom_t TooltipAtom;			///< "TOOLTIP" property
+static xcb_atom_t StatsAtom;		///< "WMDIA_STATS" property
+
+static Dock *Docks;			///< our dock windows
+static int DockCount;			///< number of docks
+static int DockAlive;			///< docks not yet destroyed
+static Dock *TooltipDock;		///< dock of the shown tooltip
+    /// options of the command line, defaults of config file docks
+static Dock DockDefault = {
+    .Name = "wmdia",
+    .SlideViewer = "feh",
+    .SlideDelay = 60 * 1000,
+    .SlideFade = 500,
+};
+static char *ConfigData;		///< config file, docks point into
+
+    /// options of a dock, command line and config file
+#define DOCK_OPTIONS "d:e:g:i:p:rs:t:v:FR:S"
+#define CONFIG_ARGS	64		///< max. words of a config line
 
-static int Timeout = -1;		///< timeout in ms
 static int WindowMode;			///< start in window mode
-static const char *Name;		///< window/application name
+static int StartupTiming;		///< print startup timing breakdown
+    /// intern atom requests of COMMAND and TOOLTIP sent by Init
+static xcb_intern_atom_cookie_t AtomCookies[PROPERTY_MAX];
+    /// intern atom request of WMDIA_STATS sent by Init
+static xcb_intern_atom_cookie_t StatsCookie;
 static const char *FontTooltip;		///< font for tooltip
 
 //{@
 ///	Called from event loop
 static void HandleTimeout(void);
-static void ButtonPress(void);
-static void WindowEnter(void);
-static void WindowLeave(void);
-static void PropertyChanged(void);
+static void ButtonPress(Dock *, const xcb_button_press_event_t *);
+static void WindowEnter(Dock *);
+static void WindowLeave(Dock *);
+static void PropertyChanged(Dock *, const xcb_property_notify_event_t *);
+static void PropertyUpdate(void);
+static void WindowConfigure(Dock *, const xcb_configure_notify_event_t *);
+static void WindowMoved(Dock *);
+static void WindowOriginUpdate(void);
+static void DockDestroyed(Dock *);
 
 //@}
 
+static void NewTooltip(void);		///< forward define for PrepareData
 static void DelTooltip(void);		///< forward define for Exit
 static void HideTooltip(void);		///< forward define for expose
 
 //@{
-///	Default font for the tooltip
+///	Default font for the tooltip, fontconfig pattern or core font
 #ifndef FONT
-#define FONT "-misc-fixed-medium-r-normal--20-*-75-75-c-*-iso8859-*"
+#define FONT "sans:pixelsize=14"
+#endif
+    /// core font, if render or fontconfig font is missing
+#ifndef FONT_CORE
+#define FONT_CORE "-misc-fixed-medium-r-normal--20-*-75-75-c-*-iso8859-*"
 #endif
 #define aFONT "7x13"
 #define bFONT "-*-bitstream vera sans-*-*-*-*-17-*-*-*-*-*-*-*"
 //@}
 
+////////////////////////////////////////////////////////////////////////////
+//	Support
+////////////////////////////////////////////////////////////////////////////
+
+/**
+**	Get ticks in ms.
+**
+**	@returns ticks in ms,
+*/
+uint32_t GetMsTicks(void)
+{
+    struct timespec tspec;
+
+    clock_gettime(CLOCK_MONOTONIC, &tspec);
+    return (tspec.tv_sec * 1000) + (tspec.tv_nsec / (1000 * 1000));
+}
+
+/**
+**	Print startup timing step.
+**
+**	@param step	name of the finished step, NULL starts the timing
+*/
+static void StartupTime(const char *step)
+{
+    static struct timespec start;
+    static struct timespec last;
+    struct timespec now;
+
+    if (!StartupTiming) {
+	return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!step) {
+	start = now;
+    } else {
+	printf("startup: %-24s %8.3f ms %8.3f ms\n", step,
+	    (now.tv_sec - last.tv_sec) * 1000.0 + (now.tv_nsec -
+		last.tv_nsec) / 1000000.0,
+	    (now.tv_sec - start.tv_sec) * 1000.0 + (now.tv_nsec -
+		start.tv_nsec) / 1000000.0);
+    }
+    last = now;
+}
+
+/**
+**	Scale 8bit color component to visual mask.
+**
+**	@param c	8bit color component
+**	@param mask	visual color mask
+*/
+static inline uint32_t MaskColor(int c, uint32_t mask)
+{
+    int shift;
+    int bits;
+
+    if (!mask) {
+	return 0;
+    }
+    shift = __builtin_ctz(mask);
+    bits = __builtin_popcount(mask);
+    if (bits < 8) {
+	c >>= 8 - bits;
+    } else {
+	c = (c << (bits - 8)) | (c >> (16 - bits));
+    }
+    return ((uint32_t) c << shift) & mask;
+}
+
+/**
+**	Convert 8bit RGB to pixel of our visual.
+**
+**	@param r	red component
+**	@param g	green component
+**	@param b	blue component
+**
+**	@returns pixel value for true/direct color visuals, black or white
+**	for all other visuals.
+*/
+uint32_t RgbPixel(int r, int g, int b)
+{
+    if (Visual && (Visual->_class == XCB_VISUAL_CLASS_TRUE_COLOR
+	    || Visual->_class == XCB_VISUAL_CLASS_DIRECT_COLOR)) {
+	return MaskColor(r, Visual->red_mask) | MaskColor(g,
+	    Visual->green_mask) | MaskColor(b, Visual->blue_mask);
+    }
+    return r + g + b > 3 * 127 ? Screen->white_pixel : Screen->black_pixel;
+}
+
 ////////////////////////////////////////////////////////////////////////////
 //	XPM Stuff
 ////////////////////////////////////////////////////////////////////////////
@@ -165,9 +303,13 @@ static xcb_image_t *XcbXpm2Image(xcb_connection_t * connection,
     xcb_alloc_color_cookie_t cookies[256];
     int color_to_pixel[256];
     uint32_t pixels[256];
+    uint32_t char_to_pixel[256];
+    uint8_t char_is_none[256];
     xcb_image_t *image;
     int mask_width;
     const char *line;
+    int bpp;
+    int c;
     int x;
     int y;
 
@@ -289,28 +431,54 @@ static xcb_image_t *XcbXpm2Image(xcb_connection_t * connection,
     if (mask) {
 	i = mask_width * h;
 	*mask = malloc(i);
-	if (!mask) {			// malloc failure
+	if (!*mask) {			// malloc failure
 	    mask = NULL;
 	} else {
 	    memset(*mask, 255, i);
 	}
     }
     //
-    //	Copy each pixel from xpm into the image, while creating the mask
+    //	Map xpm color char directly to pixel, unused chars are pixel 0
     //
+    memset(char_to_pixel, 0, sizeof(char_to_pixel));
+    memset(char_is_none, 0, sizeof(char_is_none));
+    for (i = 0; i < colors; i++) {
+	c = data[i - colors][0] & 0xFF;
+	if (color_to_pixel[c] == -1) {
+	    char_to_pixel[c] = transparent;
+	    char_is_none[c] = 1;
+	} else {
+	    char_to_pixel[c] = pixels[color_to_pixel[c]];
+	}
+    }
+
+    //
+    //	Convert row by row into the image, while creating the mask
+    //
+    bpp = 0;				// put_pixel for non host formats
+    if (image->format == XCB_IMAGE_FORMAT_Z_PIXMAP && image->byte_order ==
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	XCB_IMAGE_ORDER_LSB_FIRST
+#else
+	XCB_IMAGE_ORDER_MSB_FIRST
+#endif
+	) {
+	bpp = image->bpp;
+    }
     for (y = 0; y < h; y++) {
 	line = *data++;
-	for (x = 0; x < w; x++) {
-	    i = color_to_pixel[*line++ & 0xFF];
-	    if (i == -1) {		// marks transparent
-		xcb_image_put_pixel(image, x, y, transparent);
-		if (mask) {
-		    (*mask)[(y * mask_width) + (x >> 3)] &= (~(1 << (x & 7)));
-		}
-	    } else {
-		xcb_image_put_pixel(image, x, y, pixels[i]);
+	if (bpp == 32 || bpp == 16 || bpp == 8) {
+	    PixelXpmRow(image->data + y * image->stride, bpp, line,
+		char_to_pixel, w);
+	} else {			// bitmaps and odd formats
+	    for (x = 0; x < w; x++) {
+		xcb_image_put_pixel(image, x, y,
+		    char_to_pixel[line[x] & 0xFF]);
 	    }
 	}
+	if (mask) {
+	    PixelXpmMask(*mask + y * mask_width, line, char_is_none, w);
+	}
     }
     return image;
 }
@@ -340,94 +508,635 @@ static xcb_pixmap_t CreatePixmap(const char *const *data, xcb_pixmap_t * mask)
     }
     if (mask) {
 	*mask =
-	    xcb_create_pixmap_from_bitmap_data(Connection, Window, bitmap,
+	    xcb_create_pixmap_from_bitmap_data(Connection, Screen->root, bitmap,
 	    image->width, image->height, 1, 0, 0, NULL);
 	free(bitmap);
     }
     // now get data from image and build a pixmap...
     pixmap = xcb_generate_id(Connection);
-    xcb_create_pixmap(Connection, Screen->root_depth, pixmap, Window,
+    xcb_create_pixmap(Connection, Screen->root_depth, pixmap, Screen->root,
 	image->width, image->height);
-    xcb_image_put(Connection, pixmap, NormalGC, image, 0, 0, 0);
+    FramePutImage(pixmap, 0, 0, image);
 
     xcb_image_destroy(image);
 
     return pixmap;
 }
 
+/**
+**	Create pixmap of the dock icon.
+**
+**	The icon was converted at build time by xpm2icon.  On true and
+**	direct color visuals the pixels are computed from the visual masks
+**	and uploaded with one put, other visuals use the XPM converter.
+**
+**	@param[out] mask	shape bitmap of the icon
+**
+**	@returns pixmap of the icon.
+*/
+static xcb_pixmap_t CreateIconPixmap(xcb_pixmap_t * mask)
+{
+    uint32_t pixels[ICON_WIDTH * ICON_HEIGHT];
+    xcb_pixmap_t pixmap;
+    uint32_t rgb;
+    uint32_t pixel;
+    int i;
+
+    if (!Visual || (Visual->_class != XCB_VISUAL_CLASS_TRUE_COLOR
+	    && Visual->_class != XCB_VISUAL_CLASS_DIRECT_COLOR)) {
+	return CreatePixmap((void *)wmdia_xpm, mask);
+    }
+
+    *mask =
+	xcb_create_pixmap_from_bitmap_data(Connection, Screen->root,
+	(uint8_t *) IconShape, ICON_WIDTH, ICON_HEIGHT, 1, 0, 0, NULL);
+
+    pixmap = xcb_generate_id(Connection);
+    xcb_create_pixmap(Connection, Screen->root_depth, pixmap, Screen->root,
+	ICON_WIDTH, ICON_HEIGHT);
+    if (NativeRgb) {
+	FramePut(pixmap, 0, 0, ICON_WIDTH, ICON_HEIGHT, IconPixels,
+	    ICON_WIDTH);
+	return pixmap;
+    }
+
+    rgb = ~0U;				// icons have long runs of one color
+    pixel = 0;
+    for (i = 0; i < ICON_WIDTH * ICON_HEIGHT; ++i) {
+	if (IconPixels[i] != rgb) {
+	    rgb = IconPixels[i];
+	    pixel = RgbPixel(rgb >> 16, (rgb >> 8) & 0xFF, rgb & 0xFF);
+	}
+	pixels[i] = pixel;
+    }
+    FramePut(pixmap, 0, 0, ICON_WIDTH, ICON_HEIGHT, pixels, ICON_WIDTH);
+
+    return pixmap;
+}
+
 ////////////////////////////////////////////////////////////////////////////
 
+/**
+**	Upload frame into a dock window, without flush.
+**
+**	With the Present extension the frame is presented from a back
+**	buffer.  Otherwise it is uploaded into the background pixmap of the
+**	dock, which replaces any background set by others.  Docks share the
+**	icon pixmap, until they show their first frame.
+**
+**	While the pixmap stays the background, only the changed 8x8 tiles
+**	are uploaded and cleared, an unchanged frame sends nothing.
+**
+**	@param dock	dock window
+**	@param pixels	#DOCK_SIZE x #DOCK_SIZE native 32bit pixels
+**	@param stride	pixels per line
+*/
+void PutFrame(Dock * dock, const uint32_t * pixels, int stride)
+{
+    xcb_rectangle_t rects[FRAME_RECTS_MAX];
+    xcb_rectangle_t *r;
+    uint64_t dirty;
+    uint64_t start;
+    uint64_t trace;
+    int n;
+    int y;
+
+    if (!dock->Window) {		// destroyed
+	return;
+    }
+    start = StatsMicros();
+    trace = TraceBegin();
+    if (PresentFrame(dock, pixels, stride)) {
+	StatsTime(StatsFrameTime, start);
+	TraceEnd("frame", trace, 0);
+	return;
+    }
+    if (!dock->Pixmap) {
+	dock->Pixmap = xcb_generate_id(Connection);
+	xcb_create_pixmap(Connection, Screen->root_depth, dock->Pixmap,
+	    Screen->root, DOCK_SIZE, DOCK_SIZE);
+	dock->Shown = malloc(DOCK_SIZE * DOCK_SIZE * sizeof(*dock->Shown));
+	dock->FrameBackground = 0;
+    }
+    if (!dock->FrameBackground || !dock->Shown) {
+	rects[0].x = 0;
+	rects[0].y = 0;
+	rects[0].width = DOCK_SIZE;
+	rects[0].height = DOCK_SIZE;
+	n = 1;
+	xcb_change_window_attributes(Connection, dock->Window,
+	    XCB_CW_BACK_PIXMAP, &dock->Pixmap);
+	dock->FrameBackground = 1;
+    } else if (!(dirty = FrameDiff(dock->Shown, pixels, stride))) {
+	StatsAdd(StatsFramesUnchanged, 1);
+	StatsTime(StatsFrameTime, start);
+	TraceEnd("frame", trace, 0);
+	return;				// unchanged
+    } else {
+	n = FrameDirtyRects(dirty, rects);
+    }
+
+    for (r = rects; r < rects + n; ++r) {
+	FramePut(dock->Pixmap, r->x, r->y, r->width, r->height,
+	    pixels + r->y * stride + r->x, stride);
+	if (dock->Shown) {
+	    for (y = r->y; y < r->y + r->height; ++y) {
+		memcpy(dock->Shown + y * DOCK_SIZE + r->x,
+		    pixels + y * stride + r->x, r->width * sizeof(*pixels));
+	    }
+	}
+	xcb_clear_area(Connection, 0, dock->Window, r->x, r->y, r->width,
+	    r->height);
+    }
+    StatsAdd(StatsFramesShown, 1);
+    StatsTime(StatsFrameTime, start);
+    TraceEnd("frame", trace, n);
+}
+
+/**
+**	Show frame in a dock window.
+**
+**	@param dock	dock window
+**	@param pixels	#DOCK_SIZE x #DOCK_SIZE native 32bit pixels
+**	@param stride	pixels per line
+*/
+void ShowFrame(Dock * dock, const uint32_t * pixels, int stride)
+{
+    uint64_t trace;
+
+    PutFrame(dock, pixels, stride);
+    trace = TraceBegin();
+    xcb_flush(Connection);
+    TraceEnd("flush", trace, 0);
+}
+
+/**
+**	Find dock of a window.
+**
+**	@param window	window of an event
+**
+**	@returns dock of the window, NULL if not one of our docks.
+*/
+static Dock *DockOfWindow(xcb_window_t window)
+{
+    int i;
+
+    for (i = 0; i < DockCount; ++i) {
+	if (Docks[i].Window == window) {
+	    return Docks + i;
+	}
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------------
+//	Event loop
+//----------------------------------------------------------------------------
+
+#define LOOP_SOURCES	32		///< initial polled file descriptors
+#define LOOP_TIMERS	8		///< max. pending timers
+
+static struct pollfd *LoopFds;		///< polled file descriptors
+static void (**LoopHandler) (void);	///< fd ready handler
+static int LoopSources;			///< used entries in LoopFds
+static int LoopAlloc;			///< allocated entries of LoopFds
+
+///
+///	Timer of the event loop.
+///
+typedef struct _loop_timer_
+{
+    uint32_t Tick;			///< expire at this tick
+    void (*Handler) (void);		///< timeout handler, NULL free
+} LoopTimer;
+
+static LoopTimer LoopTimers[LOOP_TIMERS];	///< pending timers
+static char LoopQuit;			///< flag leave event loop
+
+/**
+**	Add file descriptor to event loop.
+**
+**	The table grows, many docks have many sources.  Can be called from
+**	the handlers.
+**
+**	@param fd	file descriptor to poll for input
+**	@param handler	called, when fd is readable or has an error
+**
+**	@returns -1 if out of memory, 0 otherwise.
+*/
+int LoopAddFd(int fd, void (*handler) (void))
+{
+    struct pollfd *fds;
+    void (**handlers) (void);
+    int alloc;
+    int i;
+
+    for (i = 0; i < LoopSources && LoopHandler[i]; ++i) {
+    }
+    if (i == LoopAlloc) {
+	alloc = LoopAlloc ? LoopAlloc * 2 : LOOP_SOURCES;
+	if (!(fds = realloc(LoopFds, alloc * sizeof(*fds)))) {
+	    fprintf(stderr, "loop: too many sources\n");
+	    return -1;
+	}
+	LoopFds = fds;
+	if (!(handlers = realloc(LoopHandler, alloc * sizeof(*handlers)))) {
+	    fprintf(stderr, "loop: too many sources\n");
+	    return -1;
+	}
+	LoopHandler = handlers;
+	LoopAlloc = alloc;
+    }
+    LoopFds[i].fd = fd;
+    LoopFds[i].events = POLLIN | POLLPRI;
+    LoopFds[i].revents = 0;
+    LoopHandler[i] = handler;
+    if (i == LoopSources) {
+	LoopSources++;
+    }
+    return 0;
+}
+
+/**
+**	Remove file descriptor from event loop.
+**
+**	Can be called from the handlers.
+**
+**	@param fd	file descriptor added with LoopAddFd
+*/
+void LoopDelFd(int fd)
+{
+    int i;
+
+    for (i = 0; i < LoopSources; ++i) {
+	if (LoopHandler[i] && LoopFds[i].fd == fd) {
+	    LoopFds[i].fd = -1;		// negative fd is ignored by poll
+	    LoopHandler[i] = NULL;
+	}
+    }
+}
+
+/**
+**	Set or move timer.
+**
+**	Each handler has only one timer.
+**
+**	@param handler	called, when tick is reached
+**	@param tick	expire tick, see GetMsTicks
+*/
+void LoopSetTimer(void (*handler) (void), uint32_t tick)
+{
+    int i;
+    int j;
+
+    j = -1;
+    for (i = 0; i < LOOP_TIMERS; ++i) {
+	if (LoopTimers[i].Handler == handler) {
+	    j = i;
+	    break;
+	}
+	if (j < 0 && !LoopTimers[i].Handler) {
+	    j = i;
+	}
+    }
+    if (j < 0) {
+	fprintf(stderr, "loop: too many timers\n");
+	abort();
+    }
+    LoopTimers[j].Tick = tick;
+    LoopTimers[j].Handler = handler;
+}
+
+/**
+**	Cancel timer.
+**
+**	@param handler	timer handler of LoopSetTimer
+*/
+void LoopDelTimer(void (*handler) (void))
+{
+    int i;
+
+    for (i = 0; i < LOOP_TIMERS; ++i) {
+	if (LoopTimers[i].Handler == handler) {
+	    LoopTimers[i].Handler = NULL;
+	}
+    }
+}
+
+/**
+**	Milliseconds until the next timeout.
+**
+**	@returns -1 if no timer is pending.
+*/
+static int LoopTimeout(void)
+{
+    uint32_t now;
+    int timeout;
+    int i;
+    int t;
+
+    now = GetMsTicks();
+    timeout = -1;
+    for (i = 0; i < LOOP_TIMERS; ++i) {
+	if (LoopTimers[i].Handler) {
+	    t = LoopTimers[i].Tick - now;
+	    if (t < 0) {
+		t = 0;
+	    }
+	    if (timeout < 0 || t < timeout) {
+		timeout = t;
+	    }
+	}
+    }
+    return timeout;
+}
+
+/**
+**	Call the handlers of all expired timers.
+*/
+static void LoopRunTimers(void)
+{
+    void (*handler) (void);
+    uint32_t now;
+    int i;
+
+    now = GetMsTicks();
+    for (i = 0; i < LOOP_TIMERS; ++i) {
+	handler = LoopTimers[i].Handler;
+	if (handler && (int32_t) (LoopTimers[i].Tick - now) <= 0) {
+	    LoopTimers[i].Handler = NULL;	// handler can rearm
+	    handler();
+	}
+    }
+}
+
+/**
+**	Handle X11 event.
+**
+**	The handling time is recorded per event type in the statistics and
+**	traced as span named by the event type.
+**
+**	@param event	X11 event
+*/
+static void HandleEvent(xcb_generic_event_t * event)
+{
+    Dock *dock;
+    const char *name;
+    uint64_t start;
+    uint64_t trace;
+
+    start = StatsMicros();
+    trace = TraceBegin();
+    switch (XCB_EVENT_RESPONSE_TYPE(event)) {
+	case XCB_EXPOSE:
+	    dock = DockOfWindow(((xcb_expose_event_t *) event)->window);
+	    if (dock) {
+		PresentExpose(dock, (xcb_expose_event_t *) event);
+	    }
+	    // collapse multi expose
+	    if (!((xcb_expose_event_t *) event)->count) {
+		// FIXME: redraw the tooltip
+		HideTooltip();
+
+		//xcb_clear_area(Connection, 0, Window, 0, 0, 64, 64);
+		// flush the request
+		//xcb_flush(Connection);
+	    }
+	    break;
+	case XCB_ENTER_NOTIFY:
+	    dock = DockOfWindow(((xcb_enter_notify_event_t *) event)->event);
+	    if (dock) {
+		// pointer position gives our position for free
+		dock->X = ((xcb_enter_notify_event_t *) event)->root_x
+		    - ((xcb_enter_notify_event_t *) event)->event_x;
+		dock->Y = ((xcb_enter_notify_event_t *) event)->root_y
+		    - ((xcb_enter_notify_event_t *) event)->event_y;
+		WindowEnter(dock);
+	    }
+	    break;
+	case XCB_LEAVE_NOTIFY:
+	    dock = DockOfWindow(((xcb_leave_notify_event_t *) event)->event);
+	    if (dock) {
+		WindowLeave(dock);
+	    }
+	    break;
+	case XCB_BUTTON_PRESS:
+	    dock = DockOfWindow(((xcb_button_press_event_t *) event)->event);
+	    if (!dock) {		// click on tooltip
+		dock = TooltipDock;
+	    }
+	    if (dock) {
+		ButtonPress(dock, (xcb_button_press_event_t *) event);
+	    }
+	    break;
+	case XCB_PROPERTY_NOTIFY:
+	    dock =
+		DockOfWindow(((xcb_property_notify_event_t *) event)->window);
+	    if (dock) {
+		PropertyChanged(dock, (xcb_property_notify_event_t *) event);
+	    }
+	    break;
+	case XCB_CONFIGURE_NOTIFY:
+	    dock =
+		DockOfWindow(((xcb_configure_notify_event_t *) event)->window);
+	    if (dock) {
+		WindowConfigure(dock, (xcb_configure_notify_event_t *) event);
+	    }
+	    break;
+	case XCB_REPARENT_NOTIFY:
+	    dock =
+		DockOfWindow(((xcb_reparent_notify_event_t *) event)->window);
+	    if (dock) {
+		WindowMoved(dock);
+	    }
+	    break;
+	case XCB_MAP_NOTIFY:
+	case XCB_UNMAP_NOTIFY:
+	case XCB_GRAVITY_NOTIFY:
+	case XCB_CIRCULATE_NOTIFY:
+	    break;
+	case XCB_DESTROY_NOTIFY:
+	    // dock closed, exit application with the last one
+	    dock = DockOfWindow(((xcb_destroy_notify_event_t *) event)->window);
+	    if (dock && dock->Window) {
+		DockDestroyed(dock);
+	    }
+	    break;
+	default:
+	    if (FrameEvent(event) || PresentEvent(event)) {
+		break;
+	    }
+	    // Unknown event type, ignore it
+	    StatsAdd(StatsEventsUnknown, 1);
+	    break;
+    }
+    StatsEvent(XCB_EVENT_RESPONSE_TYPE(event), start);
+    if (trace) {
+	name = StatsEventName(XCB_EVENT_RESPONSE_TYPE(event));
+	TraceEnd(name ? name : "ExtensionEvent", trace,
+	    XCB_EVENT_RESPONSE_TYPE(event));
+    }
+}
+
+/**
+**	Handle all X11 events.
+*/
+static void HandleEvents(void)
+{
+    xcb_generic_event_t *event;
+
+    while ((event = xcb_poll_for_event(Connection))) {
+	HandleEvent(event);
+	free(event);
+    }
+    // No event, can happen, but we must check for close
+    if (xcb_connection_has_error(Connection)) {
+	LoopQuit = 1;
+    }
+}
+
 /**
 **	Loop
+**
+**	Polls the X11 connection and all added sources and runs the timers.
+**	The X11 connection is the first source, so X11 events are always
+**	handled before any stream or feed data.  The work of each wakeup is
+**	recorded in the statistics.
 */
 static void Loop(void)
 {
-    struct pollfd fds[1];
     xcb_generic_event_t *event;
+    uint64_t start;
+    uint64_t trace;
     int n;
+    int i;
 
-    fds[0].fd = xcb_get_file_descriptor(Connection);
-    fds[0].events = POLLIN | POLLPRI;
-
-    for (;;) {
-	n = poll(fds, 1, Timeout);
+    while (!LoopQuit) {
+	// events queued by replies of the last round, wouldn't wake poll
+	if ((event = xcb_poll_for_queued_event(Connection))) {
+	    HandleEvent(event);
+	    free(event);
+	    continue;
+	}
+	// event queue drained, refresh changed properties once
+	PropertyUpdate();
+	WindowOriginUpdate();
+	n = poll(LoopFds, LoopSources, LoopTimeout());
 	if (n < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
 	    return;
 	}
-	if (n) {
-	    if (fds[0].revents & (POLLIN | POLLPRI)) {
-		while ((event = xcb_poll_for_event(Connection))) {
-
-		    switch (XCB_EVENT_RESPONSE_TYPE(event)) {
-			case XCB_EXPOSE:
-			    // collapse multi expose
-			    if (!((xcb_expose_event_t *) event)->count) {
-				// FIXME: redraw the tooltip
-				HideTooltip();
-
-				//xcb_clear_area(Connection, 0, Window, 0, 0, 64, 64);
-				// flush the request
-				//xcb_flush(Connection);
-			    }
-			    break;
-			case XCB_ENTER_NOTIFY:
-			    WindowEnter();
-			    break;
-			case XCB_LEAVE_NOTIFY:
-			    WindowLeave();
-			    break;
-			case XCB_BUTTON_PRESS:
-			    ButtonPress();
-			    break;
-			case XCB_PROPERTY_NOTIFY:
-			    PropertyChanged();
-			    break;
-			case XCB_DESTROY_NOTIFY:
-			    // window closed, exit application
-			    return;
-			default:
-			    // Unknown event type, ignore it
-			    printf("unknown event type %d\n",
-				XCB_EVENT_RESPONSE_TYPE(event));
-			    break;
-		    }
-
-		    free(event);
-		}
-		// No event, can happen, but we must check for close
-		if (xcb_connection_has_error(Connection)) {
+	start = StatsMicros();
+	trace = TraceBegin();
+	for (i = 0; n && i < LoopSources; ++i) {
+	    if (LoopFds[i].revents && LoopHandler[i]) {
+		LoopFds[i].revents = 0;
+		LoopHandler[i] ();
+		if (LoopQuit) {
 		    return;
 		}
 	    }
-	} else {
-	    HandleTimeout();
 	}
+	LoopRunTimers();
+	StatsTime(StatsLoopTime, start);
+	TraceEnd("loop", trace, n);
     }
 }
 
+/**
+**	Setup dock properties.
+**
+**	@param dock	dock with options
+*/
+static void DockSetup(Dock * dock)
+{
+    int i;
+
+    memset(dock->Properties, 0, sizeof(dock->Properties));
+    dock->Properties[PROPERTY_COMMAND].Atom = &CommandAtom;
+    dock->Properties[PROPERTY_TOOLTIP].Atom = &TooltipAtom;
+    for (i = 0; i < PROPERTY_MAX; ++i) {
+	dock->Properties[i].Dirty = 1;
+    }
+}
+
+/**
+**	Create dock window.
+**
+**	@param connection	connection to X11 server
+**	@param screen		our screen
+**	@param pixmap		initial background of the window
+**	@param dock		dock with generated window id
+**	@param leader		window of the first dock, group leader
+*/
+static void DockCreate(xcb_connection_t * connection, xcb_screen_t * screen,
+    xcb_pixmap_t pixmap, Dock * dock, xcb_window_t leader)
+{
+    uint32_t mask;
+    uint32_t values[2];
+    xcb_size_hints_t size_hints;
+    xcb_icccm_wm_hints_t wm_hints;
+    int i;
+    char *buf;
+
+    mask = XCB_CW_BACK_PIXMAP | XCB_CW_EVENT_MASK;
+    values[0] = pixmap;
+    values[1] =
+	XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_BUTTON_PRESS |
+	XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_LEAVE_WINDOW |
+	XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+
+    xcb_create_window(connection,	// Connection
+	XCB_COPY_FROM_PARENT,		// depth (same as root)
+	dock->Window,			// window Id
+	screen->root,			// parent window
+	0, 0,				// x, y
+	64, 64,				// width, height
+	0,				// border_width
+	XCB_WINDOW_CLASS_INPUT_OUTPUT,	// class
+	screen->root_visual,		// visual
+	mask, values);			// mask, values
+
+    // XSetWMNormalHints
+    size_hints.flags = 0;		// FIXME: bad lib design
+    xcb_icccm_size_hints_set_position(&size_hints, 1, 0, 0);
+    xcb_icccm_size_hints_set_size(&size_hints, 1, 64, 64);
+    xcb_icccm_set_wm_normal_hints(connection, dock->Window, &size_hints);
+
+    i = strlen(dock->Name);
+    buf = alloca(i + sizeof("wmdia") + 2);
+    strncpy(buf, dock->Name, i + 1);
+    strcpy(buf + i + 1, "wmdia");
+    xcb_icccm_set_wm_class(connection, dock->Window,
+	i + 1 + sizeof("wmdia"), buf);
+
+    xcb_icccm_set_wm_name(connection, dock->Window, XCB_ATOM_STRING, 8, i,
+	dock->Name);
+    xcb_icccm_set_wm_icon_name(connection, dock->Window, XCB_ATOM_STRING, 8,
+	i, dock->Name);
+
+    // XSetWMHints
+    wm_hints.flags = 0;
+    xcb_icccm_wm_hints_set_icon_pixmap(&wm_hints, pixmap);
+    xcb_icccm_wm_hints_set_window_group(&wm_hints, leader);
+    xcb_icccm_wm_hints_set_withdrawn(&wm_hints);
+    if (WindowMode) {
+	xcb_icccm_wm_hints_set_none(&wm_hints);
+    }
+    xcb_icccm_set_wm_hints(connection, dock->Window, &wm_hints);
+
+    xcb_map_window(connection, dock->Window);
+}
+
 /**
 **	Init the application.
 **
+**	No reply is waited for, until all dock windows are mapped.
+**	Requests needed later (atoms, extension data) are sent with the
+**	maps, their replies are collected by PrepareData and FrameInit.
+**
 **	@param argc	number of arguments
 **	@param argv	arguments vector
 */
@@ -436,19 +1145,16 @@ static int Init(int argc, char *const argv[])
     const char *display_name;
     xcb_connection_t *connection;
     xcb_screen_iterator_t iter;
+    xcb_depth_iterator_t depth_iter;
     int screen_nr;
     xcb_screen_t *screen;
     xcb_gcontext_t normal;
     uint32_t mask;
     uint32_t values[3];
     xcb_pixmap_t pixmap;
-    xcb_window_t window;
-    xcb_size_hints_t size_hints;
-    xcb_icccm_wm_hints_t wm_hints;
     int i;
     int n;
     char *s;
-    char *buf;
 
     display_name = getenv("DISPLAY");
 
@@ -459,6 +1165,23 @@ static int Init(int argc, char *const argv[])
 	fprintf(stderr, "Can't connect to X11 server on %s\n", display_name);
 	return -1;
     }
+    Connection = connection;
+    StartupTime("connect");
+
+    //	Send requests, whose replies are needed after the map
+    AtomCookies[PROPERTY_COMMAND] =
+	xcb_intern_atom_unchecked(connection, 0, sizeof("COMMAND") - 1,
+	"COMMAND");
+    AtomCookies[PROPERTY_TOOLTIP] =
+	xcb_intern_atom_unchecked(connection, 0, sizeof("TOOLTIP") - 1,
+	"TOOLTIP");
+    StatsCookie =
+	xcb_intern_atom_unchecked(connection, 0, sizeof("WMDIA_STATS") - 1,
+	"WMDIA_STATS");
+    FramePrefetch();
+    PresentPrefetch();
+    // render draws the tooltip text and crossfades the slides
+    xcb_prefetch_extension_data(connection, &xcb_render_id);
     //	Get the requested screen number
     iter = xcb_setup_roots_iterator(xcb_get_setup(connection));
     for (i = 0; i < screen_nr; ++i) {
@@ -466,6 +1189,19 @@ static int Init(int argc, char *const argv[])
     }
     screen = iter.data;
 
+    //	Find the visual of the root window, needed to convert RGB to pixels
+    for (depth_iter = xcb_screen_allowed_depths_iterator(screen);
+	depth_iter.rem; xcb_depth_next(&depth_iter)) {
+	xcb_visualtype_iterator_t visual_iter;
+
+	visual_iter = xcb_depth_visuals_iterator(depth_iter.data);
+	for (; visual_iter.rem; xcb_visualtype_next(&visual_iter)) {
+	    if (visual_iter.data->visual_id == screen->root_visual) {
+		Visual = visual_iter.data;
+	    }
+	}
+    }
+
     //	Create normal graphic context
     normal = xcb_generate_id(connection);
     mask = XCB_GC_FOREGROUND | XCB_GC_BACKGROUND | XCB_GC_GRAPHICS_EXPOSURES;
@@ -474,57 +1210,12 @@ static int Init(int argc, char *const argv[])
     values[2] = 0;
     xcb_create_gc(connection, normal, screen->root, mask, values);
 
+    //	Shared background of all docks, until the icon is uploaded
     pixmap = xcb_generate_id(connection);
     xcb_create_pixmap(connection, screen->root_depth, pixmap, screen->root, 64,
 	64);
 
-    //	Create the window
-    window = xcb_generate_id(connection);
-
-    mask = XCB_CW_BACK_PIXMAP | XCB_CW_EVENT_MASK;
-    values[0] = pixmap;
-    values[1] =
-	XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_BUTTON_PRESS |
-	XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_LEAVE_WINDOW |
-	XCB_EVENT_MASK_PROPERTY_CHANGE;
-
-    xcb_create_window(connection,	// Connection
-	XCB_COPY_FROM_PARENT,		// depth (same as root)
-	window,				// window Id
-	screen->root,			// parent window
-	0, 0,				// x, y
-	64, 64,				// width, height
-	0,				// border_width
-	XCB_WINDOW_CLASS_INPUT_OUTPUT,	// class
-	screen->root_visual,		// visual
-	mask, values);			// mask, values
-
-    // XSetWMNormalHints
-    size_hints.flags = 0;		// FIXME: bad lib design
-    xcb_icccm_size_hints_set_position(&size_hints, 1, 0, 0);
-    xcb_icccm_size_hints_set_size(&size_hints, 1, 64, 64);
-    xcb_icccm_set_wm_normal_hints(connection, window, &size_hints);
-
-    i = strlen(Name);
-    buf = alloca(i + sizeof("wmdia") + 2);
-    strncpy(buf, Name, i + 1);
-    strcpy(buf + i + 1, "wmdia");
-    xcb_icccm_set_wm_class(connection, window, i + 1 + sizeof("wmdia"), buf);
-
-    xcb_icccm_set_wm_name(connection, window, XCB_ATOM_STRING, 8, i, Name);
-    xcb_icccm_set_wm_icon_name(connection, window, XCB_ATOM_STRING, 8, i, Name);
-
-    // XSetWMHints
-    wm_hints.flags = 0;
-    xcb_icccm_wm_hints_set_icon_pixmap(&wm_hints, pixmap);
-    xcb_icccm_wm_hints_set_window_group(&wm_hints, window);
-    xcb_icccm_wm_hints_set_withdrawn(&wm_hints);
-    if (WindowMode) {
-	xcb_icccm_wm_hints_set_none(&wm_hints);
-    }
-    xcb_icccm_set_wm_hints(connection, window, &wm_hints);
-
-    // XSetCommand (see xlib source)
+    //	XSetCommand (see xlib source), the group leader restarts us
     for (n = i = 0; i < argc; ++i) {	// length of string prop
 	n += strlen(argv[i]) + 1;
     }
@@ -533,21 +1224,39 @@ static int Init(int argc, char *const argv[])
 	strcpy(s + n, argv[i]);
 	n += strlen(s + n) + 1;
     }
-    xcb_change_property(connection, XCB_PROP_MODE_REPLACE, window,
-    	XCB_ATOM_WM_COMMAND, XCB_ATOM_STRING, 8, n, s);
 
-    //	Map the window on the screen
-    xcb_map_window(connection, window);
+    //	Create and map the windows
+    for (i = 0; i < DockCount; ++i) {
+	Docks[i].Window = xcb_generate_id(connection);
+    }
+    for (i = 0; i < DockCount; ++i) {
+	DockCreate(connection, screen, pixmap, Docks + i, Docks[0].Window);
+    }
+    xcb_change_property(connection, XCB_PROP_MODE_REPLACE, Docks[0].Window,
+	XCB_ATOM_WM_COMMAND, XCB_ATOM_STRING, 8, n, s);
+    DockAlive = DockCount;
 
     //	Make sure commands are sent
     xcb_flush(connection);
+    StartupTime("requests sent, mapped");
 
-    Connection = connection;
     Screen = screen;
-    Window = window;
     NormalGC = normal;
     Pixmap = pixmap;
 
+    // BGRX 0x00RRGGBB is the native format of the common 24bit visual
+    NativeRgb = RgbPixel(0x12, 0x34, 0x56) == 0x123456
+	&& RgbPixel(0xFF, 0xFF, 0xFF) == 0xFFFFFF;
+
+    LoopAddFd(xcb_get_file_descriptor(connection), HandleEvents);
+    FrameInit();
+    PresentInit();
+    StartupTime("frame upload setup");
+    ScaleInit();
+    LaunchInit();
+    StatsInit();
+    TraceInit();
+
     return 0;
 }
 
@@ -556,10 +1265,37 @@ static int Init(int argc, char *const argv[])
 */
 static void Exit(void)
 {
+    int i;
+    int n;
+
+    SlideExit();
+    StreamExit();
+    FeedExit();
+    ControlExit();
+    LaunchExit();
     DelTooltip();
+    FrameExit();
+    TraceExit();
 
-    xcb_destroy_window(Connection, Window);
-    Window = 0;
+    for (i = 0; i < DockCount; ++i) {
+	if (Docks[i].Window) {
+	    xcb_destroy_window(Connection, Docks[i].Window);
+	    Docks[i].Window = 0;
+	}
+	if (Docks[i].Pixmap) {
+	    xcb_free_pixmap(Connection, Docks[i].Pixmap);
+	}
+	PresentClose(Docks + i);
+	free(Docks[i].Shown);
+	for (n = 0; n < PROPERTY_MAX; ++n) {
+	    free(Docks[i].Properties[n].Value);
+	}
+    }
+    free(Docks);
+    Docks = NULL;
+    DockCount = 0;
+    free(ConfigData);
+    ConfigData = NULL;
 
     xcb_free_gc(Connection, NormalGC);
 
@@ -576,38 +1312,6 @@ static void Exit(void)
 //	App Stuff
 ////////////////////////////////////////////////////////////////////////////
 
-/**
-**	Execute command without waiting.
-*/
-static int System(char *cmd)
-{
-    int pid;
-    int status;
-    extern char **environ;
-
-    if (!cmd) {				// No command
-	return 1;
-    }
-    if ((pid = fork()) == -1) {		// fork failed
-	return -1;
-    }
-    if (!pid) {				// child
-	if (!(pid = fork())) {		// child of child
-	    char *argv[4];
-
-	    argv[0] = "sh";
-	    argv[1] = "-c";
-	    argv[2] = cmd;
-	    argv[3] = 0;
-	    execve("/bin/sh", argv, environ);
-	    exit(0);
-	}
-	exit(0);
-    }
-    wait(&status);			// wait for first child
-    return 0;
-}
-
 // ------------------------------------------------------------------------- //
 //	Tooltip
 
@@ -615,96 +1319,198 @@ xcb_window_t Tooltip;			///< tooltip window
 xcb_font_t Font;			///< tooltip font
 xcb_gcontext_t FontGC;			///< font graphic context
 int TooltipShown;			///< flag tooltip is shown
+#define TOOLTIP_IDLE	500		///< ms after startup to prepare tooltip
+static xcb_render_picture_t TooltipPicture;	///< render picture of tooltip
+
+static int FontAscent;			///< tooltip font ascent
+static int FontDescent;			///< tooltip font descent
+static int16_t FontWidth[256];		///< width of each 8bit character
 
 /**
-**	Get origin of window.
+**	Dock window was moved or reparented.
+**
+**	Requests the absolute position of the window, the reply is taken
+**	by WindowOriginUpdate without waiting.
 **
-**	@param window	get origin of this window
-**	@param[out] x	absolute X position of the window
-**	@param[out] y	absolute Y position of the window
+**	@param dock	moved dock
 */
-static void WindowOrigin(xcb_window_t window, int *x, int *y)
+static void WindowMoved(Dock * dock)
 {
-    xcb_window_t parent;
-    xcb_generic_error_t *error;
-    xcb_get_geometry_reply_t *geom;
-    xcb_query_tree_reply_t *tree;
-    xcb_translate_coordinates_reply_t *trans;
-    int rx;
-    int ry;
-
-    // geometry of the window relative to parent
-    geom =
-	xcb_get_geometry_reply(Connection,
-	xcb_get_geometry_unchecked(Connection, window), NULL);
-    if (!geom) {
-	fprintf(stderr, "xcb_get_geometry() failed\n");
+    if (dock->OriginPending) {		// request again after the reply
+	dock->OriginDirty = 1;
 	return;
     }
-    rx = geom->x;
-    ry = geom->y;
-    free(geom);
+    dock->OriginCookie =
+	xcb_translate_coordinates_unchecked(Connection, dock->Window,
+	Screen->root, 0, 0);
+    dock->OriginPending = 1;
+    xcb_flush(Connection);
+}
 
-    // get the parent of the window
-    tree =
-	xcb_query_tree_reply(Connection, xcb_query_tree(Connection, window),
-	&error);
-    if (!tree || error) {
-	fprintf(stderr, "xcb_query_tree() failed\n");
-	return;
-    }
+/**
+**	Take absolute positions of the dock windows, if received.
+*/
+static void WindowOriginUpdate(void)
+{
+    xcb_translate_coordinates_reply_t *reply;
+    xcb_generic_error_t *error;
+    Dock *dock;
 
-    parent = tree->parent;
-    free(tree);
+    for (dock = Docks; dock < Docks + DockCount; ++dock) {
+	if (!dock->OriginPending) {
+	    continue;
+	}
+	reply = NULL;
+	error = NULL;
+	if (!xcb_poll_for_reply(Connection, dock->OriginCookie.sequence,
+		(void **)&reply, &error)) {
+	    continue;			// not yet received
+	}
+	dock->OriginPending = 0;
+	if (reply) {
+	    dock->X = reply->dst_x;
+	    dock->Y = reply->dst_y;
+	    free(reply);
+	}
+	free(error);
+	if (dock->OriginDirty) {
+	    dock->OriginDirty = 0;
+	    WindowMoved(dock);
+	}
+    }
+}
 
-    // translated coordinates 
-    trans =
-	xcb_translate_coordinates_reply(Connection,
-	xcb_translate_coordinates_unchecked(Connection, parent, Screen->root,
-	    rx, ry), NULL);
-    if (!trans) {
-	fprintf(stderr, "xcb_translate_coordinates() failed\n");
+/**
+**	Window configure notify.
+**
+**	A synthetic event of the window manager contains the absolute
+**	position (ICCCM 4.1.5), otherwise it is relative to the parent.
+**
+**	@param dock	dock of the window
+**	@param event	configure notify event
+*/
+static void WindowConfigure(Dock * dock,
+    const xcb_configure_notify_event_t * event)
+{
+    if (event->response_type & 0x80) {
+	dock->X = event->x;
+	dock->Y = event->y;
 	return;
     }
+    WindowMoved(dock);
+}
 
-    rx = trans->dst_x;
-    ry = trans->dst_y;
-    free(trans);
+/**
+**	Load font metrics.
+**
+**	The widths of all 8bit characters are kept, so text extents are
+**	calculated without asking the server.
+**
+**	@param cookie	query font request sent with the open font
+*/
+static void FontMetrics(xcb_query_font_cookie_t cookie)
+{
+    xcb_query_font_reply_t *reply;
+    xcb_charinfo_t *infos;
+    int n;
+    int c;
+    int w;
 
-    if (x) {
-	*x = rx;
+    reply = xcb_query_font_reply(Connection, cookie, NULL);
+    if (!reply) {
+	fprintf(stderr, "Can't query font\n");
+	return;
+    }
+    FontAscent = reply->font_ascent;
+    FontDescent = reply->font_descent;
+
+    infos = xcb_query_font_char_infos(reply);
+    n = xcb_query_font_char_infos_length(reply);
+    for (c = 0; c < 256; ++c) {
+	w = reply->max_bounds.character_width;
+	if (n) {			// per character metrics
+	    w = 0;
+	    // only row 0 of matrix fonts, poly text 8 uses byte1 = 0
+	    if (!reply->min_byte1 && c >= reply->min_char_or_byte2
+		&& c <= reply->max_char_or_byte2
+		&& c - reply->min_char_or_byte2 < n) {
+		w = infos[c - reply->min_char_or_byte2].character_width;
+	    }
+	}
+	FontWidth[c] = w;
     }
-    if (y) {
-	*y = ry;
+    // undefined characters are drawn as default char
+    if (reply->default_char < 256) {
+	w = FontWidth[reply->default_char];
+	for (c = 0; c < 256; ++c) {
+	    if (!FontWidth[c]) {
+		FontWidth[c] = w;
+	    }
+	}
     }
+
+    free(reply);
 }
 
 /**
 **	Create new tooltip.
+**
+**	Called at idle after startup or on first hover.  All requests are
+**	sent before the first reply is needed, true color visuals need no
+**	color allocation.
 */
 static void NewTooltip(void)
 {
     xcb_window_t window;
     xcb_font_t font;
+    xcb_alloc_color_cookie_t color_cookie;
     xcb_alloc_color_reply_t *alloc_color;
+    xcb_void_cookie_t font_cookie;
+    xcb_query_font_cookie_t query_cookie;
     xcb_generic_error_t *error;
     uint32_t mask;
     uint32_t values[5];
 
+    if (Tooltip) {			// already prepared
+	return;
+    }
+    LoopDelTimer(NewTooltip);
+
     //
     //	allocate YELLOW pixel.
     //
-    alloc_color =
-	xcb_alloc_color_reply(Connection, xcb_alloc_color(Connection,
-	    Screen->default_colormap, 0xD000, 0xD000, 0), NULL);
+    color_cookie.sequence = 0;
+    if (!Visual || (Visual->_class != XCB_VISUAL_CLASS_TRUE_COLOR
+	    && Visual->_class != XCB_VISUAL_CLASS_DIRECT_COLOR)) {
+	color_cookie =
+	    xcb_alloc_color(Connection, Screen->default_colormap, 0xD000,
+	    0xD000, 0);
+    }
+    //
+    //	Open core font, reply checked after the color
+    //
+    font = 0;
+    if (*FontTooltip == '-') {
+	font = xcb_generate_id(Connection);
+	font_cookie =
+	    xcb_open_font_checked(Connection, font, strlen(FontTooltip),
+	    FontTooltip);
+	query_cookie = xcb_query_font(Connection, font);
+    }
 
+    values[0] = RgbPixel(0xD0, 0xD0, 0x00);
+    if (color_cookie.sequence) {
+	alloc_color =
+	    xcb_alloc_color_reply(Connection, color_cookie, NULL);
+	values[0] = alloc_color ? alloc_color->pixel : Screen->white_pixel;
+	free(alloc_color);
+    }
     //	Create the window
     window = xcb_generate_id(Connection);
 
     mask =
 	XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL | XCB_CW_OVERRIDE_REDIRECT |
 	XCB_CW_SAVE_UNDER | XCB_CW_EVENT_MASK;
-    values[0] = alloc_color->pixel;
     values[1] = Screen->black_pixel;
     values[2] = 1;
     values[3] = 1;
@@ -721,18 +1527,38 @@ static void NewTooltip(void)
 	XCB_COPY_FROM_PARENT,		// visual
 	mask, values);			// mask, values
 
+    Tooltip = window;
+
+    //
+    //	UTF-8 text through render, XLFD names are core fonts
     //
-    //	Find and load font
+    if (!font && TextInit(FontTooltip)) {
+	TooltipPicture = TextPicture(window);
+	xcb_flush(Connection);
+	return;
+    }
+    //
+    //	Fallback to default core font
     //
-    font = xcb_generate_id(Connection);
-    error =
-	xcb_request_check(Connection, xcb_open_font_checked(Connection, font,
-	    strlen(FontTooltip), FontTooltip));
+    error = font ? xcb_request_check(Connection, font_cookie) : NULL;
+    if (!font || error) {
+	free(error);
+	if (!font) {
+	    font = xcb_generate_id(Connection);
+	} else {			// failed font isn't opened, reuse id
+	    xcb_discard_reply(Connection, query_cookie.sequence);
+	}
+	font_cookie =
+	    xcb_open_font_checked(Connection, font, sizeof(FONT_CORE) - 1,
+	    FONT_CORE);
+	query_cookie = xcb_query_font(Connection, font);
+	error = xcb_request_check(Connection, font_cookie);
+    }
     if (error) {
 	fprintf(stderr, "Can't open font %d\n", error->error_code);
 	exit(-1);
     }
-    // FIXME: try alternative fonts
+    FontMetrics(query_cookie);
 
     // create graphics context
     FontGC = xcb_generate_id(Connection);
@@ -742,10 +1568,8 @@ static void NewTooltip(void)
     values[2] = 0;
 
     xcb_create_gc(Connection, FontGC, window, mask, values);
+    xcb_flush(Connection);
 
-    free(alloc_color);
-
-    Tooltip = window;
     Font = font;
 }
 
@@ -755,10 +1579,17 @@ static void NewTooltip(void)
 static void DelTooltip(void)
 {
     if (Tooltip) {
+	if (TooltipPicture) {
+	    xcb_render_free_picture(Connection, TooltipPicture);
+	    TooltipPicture = 0;
+	    TextExit();
+	} else {
+	    xcb_free_gc(Connection, FontGC);
+	    xcb_close_font(Connection, Font);
+	}
 	xcb_destroy_window(Connection, Tooltip);
-	xcb_free_gc(Connection, FontGC);
 	// FIXME: free color
-	xcb_close_font(Connection, Font);
+	Tooltip = 0;
     }
 }
 
@@ -827,65 +1658,54 @@ xcb_void_cookie_t xcb_poly_text_8_simple(xcb_connection_t * c,
 /**
 **	Show tooltip
 **
+**	With render the UTF-8 text can have any length and many lines,
+**	the core font shows only the first line of 8bit characters.
+**
+**	@param dock	dock, the tooltip is placed at
 **	@param len	length of text to display
 **	@param str	text to display
 */
-static void ShowTooltip(int len, const char *str)
+static void ShowTooltip(const Dock * dock, int len, const char *str)
 {
+    const char *nl;
     uint32_t mask;
     uint32_t values[5];
-    xcb_generic_error_t *error;
-    xcb_char2b_t *chars;
-    xcb_query_text_extents_reply_t *query_text_extents;
     int i;
     int x;
     int y;
     int th;
     int tw;
+    int h;
 
     //
-    //	Tooltip text length.
+    //	Tooltip text size.
     //
-    chars = alloca(len * 2);
-    for (i = 0; i < len; ++i) {		// convert 8 -> 16
-	chars[i].byte1 = 0;
-	chars[i].byte2 = str[i];
-    }
-
-    query_text_extents =
-	xcb_query_text_extents_reply(Connection,
-	xcb_query_text_extents(Connection, Font, len, chars), &error);
-    if (!query_text_extents || error) {
-	fprintf(stderr, "Can't query text extents\n");
-	return;
+    if (TooltipPicture) {
+	TextExtents(str, len, &tw, &h);
+	th = 4 + h;
+    } else {
+	if ((nl = memchr(str, '\n', len))) {
+	    len = nl - str;
+	}
+	if (len > 254) {		// limit of xcb_poly_text_8_simple
+	    len = 254;
+	}
+	tw = 0;
+	for (i = 0; i < len; ++i) {
+	    tw += FontWidth[(uint8_t) str[i]];
+	}
+	h = FontAscent + FontDescent;
+	th = 4 + h;
     }
-
-    /*
-       printf("%d, %d A=%d D=%d\n", query_text_extents->draw_direction,
-       query_text_extents->length, query_text_extents->font_ascent,
-       query_text_extents->font_descent);
-       printf("A=%d, D=%d, W=%d L=%d R=%d\n",
-       query_text_extents->overall_ascent,
-       query_text_extents->overall_descent,
-       query_text_extents->overall_width,
-       query_text_extents->overall_left,
-       query_text_extents->overall_right);
-     */
-
-    th = 4 + query_text_extents->font_ascent +
-	query_text_extents->font_descent;
     if (th < 16) {
 	th = 16;
     }
-    tw = query_text_extents->overall_width + 16;
-    if (tw < 16) {
-	tw = 16 * 100;
-    }
+    tw += 16;
     //
     //	Move and show tooltip
     //
-    x = y = 0;
-    WindowOrigin(Window, &x, &y);
+    x = dock->X;
+    y = dock->Y;
 
     if (x + tw > Screen->width_in_pixels) {	// on screen
 	x -= tw;
@@ -911,15 +1731,19 @@ static void ShowTooltip(int len, const char *str)
     //
     //	Draw text
     //
-    xcb_poly_text_8_simple(Connection, Tooltip, FontGC, 8,
-	4 + (query_text_extents->font_descent +
-	    query_text_extents->font_ascent - th) / 2 +
-	query_text_extents->font_ascent, len, str);
+    if (TooltipPicture) {
+	// clear, the text is drawn over the old contents
+	xcb_clear_area(Connection, 0, Tooltip, 0, 0, 0, 0);
+	TextDraw(TooltipPicture, 8, (th - h) / 2, str, len);
+    } else {
+	xcb_poly_text_8_simple(Connection, Tooltip, FontGC, 8,
+	    (th - h) / 2 + FontAscent, len, str);
+    }
 
     xcb_flush(Connection);
 
     TooltipShown = 1;
-    Timeout = 5 * 1000;
+    LoopSetTimer(HandleTimeout, GetMsTicks() + 5 * 1000);
 }
 
 /**
@@ -932,7 +1756,7 @@ static void HideTooltip(void)
 	xcb_flush(Connection);
 
 	TooltipShown = 0;
-	Timeout = -1;
+	LoopDelTimer(HandleTimeout);
     }
 }
 
@@ -949,38 +1773,47 @@ static void HandleTimeout(void)
 
 /**
 **	Button press call back.
+**
+**	The mouse wheel steps through the slides, other buttons execute
+**	the command.
+**
+**	@param dock	dock clicked or dock of the clicked tooltip
+**	@param event	button press event
 */
-static void ButtonPress(void)
+static void ButtonPress(Dock * dock, const xcb_button_press_event_t * event)
 {
-    char *cmd;
-    xcb_get_property_cookie_t cookie;
-    xcb_icccm_get_text_property_reply_t prop;
-
-    cookie = xcb_icccm_get_text_property_unchecked(Connection, Window,
-    	CommandAtom);
-    if (xcb_icccm_get_text_property_reply(Connection, cookie, &prop, NULL)) {
-	if (prop.name_len) {
-	    cmd = alloca(prop.name_len + 1);
-	    strcpy(cmd, prop.name);
-	    cmd[prop.name_len] = '\0';
+    const char *command;
 
-	    System(cmd);
-	}
+    switch (event->detail) {
+	case XCB_BUTTON_INDEX_4:	// wheel up
+	    SlideStep(dock, -1);
+	    xcb_flush(Connection);
+	    return;
+	case XCB_BUTTON_INDEX_5:	// wheel down
+	    SlideStep(dock, 1);
+	    xcb_flush(Connection);
+	    return;
+    }
 
-	xcb_icccm_get_text_property_reply_wipe(&prop);
+    command = dock->Properties[PROPERTY_COMMAND].Value;
+    if (command && *command) {
+	LaunchCommand(command);
     }
 }
 
 /**
 **	Window enter
+**
+**	All docks share one tooltip window, it moves to the entered dock.
+**
+**	@param dock	entered dock
 */
-static void WindowEnter(void)
+static void WindowEnter(Dock * dock)
 {
-    xcb_get_property_cookie_t cookie;
-    xcb_icccm_get_text_property_reply_t prop;
+    const char *text;
 
-    if (TooltipShown) {
-	Timeout = 5 * 1000;
+    if (TooltipShown && TooltipDock == dock) {
+	LoopSetTimer(HandleTimeout, GetMsTicks() + 5 * 1000);
 	return;
     }
     // FIXME: don't show tooltip at once, small delay is better
@@ -988,80 +1821,236 @@ static void WindowEnter(void)
 	NewTooltip();
     }
     //
-    //	Get property "TOOLTIP" attached to our window.
+    //	Property "TOOLTIP" attached to the dock window.
     //
-    cookie = xcb_icccm_get_text_property_unchecked(Connection, Window, TooltipAtom);
-    if (xcb_icccm_get_text_property_reply(Connection, cookie, &prop, NULL)) {
-	if (prop.name_len) {
-	    ShowTooltip(prop.name_len, prop.name);
-	} else {
-	    ShowTooltip(sizeof("No tooltip set!") - 1, "No tooltip set!");
-	}
-
-	xcb_icccm_get_text_property_reply_wipe(&prop);
-    } else {
-	ShowTooltip(sizeof("Error tooltip") - 1, "Error tooltip");
+    text = dock->Properties[PROPERTY_TOOLTIP].Value;
+    if (!text || !*text) {
+	text = "No tooltip set!";
     }
+    TooltipDock = dock;
+    ShowTooltip(dock, strlen(text), text);
 }
 
 /**
 **	Window leave
+**
+**	@param dock	left dock
 */
-static void WindowLeave(void)
+static void WindowLeave(Dock * dock)
 {
-    if (Timeout == -1) {
-	HideTooltip();
+    (void)dock;
+
+    // the shown tooltip is removed by its timeout
+}
+
+/**
+**	Write the statistics into the WMDIA_STATS property of a dock.
+**
+**	@param dock	dock of the window
+*/
+static void StatsPublish(const Dock * dock)
+{
+    char buf[STATS_SIZE];
+    int len;
+
+    if (!StatsAtom || !dock->Window) {
+	return;
     }
+    len = StatsFormat(buf, sizeof(buf));
+    xcb_change_property(Connection, XCB_PROP_MODE_REPLACE, dock->Window,
+	StatsAtom, XCB_ATOM_STRING, 8, len, buf);
+    xcb_flush(Connection);
 }
 
 /**
-**	Property changed
+**	Property changed.
+**
+**	Only marks the property, all changes of one event queue drain are
+**	fetched together by PropertyUpdate.  Deleting WMDIA_STATS writes
+**	fresh statistics.
+**
+**	@param dock	dock of the window
+**	@param event	property notify event
 */
-static void PropertyChanged(void)
+static void PropertyChanged(Dock * dock,
+    const xcb_property_notify_event_t * event)
 {
-    if (TooltipShown) {
-	TooltipShown = 0;
-	WindowEnter();
+    int i;
+
+    if (event->atom == StatsAtom && event->state == XCB_PROPERTY_DELETE) {
+	StatsPublish(dock);
+	return;
+    }
+    for (i = 0; i < PROPERTY_MAX; ++i) {
+	if (event->atom == *dock->Properties[i].Atom) {
+	    dock->Properties[i].Dirty = 1;
+	}
+    }
+}
+
+/**
+**	Refresh changed properties without waiting.
+**
+**	Sends a request for each changed property and collects the replies
+**	already received.  A property changed again while its request is
+**	pending, is fetched again after the reply.
+*/
+static void PropertyUpdate(void)
+{
+    xcb_get_property_reply_t *reply;
+    xcb_generic_error_t *error;
+    Property *prop;
+    Dock *dock;
+    uint64_t trace;
+    int flush;
+    int len;
+    int i;
+
+    flush = 0;
+    for (dock = Docks; dock < Docks + DockCount; ++dock) {
+	if (!dock->Window) {		// destroyed
+	    continue;
+	}
+	for (i = 0; i < PROPERTY_MAX; ++i) {
+	    prop = dock->Properties + i;
+	    if (prop->Pending) {
+		reply = NULL;
+		error = NULL;
+		if (!xcb_poll_for_reply(Connection, prop->Cookie.sequence,
+			(void **)&reply, &error)) {
+		    continue;		// not yet received
+		}
+		prop->Pending = 0;
+		free(prop->Value);
+		prop->Value = NULL;
+		if (reply && reply->format == 8) {
+		    len = xcb_get_property_value_length(reply);
+		    if ((prop->Value = malloc(len + 1))) {
+			memcpy(prop->Value, xcb_get_property_value(reply),
+			    len);
+			prop->Value[len] = '\0';
+		    }
+		}
+		free(reply);
+		free(error);
+
+		// show the new tooltip text
+		if (i == PROPERTY_TOOLTIP && TooltipShown
+		    && TooltipDock == dock && !prop->Dirty) {
+		    TooltipShown = 0;
+		    WindowEnter(dock);
+		    flush = 1;
+		}
+	    }
+	    if (prop->Dirty && !prop->Pending) {
+		prop->Cookie =
+		    xcb_get_property_unchecked(Connection, 0, dock->Window,
+		    *prop->Atom, XCB_GET_PROPERTY_TYPE_ANY, 0,
+		    PROPERTY_SIZE / 4);
+		prop->Dirty = 0;
+		prop->Pending = 1;
+		flush = 1;
+	    }
+	}
+    }
+    if (flush) {
+	trace = TraceBegin();
+	xcb_flush(Connection);
+	TraceEnd("flush", trace, 0);
     }
 }
 
 /**
 **	Prepare our graphic data.
+**
+**	Collects the atoms requested by Init, the tooltip is prepared at
+**	idle.
 */
 static void PrepareData(void)
 {
-    xcb_intern_atom_cookie_t cookies[2];
     xcb_intern_atom_reply_t * reply;
     xcb_pixmap_t shape;
+    int i;
 
-    cookies[0] = xcb_intern_atom_unchecked(Connection, 0,
-    	sizeof("COMMAND") - 1 , "COMMAND");
-    cookies[1] = xcb_intern_atom_unchecked(Connection, 0,
-    	sizeof("TOOLTIP") - 1 , "TOOLTIP");
-
-    Image = CreatePixmap((void *)wmdia_xpm, &shape);
-    // Copy background part
+    Image = CreateIconPixmap(&shape);
+    // Copy background part, shared by all docks
     xcb_copy_area(Connection, Image, Pixmap, NormalGC, 0, 0, 0, 0, 64, 64);
     if (shape) {
-	xcb_shape_mask(Connection, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING,
-	    Window, 0, 0, shape);
+	for (i = 0; i < DockCount; ++i) {
+	    xcb_shape_mask(Connection, XCB_SHAPE_SO_SET,
+		XCB_SHAPE_SK_BOUNDING, Docks[i].Window, 0, 0, shape);
+	}
 	xcb_free_pixmap(Connection, shape);
     }
 
     HandleTimeout();
+    StartupTime("icon uploaded");
 
     //
     //	Prepare atoms for our properties
     //
-    
-    if ((reply = xcb_intern_atom_reply(Connection, cookies[0], NULL))) {
-	CommandAtom = reply->atom;
-	free(reply);
+    for (i = 0; i < PROPERTY_MAX; ++i) {
+	if ((reply = xcb_intern_atom_reply(Connection, AtomCookies[i], NULL))) {
+	    *Docks->Properties[i].Atom = reply->atom;	// shared by all
+	    free(reply);
+	}
     }
-    if ((reply = xcb_intern_atom_reply(Connection, cookies[1], NULL))) {
-	TooltipAtom = reply->atom;
+    if ((reply = xcb_intern_atom_reply(Connection, StatsCookie, NULL))) {
+	StatsAtom = reply->atom;
 	free(reply);
     }
+    for (i = 0; i < DockCount; ++i) {
+	StatsPublish(Docks + i);
+    }
+    StartupTime("atoms received");
+
+    LoopSetTimer(NewTooltip, GetMsTicks() + TOOLTIP_IDLE);
+}
+
+/**
+**	Dock window was destroyed.
+**
+**	Stops the sources of the dock, the application exits with the last
+**	dock.
+**
+**	@param dock	destroyed dock
+*/
+static void DockDestroyed(Dock * dock)
+{
+    int i;
+
+    SlideClose(dock);
+    FeedClose(dock);
+    StreamClose(dock);
+    ControlClose(dock);
+    PresentClose(dock);
+
+    if (TooltipDock == dock) {
+	HideTooltip();
+	TooltipDock = NULL;
+    }
+    for (i = 0; i < PROPERTY_MAX; ++i) {
+	if (dock->Properties[i].Pending) {
+	    xcb_discard_reply(Connection,
+		dock->Properties[i].Cookie.sequence);
+	    dock->Properties[i].Pending = 0;
+	}
+    }
+    if (dock->OriginPending) {
+	xcb_discard_reply(Connection, dock->OriginCookie.sequence);
+	dock->OriginPending = 0;
+    }
+    if (dock->Pixmap) {
+	xcb_free_pixmap(Connection, dock->Pixmap);
+	dock->Pixmap = 0;
+    }
+    free(dock->Shown);
+    dock->Shown = NULL;
+    dock->Window = 0;
+
+    if (!--DockAlive) {
+	LoopQuit = 1;
+    }
 }
 
 // ------------------------------------------------------------------------- //
@@ -1084,11 +2073,266 @@ static void PrintVersion(void)
 */
 static void PrintUsage(void)
 {
-    printf("Usage: wmdia [-e cmd] [-f font] [-h] [-n name] [-w]\n"
+    printf("Usage: wmdia [-c file] [-e cmd] [-f font] [-h] [-n name] [-w] [-x]\n"
+	"\t[-X] [-F] [-S] [-T] [-i fifo] [-p fmt] [-g size] [-R fps]\n"
+	"\t[-s dir|listfile] [-d delay] [-r] [-t ms] [-v viewer]\n"
+	"\t[-m size] [-C size] [-P tracefile]\n"
+	"\t-c file\tServe one dock per line \"name [options]\" of file\n"
+	"\t\tdock options are -d -e -g -i -p -r -s -t -v -F -R -S\n"
+	"\t\t(-g -p -R only on the line with -i)\n"
 	"\t-e cmd\tExecute command after setup\n"
-	"\t-f font\tFont for tooltip\n" "\t-h\tDisplay this text\n"
+	"\t-f font\tFontconfig pattern or core font for tooltip\n" "\t-h\tDisplay this text\n"
 	"\t-n name\tChange window name (default wmdia)\n"
-	"\t-w\tStart in window mode\n" "Only idiots print usage on stderr!\n");
+	"\t-w\tStart in window mode\n"
+	"\t-x\tDon't use the MIT-SHM extension\n"
+	"\t-X\tDon't use the Present extension\n"
+	"\t-F\tCreate frame feed /wmdia-<name> for producers\n"
+	"\t-S\tCreate control socket wmdia-<name>.sock for scripts\n"
+	"\t-T\tPrint startup timing breakdown\n"
+	"\t-i fifo\tShow raw frames read from fifo, file or - for stdin\n"
+	"\t-p fmt\tPixel format of -i: bgrx (default), rgb24 or yuv420\n"
+	"\t-g size\tFrame size of -i: 64 (default) or 62\n"
+	"\t-R fps\tShow at most fps frames of -i per second (default 30)\n"
+	"\t-s dir|listfile\tShow slideshow of images in dir or listfile\n"
+	"\t-d delay\tDelay between slides in seconds (default 60)\n"
+	"\t-r\tShow slides in random order\n"
+	"\t-t ms\tCrossfade between slides, 0 disables (default 500)\n"
+	"\t-v viewer\tCommand to view the slide on click (default feh)\n"
+	"\t-m size\tServer pixmap cache in KiB, 0 disables (default 1024)\n"
+	"\t-C size\tThumbnail cache size in MiB, 0 disables (default 64)\n"
+	"\t-P tracefile\tTrace spans as chrome trace JSON, written on exit\n"
+	"\t\tand SIGUSR1\n"
+	"Only idiots print usage on stderr!\n");
+}
+
+/**
+**	Handle option of a dock.
+**
+**	Used for the command line and the dock lines of the config file.
+**
+**	@param dock	configured dock
+**	@param c	option character of #DOCK_OPTIONS
+**	@param arg	argument of the option
+**
+**	@returns 1 if handled, 0 if no dock option, -1 on error.
+*/
+static int DockOption(Dock * dock, int c, const char *arg)
+{
+    switch (c) {
+	case 'd':			// slideshow delay
+	    dock->SlideDelay = atoi(arg) * 1000;
+	    if (dock->SlideDelay <= 0) {
+		dock->SlideDelay = 1000;
+	    }
+	    return 1;
+	case 'e':			// execute command
+	    dock->Execute = arg;
+	    return 1;
+	case 'r':			// random slideshow
+	    dock->SlideRandom = 1;
+	    return 1;
+	case 's':			// slideshow source
+	    dock->SlideSource = arg;
+	    return 1;
+	case 't':			// slideshow crossfade
+	    dock->SlideFade = atoi(arg);
+	    if (dock->SlideFade < 0) {
+		dock->SlideFade = 0;
+	    }
+	    return 1;
+	case 'v':			// slideshow viewer
+	    dock->SlideViewer = arg;
+	    return 1;
+	case 'F':			// frame feed
+	    dock->FeedCreate = 1;
+	    return 1;
+	case 'S':			// control socket
+	    dock->ControlCreate = 1;
+	    return 1;
+	case 'i':			// raw frame stream
+	    dock->StreamSource = arg;
+	    return 1;
+	case 'p':			// raw frame pixel format
+	    if (StreamSetFormat(arg)) {
+		fprintf(stderr, "Unknown pixel format '%s'\n", arg);
+		return -1;
+	    }
+	    return 1;
+	case 'g':			// raw frame size
+	    StreamSize = atoi(arg);
+	    if (StreamSize != DIA_SIZE && StreamSize != DOCK_SIZE) {
+		fprintf(stderr, "Frame size must be %d or %d\n", DIA_SIZE,
+		    DOCK_SIZE);
+		return -1;
+	    }
+	    return 1;
+	case 'R':			// raw frame rate
+	    StreamFps = atoi(arg);
+	    return 1;
+    }
+    return 0;
+}
+
+/**
+**	Split config line into words.
+**
+**	Words are separated by white space, single or double quotes group
+**	white space into a word.  A '#' starts a comment.  The line is
+**	modified in place.
+**
+**	@param line	config line
+**	@param[out] argv	words of the line, terminated by NULL
+**	@param max	size of argv without the terminating NULL
+**
+**	@returns number of words, -1 for too many words or open quote.
+*/
+static int ConfigSplit(char *line, char **argv, int max)
+{
+    char *s;
+    char *d;
+    int quote;
+    int n;
+
+    s = line;
+    for (n = 0;; ++n) {
+	s += strspn(s, " \t\r");
+	if (!*s || *s == '#') {
+	    argv[n] = NULL;
+	    return n;
+	}
+	if (n == max) {
+	    return -1;
+	}
+	argv[n] = d = s;
+	for (quote = 0; *s; ++s) {
+	    if (quote) {
+		if (*s == quote) {
+		    quote = 0;
+		    continue;
+		}
+	    } else if (*s == '"' || *s == '\'') {
+		quote = *s;
+		continue;
+	    } else if (*s == ' ' || *s == '\t' || *s == '\r') {
+		break;
+	    }
+	    *d++ = *s;
+	}
+	if (quote) {
+	    return -1;
+	}
+	if (*s) {			// d can't pass s
+	    ++s;
+	}
+	*d = '\0';
+    }
+}
+
+/**
+**	Read config file.
+**
+**	Each line describes one dock: "name [options]".  The options of the
+**	command line are the defaults of all docks.  The stream options -p
+**	-g -R are global, only the line with -i of the one stream dock may
+**	set them.
+**
+**	@param file	config file name
+**
+**	@returns -1 on error, 0 otherwise.
+*/
+static int ReadConfig(const char *file)
+{
+    FILE *fp;
+    char *argv[CONFIG_ARGS + 1];
+    char *line;
+    char *next;
+    char *buf;
+    size_t size;
+    size_t n;
+    Dock *docks;
+    int argc;
+    int lineno;
+    int stream_line;
+    int stream_opts;
+    int stream_source;
+    int c;
+
+    if (!(fp = fopen(file, "r"))) {
+	fprintf(stderr, "Can't open config file '%s'\n", file);
+	return -1;
+    }
+    // read whole file, the docks point into it
+    size = 0;
+    do {
+	if (!(buf = realloc(ConfigData, size + 4096 + 1))) {
+	    fclose(fp);
+	    return -1;
+	}
+	ConfigData = buf;
+	n = fread(ConfigData + size, 1, 4096, fp);
+	size += n;
+    } while (n == 4096);
+    fclose(fp);
+    ConfigData[size] = '\0';
+
+    lineno = 0;
+    stream_line = 0;
+    for (line = ConfigData; line; line = next) {
+	if ((next = strchr(line, '\n'))) {
+	    *next++ = '\0';
+	}
+	++lineno;
+	if ((argc = ConfigSplit(line, argv, CONFIG_ARGS)) < 0) {
+	    fprintf(stderr, "%s:%d: open quote or too many words\n", file,
+		lineno);
+	    return -1;
+	}
+	if (!argc) {			// empty or comment
+	    continue;
+	}
+	if (!(docks = realloc(Docks, (DockCount + 1) * sizeof(*docks)))) {
+	    return -1;
+	}
+	Docks = docks;
+	docks += DockCount;
+	*docks = DockDefault;
+	docks->Name = argv[0];
+
+	optind = 0;			// restart getopt, argv[0] is the name
+	stream_opts = 0;
+	stream_source = 0;
+	while ((c = getopt(argc, argv, DOCK_OPTIONS)) != EOF) {
+	    if (c == 'p' || c == 'g' || c == 'R') {
+		stream_opts = 1;
+	    }
+	    if (c == 'i') {
+		stream_source = 1;
+	    }
+	    if (DockOption(docks, c, optarg) <= 0) {
+		fprintf(stderr, "%s:%d: bad dock options\n", file, lineno);
+		return -1;
+	    }
+	}
+	if (stream_opts && (!stream_source || stream_line)) {
+	    fprintf(stderr, "%s:%d: -p -g -R only with -i of the stream dock"
+		"\n", file, lineno);
+	    return -1;
+	}
+	if (stream_opts) {
+	    stream_line = lineno;
+	}
+	if (optind < argc) {
+	    fprintf(stderr, "%s:%d: unhandled argument '%s'\n", file, lineno,
+		argv[optind]);
+	    return -1;
+	}
+	++DockCount;
+    }
+    if (!DockCount) {
+	fprintf(stderr, "%s: no docks configured\n", file);
+	return -1;
+    }
+    return 0;
 }
 
 /**
@@ -1099,29 +2343,48 @@ static void PrintUsage(void)
 */
 int main(int argc, char *const argv[])
 {
-    char *execute_cmd;
+    const char *config;
+    int c;
+    int i;
 
-    execute_cmd = NULL;
-    Name = "wmdia";
+    config = NULL;
     FontTooltip = FONT;			// setup defaults
 
     //
     //	Parse arguments.
     //
     for (;;) {
-	switch (getopt(argc, argv, "h?-e:f:n:w")) {
-	    case 'e':			// execute command
-		execute_cmd = optarg;
+	switch ((c = getopt(argc, argv, "h?-c:f:m:n:wxC:P:TX" DOCK_OPTIONS))) {
+	    case 'c':			// config file of docks
+		config = optarg;
 		continue;
 	    case 'f':			// font of tooltip
 		FontTooltip = optarg;
 		continue;
 	    case 'n':			// change window name
-		Name = optarg;
+		DockDefault.Name = optarg;
+		continue;
+	    case 'm':			// pixmap cache size
+		SlidePixmapBudget = atoi(optarg) * 1024U;
+		continue;
+	    case 'C':			// thumbnail cache size
+		CacheBudget = atoi(optarg) * 1024U * 1024U;
 		continue;
 	    case 'w':			// window mode
 		WindowMode = 1;
 		continue;
+	    case 'x':			// no shared memory
+		FrameNoShm = 1;
+		continue;
+	    case 'X':			// no present extension
+		PresentDisabled = 1;
+		continue;
+	    case 'T':			// startup timing
+		StartupTiming = 1;
+		continue;
+	    case 'P':			// trace file
+		TraceFile = optarg;
+		continue;
 
 	    case EOF:
 		break;
@@ -1139,6 +2402,13 @@ int main(int argc, char *const argv[])
 		fprintf(stderr, "Missing argument for option '%c'\n", optopt);
 		return -1;
 	    default:
+		// options of the dock
+		if ((i = DockOption(&DockDefault, c, optarg)) > 0) {
+		    continue;
+		}
+		if (i < 0) {
+		    return -1;
+		}
 		PrintVersion();
 		fprintf(stderr, "Unknown option '%c'\n", optopt);
 		return -1;
@@ -1152,18 +2422,49 @@ int main(int argc, char *const argv[])
 	}
 	return -1;
     }
+    //
+    //	One dock of the command line or the docks of the config file.
+    //
+    if (config) {
+	if (ReadConfig(config) < 0) {
+	    return -1;
+	}
+    } else {
+	Docks = malloc(sizeof(*Docks));
+	Docks[0] = DockDefault;
+	DockCount = 1;
+    }
+    for (i = 0; i < DockCount; ++i) {
+	DockSetup(Docks + i);
+    }
 
+    StartupTime(NULL);
     if (Init(argc, argv) < 0) {
 	return -1;
     }
     PrepareData();
-    if (execute_cmd) {
-	System(execute_cmd);
+    for (i = 0; i < DockCount; ++i) {
+	if (Docks[i].FeedCreate) {
+	    FeedInit(Docks + i);
+	}
+	if (Docks[i].ControlCreate) {
+	    ControlInit(Docks + i);
+	}
+	if (Docks[i].SlideSource) {
+	    SlideInit(Docks + i);
+	}
+	if (Docks[i].StreamSource) {
+	    StreamInit(Docks + i);
+	}
+	if (Docks[i].Execute) {
+	    LaunchCommand(Docks[i].Execute);
+	}
+	// show initial content
+	xcb_clear_area(Connection, 0, Docks[i].Window, 0, 0, 64, 64);
     }
-    // show initial content
-    xcb_clear_area(Connection, 0, Window, 0, 0, 64, 64);
     // flush the request
     xcb_flush(Connection);
+    StartupTime("sources started");
 
     Loop();
     Exit();
@@ -0,0 +1,141 @@
+///
+///	@file wmdia.h		@brief	DIA Dockapp header file
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup wmdia
+/// @{
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define DOCK_SIZE	64		///< width and height of dock window
+#define DIA_SIZE	62		///< width and height of the dia
+
+#define PROPERTY_COMMAND	0	///< index of COMMAND property
+#define PROPERTY_TOOLTIP	1	///< index of TOOLTIP property
+#define PROPERTY_MAX		2	///< number of cached properties
+#define PROPERTY_SIZE		16384	///< max. bytes of a property
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Client side copy of a window property.
+///
+typedef struct _property_
+{
+    xcb_atom_t *Atom;			///< atom of the property
+    char *Value;			///< cached value, NULL if not set
+    char Dirty;				///< changed, must be fetched
+    char Pending;			///< get_property request sent
+    xcb_get_property_cookie_t Cookie;	///< pending request
+} Property;
+
+typedef struct _slideshow_ Slideshow;	///< slideshow of a dock
+typedef struct _frame_feed_ FrameFeed;	///< frame feed of a dock
+typedef struct _control_socket_ ControlSocket;	///< control of a dock
+typedef struct _dock_present_ DockPresent;	///< back buffers of a dock
+
+///
+///	Dock window.
+///
+///	All docks share the connection, graphic context, icon and tooltip.
+///	The options select the sources started for the dock.
+///
+typedef struct _dock_
+{
+    xcb_window_t Window;		///< dock window, 0 if destroyed
+    xcb_pixmap_t Pixmap;		///< background of frames, 0 if unused
+    uint32_t *Shown;			///< pixels of Dock::Pixmap, diff base
+    char FrameBackground;		///< frames own the window background
+    uint32_t FrameSequence;		///< producer sequence of the frame
+    DockPresent *Present;		///< back buffers, NULL if not used
+    const char *Name;			///< window name
+
+    Property Properties[PROPERTY_MAX];	///< cached properties
+
+    int X;				///< absolute x position of window
+    int Y;				///< absolute y position of window
+    char OriginPending;			///< translate coordinates sent
+    char OriginDirty;			///< moved again while pending
+    xcb_translate_coordinates_cookie_t OriginCookie;	///< pending request
+
+    const char *Execute;		///< command executed after setup
+    const char *SlideSource;		///< slideshow directory or list file
+    const char *SlideViewer;		///< viewer command for click
+    int SlideDelay;			///< delay between slides in ms
+    char SlideRandom;			///< show slides in random order
+    int SlideFade;			///< crossfade between slides in ms
+    char FeedCreate;			///< create frame feed
+    const char *StreamSource;		///< raw frame stream, "-" for stdin
+    char ControlCreate;			///< create control socket
+
+    Slideshow *Slideshow;		///< running slideshow
+    FrameFeed *Feed;			///< running frame feed
+    ControlSocket *Control;		///< control socket
+} Dock;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern xcb_connection_t *Connection;	///< connection to X11 server
+extern xcb_screen_t *Screen;		///< our screen
+extern xcb_gcontext_t NormalGC;		///< normal graphic context
+
+extern xcb_atom_t CommandAtom;		///< "COMMAND" property
+extern xcb_atom_t TooltipAtom;		///< "TOOLTIP" property
+
+extern int NativeRgb;			///< visual pixels are 0x00RRGGBB
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+    /// Get ticks in ms.
+extern uint32_t GetMsTicks(void);
+
+    /// Convert 8bit RGB to pixel of our visual.
+extern uint32_t RgbPixel(int, int, int);
+
+    /// Upload frame into the dock window, without flush.
+extern void PutFrame(Dock *, const uint32_t *, int);
+
+    /// Show frame in the dock window.
+extern void ShowFrame(Dock *, const uint32_t *, int);
+
+    /// Add file descriptor to event loop.
+extern int LoopAddFd(int, void (*)(void));
+
+    /// Remove file descriptor from event loop.
+extern void LoopDelFd(int);
+
+    /// Set or move timer.
+extern void LoopSetTimer(void (*)(void), uint32_t);
+
+    /// Cancel timer.
+extern void LoopDelTimer(void (*)(void));
+
+/// @}
@@ -0,0 +1,1116 @@
+///
+///	@file wmdiabench.c	@brief	End-to-end benchmark of the wmdia dockapp
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Wmdiabench The end-to-end benchmark.
+///
+///	Launches wmdia on the X server of $DISPLAY (a private Xvfb started
+///	by bench.sh) and drives it like a user:
+///
+///	- startup: spawn to first map of the dock window
+///	- tooltip: pointer enter to the tooltip shown, alternating between
+///	  two docks of one process
+///	- click: XTest button press to the started command running
+///	- slides: mouse wheel to the next slide shown, as fast as the
+///	  slide worker delivers
+///	- feed: frames written into the frame feed at a fixed rate against
+///	  frames shown (DAMAGE events of the dock window)
+///
+///	The results are written as JSON to stdout: p50/p99 latencies, CPU
+///	time and resident set size of wmdia for each scenario.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <png.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+#include <xcb/damage.h>
+
+#include "wmdiafeed.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define BENCH_RUNS	50		///< default samples per scenario
+#define BENCH_FPS	60		///< default frame feed rate
+#define BENCH_SECONDS	5		///< default frame feed duration
+#define BENCH_SLIDES	30		///< default number of slides
+#define BENCH_TIMEOUT	2000		///< ms to wait for a reaction
+#define BENCH_MS	1000000ULL	///< ns per ms
+
+    /// event type without the send event flag
+#define BENCH_EVENT_TYPE(event)	((event)->response_type & ~0x80)
+
+//----------------------------------------------------------------------------
+//	Typedefs
+//----------------------------------------------------------------------------
+
+///
+///	Resource usage of wmdia during a scenario.
+///
+typedef struct _bench_usage_
+{
+    uint64_t Start;			///< wall clock at start in ns
+    unsigned long Ticks;		///< user + system clock ticks at start
+    double Cpu;				///< cpu time in ms
+    double Wall;			///< wall time in ms
+    unsigned long Rss;			///< resident set size in KiB
+    unsigned long Hwm;			///< peak resident set size in KiB
+} BenchUsage;
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+extern char **environ;			///< process environment
+
+static xcb_connection_t *Connection;	///< connection to X11 server
+static xcb_screen_t *Screen;		///< our screen
+static xcb_atom_t TooltipAtom;		///< "TOOLTIP" property
+static xcb_atom_t CommandAtom;		///< "COMMAND" property
+
+static const char *Wmdia = "./wmdia";	///< wmdia executable
+static int Runs = BENCH_RUNS;		///< samples per scenario
+static int Fps = BENCH_FPS;		///< frame feed rate
+static int Seconds = BENCH_SECONDS;	///< frame feed duration
+static int Slides = BENCH_SLIDES;	///< number of generated slides
+static const char *Dir;			///< directory of our files
+static char Name[32];			///< window name of the docks
+static int Fields;			///< JSON fields written
+
+//----------------------------------------------------------------------------
+//	Functions
+//----------------------------------------------------------------------------
+
+/**
+**	Get monotonic time.
+**
+**	@returns time in ns.
+*/
+static uint64_t BenchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+**	Get next X11 event.
+**
+**	@param deadline	give up at this time, see BenchNow
+**
+**	@returns event to be freed by caller, NULL on timeout.
+*/
+static xcb_generic_event_t *BenchEvent(uint64_t deadline)
+{
+    xcb_generic_event_t *event;
+    struct pollfd fds;
+    uint64_t now;
+
+    for (;;) {
+	if ((event = xcb_poll_for_event(Connection))) {
+	    return event;
+	}
+	if (xcb_connection_has_error(Connection)) {
+	    fprintf(stderr, "wmdiabench: X11 connection lost\n");
+	    exit(-1);
+	}
+	if ((now = BenchNow()) >= deadline) {
+	    return NULL;
+	}
+	fds.fd = xcb_get_file_descriptor(Connection);
+	fds.events = POLLIN;
+	poll(&fds, 1, (deadline - now) / BENCH_MS + 1);
+    }
+}
+
+/**
+**	Throw away all X11 events for some time.
+**
+**	@param ms	time in ms
+*/
+static void BenchDrain(int ms)
+{
+    xcb_generic_event_t *event;
+    uint64_t deadline;
+
+    xcb_flush(Connection);
+    deadline = BenchNow() + ms * BENCH_MS;
+    while ((event = BenchEvent(deadline))) {
+	free(event);
+    }
+}
+
+/**
+**	Intern an atom.
+**
+**	@param name	name of the atom
+*/
+static xcb_atom_t BenchAtom(const char *name)
+{
+    xcb_intern_atom_reply_t *reply;
+    xcb_atom_t atom;
+
+    reply =
+	xcb_intern_atom_reply(Connection, xcb_intern_atom(Connection, 0,
+	    strlen(name), name), NULL);
+    atom = reply ? reply->atom : XCB_NONE;
+    free(reply);
+    return atom;
+}
+
+/**
+**	Set a string property of a dock.
+**
+**	@param window	dock window
+**	@param atom	property
+**	@param value	text of the property
+*/
+static void BenchProperty(xcb_window_t window, xcb_atom_t atom,
+    const char *value)
+{
+    xcb_change_property(Connection, XCB_PROP_MODE_REPLACE, window, atom,
+	XCB_ATOM_STRING, 8, strlen(value), value);
+}
+
+/**
+**	Press and release a button with XTest.
+**
+**	@param button	button index
+*/
+static void BenchButton(int button)
+{
+    xcb_test_fake_input(Connection, XCB_BUTTON_PRESS, button,
+	XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+    xcb_test_fake_input(Connection, XCB_BUTTON_RELEASE, button,
+	XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+    xcb_flush(Connection);
+}
+
+/**
+**	Move the pointer.
+**
+**	@param x	root x coordinate
+**	@param y	root y coordinate
+*/
+static void BenchPointer(int x, int y)
+{
+    xcb_warp_pointer(Connection, XCB_NONE, Screen->root, 0, 0, 0, 0, x, y);
+    xcb_flush(Connection);
+}
+
+/**
+**	Start wmdia.
+**
+**	Output of wmdia goes to stderr, stdout is our JSON.
+**
+**	@param args	options after -n name, NULL terminated
+**
+**	@returns process id, -1 on error.
+*/
+static pid_t BenchSpawn(const char *const *args)
+{
+    posix_spawn_file_actions_t actions;
+    const char *argv[16];
+    pid_t pid;
+    int i;
+    int err;
+
+    argv[0] = Wmdia;
+    argv[1] = "-n";
+    argv[2] = Name;
+    for (i = 3; *args && i < 15; ++i) {
+	argv[i] = *args++;
+    }
+    argv[i] = NULL;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, 2, 1);
+    err = posix_spawn(&pid, Wmdia, &actions, NULL, (char *const *)argv,
+	environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err) {
+	fprintf(stderr, "wmdiabench: can't start '%s': %s\n", Wmdia,
+	    strerror(err));
+	return -1;
+    }
+    return pid;
+}
+
+/**
+**	Wait until the docks are mapped.
+**
+**	The docks are mapped in the order of the configuration.
+**
+**	@param[out] windows	dock windows
+**	@param n		number of docks
+**	@param deadline		give up at this time, see BenchNow
+**
+**	@returns number of mapped docks.
+*/
+static int BenchWaitMap(xcb_window_t * windows, int n, uint64_t deadline)
+{
+    xcb_generic_event_t *event;
+    int i;
+
+    for (i = 0; i < n && (event = BenchEvent(deadline));) {
+	if (BENCH_EVENT_TYPE(event) == XCB_MAP_NOTIFY) {
+	    windows[i++] = ((xcb_map_notify_event_t *) event)->window;
+	}
+	free(event);
+    }
+    return i;
+}
+
+/**
+**	Stop wmdia.
+**
+**	wmdia exits cleanly, when its last dock window is destroyed.
+**
+**	@param pid	process id of wmdia
+**	@param windows	dock windows
+**	@param n	number of docks
+*/
+static void BenchStop(pid_t pid, const xcb_window_t * windows, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+	xcb_destroy_window(Connection, windows[i]);
+    }
+    xcb_flush(Connection);
+    for (i = 0; i < BENCH_TIMEOUT / 10; ++i) {
+	if (waitpid(pid, NULL, WNOHANG) == pid) {
+	    return;
+	}
+	usleep(10 * 1000);
+    }
+    fprintf(stderr, "wmdiabench: wmdia hangs, killed\n");
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+/**
+**	Read a value of /proc/<pid>/status.
+**
+**	@param pid	process id
+**	@param key	name of the value including ':'
+**
+**	@returns value in KiB, 0 if not found.
+*/
+static unsigned long BenchStatus(pid_t pid, const char *key)
+{
+    char path[64];
+    char line[256];
+    unsigned long value;
+    FILE *file;
+
+    value = 0;
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    if ((file = fopen(path, "r"))) {
+	while (fgets(line, sizeof(line), file)) {
+	    if (!strncmp(line, key, strlen(key))) {
+		value = strtoul(line + strlen(key), NULL, 10);
+		break;
+	    }
+	}
+	fclose(file);
+    }
+    return value;
+}
+
+/**
+**	Read cpu time of all threads of a process.
+**
+**	@param pid	process id
+**
+**	@returns user + system time in clock ticks.
+*/
+static unsigned long BenchTicks(pid_t pid)
+{
+    char path[64];
+    char line[1024];
+    unsigned long utime;
+    unsigned long stime;
+    const char *s;
+    FILE *file;
+    size_t n;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    if (!(file = fopen(path, "r"))) {
+	return 0;
+    }
+    n = fread(line, 1, sizeof(line) - 1, file);
+    fclose(file);
+    line[n] = '\0';
+    // the command name can contain anything, fields start after it
+    if (!(s = strrchr(line, ')'))
+	|| sscanf(s + 1,
+	    " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime,
+	    &stime) != 2) {
+	return 0;
+    }
+    return utime + stime;
+}
+
+/**
+**	Begin resource usage measurement.
+**
+**	@param pid		process id of wmdia
+**	@param[out] usage	resource usage
+*/
+static void BenchUsageBegin(pid_t pid, BenchUsage * usage)
+{
+    usage->Start = BenchNow();
+    usage->Ticks = BenchTicks(pid);
+}
+
+/**
+**	End resource usage measurement.
+**
+**	@param pid		process id of wmdia
+**	@param[in,out] usage	resource usage
+*/
+static void BenchUsageEnd(pid_t pid, BenchUsage * usage)
+{
+    usage->Wall = (BenchNow() - usage->Start) / 1e6;
+    usage->Cpu = (BenchTicks(pid) - usage->Ticks) * 1000.0
+	/ sysconf(_SC_CLK_TCK);
+    usage->Rss = BenchStatus(pid, "VmRSS:");
+    usage->Hwm = BenchStatus(pid, "VmHWM:");
+}
+
+/**
+**	Begin a scenario object of the JSON output.
+**
+**	@param name	name of the scenario
+*/
+static void BenchBegin(const char *name)
+{
+    printf("%s\n  \"%s\": {", Fields++ ? "," : "", name);
+}
+
+/**
+**	End a scenario object of the JSON output.
+**
+**	@param usage	resource usage of wmdia during the scenario
+*/
+static void BenchEnd(const BenchUsage * usage)
+{
+    printf("\"cpu_ms\": %.1f, \"cpu_percent\": %.1f, "
+	"\"rss_kb\": %lu, \"hwm_kb\": %lu}", usage->Cpu,
+	usage->Wall > 0 ? usage->Cpu * 100 / usage->Wall : 0.0, usage->Rss,
+	usage->Hwm);
+    fflush(stdout);
+}
+
+/**
+**	Compare two samples for qsort.
+*/
+static int BenchCompare(const void *a, const void *b)
+{
+    return *(const double *)a < *(const double *)b ? -1 :
+	*(const double *)a > *(const double *)b;
+}
+
+/**
+**	Write latency statistics of samples.
+**
+**	p50 and p99 are nearest rank percentiles.
+**
+**	@param prefix	prefix of the JSON keys
+**	@param samples	samples in ms, sorted in place
+**	@param n	number of samples
+*/
+static void BenchLatency(const char *prefix, double *samples, int n)
+{
+    if (!n) {
+	printf("\"%sp50_ms\": null, \"%sp99_ms\": null, ", prefix, prefix);
+	return;
+    }
+    qsort(samples, n, sizeof(*samples), BenchCompare);
+    printf("\"%sp50_ms\": %.3f, \"%sp99_ms\": %.3f, "
+	"\"%smin_ms\": %.3f, \"%smax_ms\": %.3f, ", prefix,
+	samples[(n * 50 + 99) / 100 - 1], prefix,
+	samples[(n * 99 + 99) / 100 - 1], prefix, samples[0], prefix,
+	samples[n - 1]);
+}
+
+/**
+**	Command started by the click scenario.
+**
+**	Writes its start time into the fifo of the benchmark.
+**
+**	@param fifo	path of the fifo
+*/
+static int BenchNotify(const char *fifo)
+{
+    char buf[32];
+    int fd;
+    int n;
+
+    n = snprintf(buf, sizeof(buf), "%llu\n", (unsigned long long)BenchNow());
+    if ((fd = open(fifo, O_WRONLY | O_NONBLOCK)) < 0 || write(fd, buf,
+	    n) != n) {
+	return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+//	Scenarios
+//----------------------------------------------------------------------------
+
+/**
+**	Cold startup: spawn to first map of the dock window.
+*/
+static void BenchStartup(void)
+{
+    static const char *const args[] = { NULL };
+    BenchUsage usage;
+    xcb_window_t window;
+    double *samples;
+    uint64_t start;
+    pid_t pid;
+    int failed;
+    int n;
+    int i;
+
+    samples = malloc(Runs * sizeof(*samples));
+    memset(&usage, 0, sizeof(usage));
+    failed = 0;
+    n = 0;
+    for (i = 0; i < Runs; ++i) {
+	start = BenchNow();
+	if ((pid = BenchSpawn(args)) < 0) {
+	    break;
+	}
+	if (!BenchWaitMap(&window, 1, start + BENCH_TIMEOUT * BENCH_MS)) {
+	    ++failed;
+	    kill(pid, SIGKILL);
+	    waitpid(pid, NULL, 0);
+	    continue;
+	}
+	samples[n++] = (BenchNow() - start) / 1e6;
+	// cpu and memory of the complete startup
+	usage.Start = start;
+	BenchUsageEnd(pid, &usage);
+	BenchStop(pid, &window, 1);
+    }
+
+    BenchBegin("startup");
+    printf("\"runs\": %d, \"failed\": %d, ", n, failed);
+    BenchLatency("", samples, n);
+    BenchEnd(&usage);
+    free(samples);
+}
+
+/**
+**	Hover: pointer enter to tooltip shown.
+**
+**	The pointer alternates between two docks, each enter moves the
+**	shared tooltip.  Every shown tooltip is configured, the dock
+**	windows aren't.
+*/
+static void BenchTooltip(void)
+{
+    static const int points[2][2] = { {8, 8}, {264, 8} };
+    const char *args[3];
+    char config[256];
+    BenchUsage usage;
+    xcb_window_t windows[2];
+    xcb_generic_event_t *event;
+    xcb_configure_notify_event_t *configure;
+    double *samples;
+    uint64_t start;
+    uint32_t x;
+    FILE *file;
+    pid_t pid;
+    int failed;
+    int n;
+    int i;
+
+    snprintf(config, sizeof(config), "%s/%s.conf", Dir, Name);
+    if (!(file = fopen(config, "w"))) {
+	fprintf(stderr, "wmdiabench: can't create '%s'\n", config);
+	return;
+    }
+    fprintf(file, "%sa\n%sb\n", Name, Name);
+    fclose(file);
+    args[0] = "-c";
+    args[1] = config;
+    args[2] = NULL;
+
+    if ((pid = BenchSpawn(args)) < 0) {
+	unlink(config);
+	return;
+    }
+    if (BenchWaitMap(windows, 2, BenchNow() + BENCH_TIMEOUT * BENCH_MS) != 2) {
+	fprintf(stderr, "wmdiabench: docks not mapped\n");
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	unlink(config);
+	return;
+    }
+    // second dock beside the first, short tooltips keep them apart
+    x = points[1][0] - 8;
+    xcb_configure_window(Connection, windows[1], XCB_CONFIG_WINDOW_X, &x);
+    BenchProperty(windows[0], TooltipAtom, "a");
+    BenchProperty(windows[1], TooltipAtom, "b");
+    BenchDrain(1000);			// tooltip is prepared at idle
+
+    samples = malloc(Runs * sizeof(*samples));
+    failed = 0;
+    n = 0;
+    BenchUsageBegin(pid, &usage);
+    for (i = 0; i < Runs; ++i) {
+	start = BenchNow();
+	BenchPointer(points[i & 1][0], points[i & 1][1]);
+	while ((event = BenchEvent(start + BENCH_TIMEOUT * BENCH_MS))) {
+	    configure = (xcb_configure_notify_event_t *) event;
+	    if (BENCH_EVENT_TYPE(event) == XCB_CONFIGURE_NOTIFY
+		&& configure->window != windows[0]
+		&& configure->window != windows[1]) {
+		samples[n++] = (BenchNow() - start) / 1e6;
+		free(event);
+		break;
+	    }
+	    free(event);
+	}
+	if (!event) {
+	    ++failed;
+	}
+	BenchDrain(10);
+    }
+    BenchUsageEnd(pid, &usage);
+    BenchStop(pid, windows, 2);
+    unlink(config);
+
+    BenchBegin("tooltip");
+    printf("\"runs\": %d, \"failed\": %d, ", n, failed);
+    BenchLatency("", samples, n);
+    BenchEnd(&usage);
+    free(samples);
+}
+
+/**
+**	Click: button press to started command running.
+**
+**	The command is this program with -N fifo, it writes its start time
+**	into the fifo.
+*/
+static void BenchClick(void)
+{
+    static const char *const args[] = { NULL };
+    char fifo[256];
+    char self[256];
+    char command[600];
+    char buf[256];
+    BenchUsage usage;
+    xcb_window_t window;
+    struct pollfd fds;
+    double *samples;
+    uint64_t start;
+    uint64_t now;
+    ssize_t len;
+    pid_t pid;
+    int keep;
+    int failed;
+    int n;
+    int i;
+
+    snprintf(fifo, sizeof(fifo), "%s/%s.fifo", Dir, Name);
+    if ((len = readlink("/proc/self/exe", self, sizeof(self) - 1)) < 0) {
+	return;
+    }
+    self[len] = '\0';
+    snprintf(command, sizeof(command), "%s -N %s", self, fifo);
+    unlink(fifo);
+    if (mkfifo(fifo, 0600) || (fds.fd = open(fifo, O_RDONLY | O_NONBLOCK)) < 0) {
+	fprintf(stderr, "wmdiabench: can't create '%s'\n", fifo);
+	return;
+    }
+    // own writer, no hangup between the commands
+    keep = open(fifo, O_WRONLY | O_NONBLOCK);
+
+    if ((pid = BenchSpawn(args)) < 0) {
+	goto out;
+    }
+    if (!BenchWaitMap(&window, 1, BenchNow() + BENCH_TIMEOUT * BENCH_MS)) {
+	fprintf(stderr, "wmdiabench: dock not mapped\n");
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	goto out;
+    }
+    BenchProperty(window, CommandAtom, command);
+    BenchPointer(8, 8);
+    BenchDrain(200);
+
+    samples = malloc(Runs * sizeof(*samples));
+    failed = 0;
+    n = 0;
+    BenchUsageBegin(pid, &usage);
+    for (i = 0; i < Runs; ++i) {
+	start = BenchNow();
+	BenchButton(XCB_BUTTON_INDEX_1);
+	fds.events = POLLIN;
+	for (;;) {
+	    if ((now = BenchNow()) >= start + BENCH_TIMEOUT * BENCH_MS) {
+		++failed;
+		break;
+	    }
+	    if (poll(&fds, 1, (start + BENCH_TIMEOUT * BENCH_MS - now)
+		    / BENCH_MS + 1) > 0
+		&& (len = read(fds.fd, buf, sizeof(buf) - 1)) > 0) {
+		buf[len] = '\0';
+		samples[n++] = (strtoull(buf, NULL, 10) - start) / 1e6;
+		break;
+	    }
+	}
+	BenchDrain(10);
+    }
+    BenchUsageEnd(pid, &usage);
+    BenchStop(pid, &window, 1);
+
+    BenchBegin("click");
+    printf("\"runs\": %d, \"failed\": %d, ", n, failed);
+    BenchLatency("", samples, n);
+    BenchEnd(&usage);
+    free(samples);
+
+  out:
+    if (keep >= 0) {
+	close(keep);
+    }
+    close(fds.fd);
+    unlink(fifo);
+}
+
+/**
+**	Write a generated slide.
+**
+**	@param path	file name of the png
+**	@param index	number of the slide, selects the colors
+**
+**	@returns -1 on error, 0 otherwise.
+*/
+static int BenchSlideWrite(const char *path, int index)
+{
+    png_image image;
+    uint8_t *rgb;
+    int x;
+    int y;
+    int ok;
+
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = 640;
+    image.height = 480;
+    image.format = PNG_FORMAT_RGB;
+    rgb = malloc(image.width * image.height * 3);
+    for (y = 0; y < (int)image.height; ++y) {
+	for (x = 0; x < (int)image.width; ++x) {
+	    rgb[(y * image.width + x) * 3 + 0] = x + index * 37;
+	    rgb[(y * image.width + x) * 3 + 1] = y + index * 91;
+	    rgb[(y * image.width + x) * 3 + 2] = (x ^ y) + index * 13;
+	}
+    }
+    ok = png_image_write_to_file(&image, path, 0, rgb, 0, NULL);
+    free(rgb);
+    return ok ? 0 : -1;
+}
+
+/**
+**	Slides: mouse wheel to next slide shown.
+**
+**	The wheel is turned again, until the slide worker has the next
+**	slide ready.  A shown slide sets the tooltip of the dock.  The
+**	thumbnail cache is cold, when HOME is empty (bench.sh).
+*/
+static void BenchSlides(void)
+{
+    const char *args[7];
+    char dir[256];
+    char path[300];
+    BenchUsage usage;
+    xcb_window_t window;
+    xcb_generic_event_t *event;
+    xcb_property_notify_event_t *property;
+    uint32_t mask;
+    double *samples;
+    uint64_t start;
+    uint64_t step;
+    int retries;
+    int failed;
+    int shown;
+    int n;
+    int i;
+    pid_t pid;
+
+    snprintf(dir, sizeof(dir), "%s/%s.slides", Dir, Name);
+    mkdir(dir, 0700);
+    for (i = 0; i < Slides; ++i) {
+	snprintf(path, sizeof(path), "%s/%04d.png", dir, i);
+	if (BenchSlideWrite(path, i)) {
+	    fprintf(stderr, "wmdiabench: can't write '%s'\n", path);
+	    goto out;
+	}
+    }
+    args[0] = "-s";
+    args[1] = dir;
+    args[2] = "-d";
+    args[3] = "3600";			// only the wheel steps
+    args[4] = "-t";
+    args[5] = "0";			// no crossfade
+    args[6] = NULL;
+
+    if ((pid = BenchSpawn(args)) < 0) {
+	goto out;
+    }
+    if (!BenchWaitMap(&window, 1, BenchNow() + BENCH_TIMEOUT * BENCH_MS)) {
+	fprintf(stderr, "wmdiabench: dock not mapped\n");
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	goto out;
+    }
+    mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+    xcb_change_window_attributes(Connection, window, XCB_CW_EVENT_MASK,
+	&mask);
+    BenchPointer(8, 8);
+    BenchDrain(200);
+
+    samples = malloc(Slides * sizeof(*samples));
+    retries = 0;
+    failed = 0;
+    n = 0;
+    BenchUsageBegin(pid, &usage);
+    for (i = 0; i < Slides; ++i) {
+	start = BenchNow();
+	shown = 0;
+	while (!shown && BenchNow() < start + BENCH_TIMEOUT * BENCH_MS) {
+	    BenchButton(XCB_BUTTON_INDEX_5);
+	    step = BenchNow() + 50 * BENCH_MS;
+	    while (!shown && (event = BenchEvent(step))) {
+		property = (xcb_property_notify_event_t *) event;
+		shown = BENCH_EVENT_TYPE(event) == XCB_PROPERTY_NOTIFY
+		    && property->window == window
+		    && property->atom == TooltipAtom;
+		free(event);
+	    }
+	    retries += !shown;
+	}
+	if (!shown) {
+	    ++failed;
+	    continue;
+	}
+	samples[n++] = (BenchNow() - start) / 1e6;
+    }
+    BenchUsageEnd(pid, &usage);
+    BenchStop(pid, &window, 1);
+
+    BenchBegin("slides");
+    printf("\"runs\": %d, \"failed\": %d, \"retries\": %d, "
+	"\"slides_per_s\": %.2f, ", n, failed, retries,
+	usage.Wall > 0 ? n * 1000 / usage.Wall : 0.0);
+    BenchLatency("", samples, n);
+    BenchEnd(&usage);
+    free(samples);
+
+  out:
+    for (i = 0; i < Slides; ++i) {
+	snprintf(path, sizeof(path), "%s/%04d.png", dir, i);
+	unlink(path);
+    }
+    rmdir(dir);
+}
+
+/**
+**	Frame feed: frames written at a fixed rate against frames shown.
+**
+**	Each frame differs completely from the previous.  Every frame
+**	shown damages the dock window, the damage is reset after each
+**	notify.
+*/
+static void BenchFeed(void)
+{
+    static const char *const args[] = { "-F", NULL };
+    const xcb_query_extension_reply_t *damage_ext;
+    xcb_damage_query_version_reply_t *version;
+    xcb_damage_damage_t damage;
+    xcb_generic_event_t *event;
+    BenchUsage usage;
+    xcb_window_t window;
+    WmdiaFeed *feed;
+    uint32_t *pixels;
+    double *samples;
+    uint64_t next;
+    uint64_t end;
+    uint64_t last;
+    uint64_t period;
+    int produced;
+    int shown;
+    int intervals;
+    int x;
+    int y;
+    int i;
+    pid_t pid;
+
+    damage_ext = xcb_get_extension_data(Connection, &xcb_damage_id);
+    if (!damage_ext || !damage_ext->present) {
+	fprintf(stderr, "wmdiabench: no DAMAGE extension, feed skipped\n");
+	return;
+    }
+    version =
+	xcb_damage_query_version_reply(Connection,
+	xcb_damage_query_version(Connection, XCB_DAMAGE_MAJOR_VERSION,
+	    XCB_DAMAGE_MINOR_VERSION), NULL);
+    free(version);
+
+    if ((pid = BenchSpawn(args)) < 0) {
+	return;
+    }
+    if (!BenchWaitMap(&window, 1, BenchNow() + BENCH_TIMEOUT * BENCH_MS)) {
+	fprintf(stderr, "wmdiabench: dock not mapped\n");
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	return;
+    }
+    feed = NULL;
+    for (i = 0; i < BENCH_TIMEOUT / 10 && !(feed = WmdiaFeedOpen(Name)); ++i) {
+	usleep(10 * 1000);
+    }
+    if (!feed) {
+	fprintf(stderr, "wmdiabench: can't open frame feed\n");
+	BenchStop(pid, &window, 1);
+	return;
+    }
+    damage = xcb_generate_id(Connection);
+    xcb_damage_create(Connection, damage, window,
+	XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+    BenchDrain(200);
+    xcb_damage_subtract(Connection, damage, XCB_NONE, XCB_NONE);
+
+    samples = malloc(Fps * Seconds * sizeof(*samples));
+    produced = 0;
+    shown = 0;
+    intervals = 0;
+    period = 1000000000ULL / Fps;
+    BenchUsageBegin(pid, &usage);
+    next = usage.Start;
+    end = next + Seconds * 1000000000ULL;
+    last = 0;
+    // keep the damage events of the last frames
+    while (next < end + 200 * BENCH_MS) {
+	while ((event = BenchEvent(next))) {
+	    if (BENCH_EVENT_TYPE(event) ==
+		damage_ext->first_event + XCB_DAMAGE_NOTIFY) {
+		if (last && intervals < Fps * Seconds) {
+		    samples[intervals++] = (BenchNow() - last) / 1e6;
+		}
+		last = BenchNow();
+		++shown;
+		xcb_damage_subtract(Connection, damage, XCB_NONE, XCB_NONE);
+		xcb_flush(Connection);
+	    }
+	    free(event);
+	}
+	if (next < end) {
+	    pixels = WmdiaFeedBegin(feed);
+	    for (y = 0; y < WMDIA_FEED_HEIGHT; ++y) {
+		for (x = 0; x < WMDIA_FEED_WIDTH; ++x) {
+		    pixels[y * WMDIA_FEED_WIDTH + x] =
+			((x + produced) & 0xFF) << 16 | ((y + produced) & 0xFF)
+			<< 8 | ((x ^ y) + produced * 7) % 0xFF;
+		}
+	    }
+	    WmdiaFeedCommit(feed);
+	    ++produced;
+	}
+	next += period;
+    }
+    BenchUsageEnd(pid, &usage);
+    xcb_damage_destroy(Connection, damage);
+    munmap(feed, WMDIA_FEED_SIZE);
+    close(WmdiaFeedFd);
+    BenchStop(pid, &window, 1);
+
+    BenchBegin("feed");
+    printf("\"fps_target\": %d, \"produced\": %d, \"shown\": %d, "
+	"\"dropped\": %d, \"fps\": %.2f, ", Fps, produced, shown,
+	produced > shown ? produced - shown : 0, shown / (double)Seconds);
+    BenchLatency("interval_", samples, intervals);
+    BenchEnd(&usage);
+    free(samples);
+}
+
+//----------------------------------------------------------------------------
+//	Main
+//----------------------------------------------------------------------------
+
+///
+///	Table of all scenarios.
+///
+static const struct
+{
+    const char *Name;			///< name of the scenario
+    void (*Run) (void);			///< run the scenario
+} BenchScenarios[] = {
+    {"startup", BenchStartup},
+    {"tooltip", BenchTooltip},
+    {"click", BenchClick},
+    {"slides", BenchSlides},
+    {"feed", BenchFeed},
+};
+
+/**
+**	Print usage.
+*/
+static void PrintUsage(void)
+{
+    printf("Usage: wmdiabench [-w wmdia] [-n runs] [-f fps] [-s seconds]\n"
+	"\t[-i slides] [scenario...]\n"
+	"\t-w wmdia\twmdia executable (default ./wmdia)\n"
+	"\t-n runs\tSamples of latency scenarios (default %d)\n"
+	"\t-f fps\tFrame rate of the feed scenario (default %d)\n"
+	"\t-s seconds\tDuration of the feed scenario (default %d)\n"
+	"\t-i slides\tNumber of generated slides (default %d)\n"
+	"\tscenarios: startup tooltip click slides feed (default all)\n"
+	"Runs wmdia on $DISPLAY, use bench.sh for a private Xvfb.\n",
+	BENCH_RUNS, BENCH_FPS, BENCH_SECONDS, BENCH_SLIDES);
+}
+
+/**
+**	Main entry point.
+**
+**	@param argc	number of arguments
+**	@param argv	arguments vector
+**
+**	@returns 0 if all scenarios were run.
+*/
+int main(int argc, char *const argv[])
+{
+    const xcb_query_extension_reply_t *test_ext;
+    uint32_t mask;
+    int run;
+    int i;
+    int j;
+
+    for (;;) {
+	switch (getopt(argc, argv, "h?f:i:n:s:w:N:")) {
+	    case 'f':
+		Fps = atoi(optarg);
+		continue;
+	    case 'i':
+		Slides = atoi(optarg);
+		continue;
+	    case 'n':
+		Runs = atoi(optarg);
+		continue;
+	    case 's':
+		Seconds = atoi(optarg);
+		continue;
+	    case 'w':
+		Wmdia = optarg;
+		continue;
+	    case 'N':			// started by the click scenario
+		return BenchNotify(optarg);
+	    case EOF:
+		break;
+	    default:
+		PrintUsage();
+		return 0;
+	}
+	break;
+    }
+    if (Runs < 1 || Fps < 1 || Seconds < 1 || Slides < 1) {
+	PrintUsage();
+	return -1;
+    }
+    if (!(Dir = getenv("XDG_RUNTIME_DIR"))) {
+	Dir = "/tmp";
+    }
+    snprintf(Name, sizeof(Name), "bench%d", (int)getpid());
+
+    Connection = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(Connection)) {
+	fprintf(stderr, "wmdiabench: can't open display\n");
+	return -1;
+    }
+    Screen = xcb_setup_roots_iterator(xcb_get_setup(Connection)).data;
+    test_ext = xcb_get_extension_data(Connection, &xcb_test_id);
+    if (!test_ext || !test_ext->present) {
+	fprintf(stderr, "wmdiabench: no XTEST extension\n");
+	return -1;
+    }
+    // map and configure of all top level windows
+    mask = XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+    xcb_change_window_attributes(Connection, Screen->root,
+	XCB_CW_EVENT_MASK, &mask);
+    TooltipAtom = BenchAtom("TOOLTIP");
+    CommandAtom = BenchAtom("COMMAND");
+
+    printf("{\n  \"version\": \"%s\", \"git\": \"%s\", \"runs\": %d",
+	VERSION,
+#ifdef GIT_REV
+	GIT_REV,
+#else
+	"",
+#endif
+	Runs);
+    Fields = 1;
+
+    for (i = 0; i < (int)(sizeof(BenchScenarios) / sizeof(*BenchScenarios));
+	++i) {
+	run = optind == argc;
+	for (j = optind; j < argc; ++j) {
+	    run |= !strcmp(argv[j], BenchScenarios[i].Name);
+	}
+	if (run) {
+	    BenchScenarios[i].Run();
+	}
+    }
+    printf("\n}\n");
+
+    xcb_disconnect(Connection);
+    return 0;
+}
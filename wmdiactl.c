@@ -0,0 +1,152 @@
+///
+///	@file wmdiactl.c	@brief	Control client of the wmdia dockapp
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Wmdiactl The control client.
+///
+///	Sends its arguments as one batch to the control socket of a dock
+///	(wmdia -S) and prints the answer:
+///
+///		wmdiactl [-n name] 'image a.jpg' 'tooltip a.jpg' 'command feh a.jpg'
+///
+///	The argument "raw" sends a 64x64 BGRX frame read from stdin,
+///	"stats" prints the runtime statistics of wmdia after "ok".
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define RAW_SIZE (64 * 64 * 4)		///< bytes of a raw frame
+
+/**
+**	Write all bytes.
+**
+**	@param fd	socket
+**	@param buf	bytes to write
+**	@param len	number of bytes
+**
+**	@returns -1 on error, 0 otherwise.
+*/
+static int WriteAll(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+	if ((n = write(fd, buf, len)) <= 0) {
+	    return -1;
+	}
+	buf += n;
+	len -= n;
+    }
+    return 0;
+}
+
+/**
+**	Main entry point.
+**
+**	@param argc	number of arguments
+**	@param argv	arguments vector
+**
+**	@returns 0 if the batch was applied.
+*/
+int main(int argc, char *const argv[])
+{
+    struct sockaddr_un addr;
+    const char *name;
+    const char *dir;
+    char buf[RAW_SIZE];
+    ssize_t n;
+    int fd;
+    int i;
+
+    name = "wmdia";
+    for (;;) {
+	switch (getopt(argc, argv, "h?n:")) {
+	    case 'n':
+		name = optarg;
+		continue;
+	    case EOF:
+		break;
+	    default:
+		printf("Usage: wmdiactl [-n name] command...\n"
+		    "\tcommands: 'image path' raw 'tooltip text' 'command text'"
+		    " next prev stats\n");
+		return 0;
+	}
+	break;
+    }
+    if (!(dir = getenv("XDG_RUNTIME_DIR"))) {
+	dir = "/tmp";
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/wmdia-%s.sock",
+	    dir, name) >= (int)sizeof(addr.sun_path)) {
+	fprintf(stderr, "wmdiactl: socket name too long\n");
+	return -1;
+    }
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+	|| connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+	fprintf(stderr, "wmdiactl: can't connect '%s'\n", addr.sun_path);
+	return -1;
+    }
+
+    for (i = optind; i < argc; ++i) {
+	if (WriteAll(fd, argv[i], strlen(argv[i])) || WriteAll(fd, "\n", 1)) {
+	    return -1;
+	}
+	if (!strcmp(argv[i], "raw")) {
+	    if (fread(buf, 1, RAW_SIZE, stdin) != RAW_SIZE
+		|| WriteAll(fd, buf, RAW_SIZE)) {
+		fprintf(stderr, "wmdiactl: short raw frame\n");
+		return -1;
+	    }
+	}
+    }
+    if (WriteAll(fd, "\n", 1)) {	// end of batch
+	return -1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    // the reply ends with the connection, stats are more than one read
+    n = 0;
+    while (n < (ssize_t) sizeof(buf) - 1
+	&& (i = read(fd, buf + n, sizeof(buf) - 1 - n)) > 0) {
+	n += i;
+    }
+    close(fd);
+    if (n <= 0) {
+	return -1;
+    }
+    buf[n] = '\0';
+    fputs(buf, strncmp(buf, "ok", 2) ? stderr : stdout);
+
+    return strncmp(buf, "ok", 2) ? -1 : 0;
+}
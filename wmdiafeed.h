@@ -0,0 +1,186 @@
+///
+///	@file wmdiafeed.h	@brief	DIA Dockapp frame feed API
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Feed
+/// @{
+///
+///	Frame feed shared with producers.
+///
+///	wmdia -F creates the POSIX shared memory object "/wmdia-<name>" with
+///	a #WmdiaFeed header followed by #WMDIA_FEED_FRAMES frames of 64x64
+///	BGRX pixels, and the wakeup fifo "$XDG_RUNTIME_DIR/wmdia-<name>.feed"
+///	(/tmp if XDG_RUNTIME_DIR isn't set).
+///
+///	A producer writes into the frame after the ready frame, guarded by
+///	the frame sequence (odd while written), publishes it with Ready and
+///	Sequence and writes one byte into the fifo.  wmdia shows only the
+///	newest frame, older frames are overwritten and dropped.
+///
+///	With the X Present extension, wmdia writes the sequence of the
+///	newest frame on screen into Presented and its presentation time
+///	into PresentedUst (CLOCK_MONOTONIC microseconds), PresentedUst
+///	first.  Both stay 0 without Present.
+///
+///	The layout is fixed by the defines below, neither side trusts the
+///	layout fields of the shared header.
+///
+///	@code
+///	WmdiaFeed *feed = WmdiaFeedOpen("wmdia");
+///	for (;;) {
+///	    uint32_t *pixels = WmdiaFeedBegin(feed);
+///	    render(pixels);
+///	    WmdiaFeedCommit(feed);
+///	}
+///	@endcode
+///
+
+#include <stdint.h>
+
+#define WMDIA_FEED_MAGIC	0x46444D57	///< "WMDF" little endian
+#define WMDIA_FEED_VERSION	2	///< version of the feed layout
+#define WMDIA_FEED_FRAMES	4	///< frames in the ring
+#define WMDIA_FEED_WIDTH	64	///< width of a frame
+#define WMDIA_FEED_HEIGHT	64	///< height of a frame
+
+///
+///	Frame feed header.
+///
+typedef struct _wmdia_feed_
+{
+    uint32_t Magic;			///< #WMDIA_FEED_MAGIC
+    uint32_t Version;			///< #WMDIA_FEED_VERSION
+    uint32_t Width;			///< frame width in pixels
+    uint32_t Height;			///< frame height in pixels
+    uint32_t Stride;			///< bytes per frame line
+    uint32_t Frames;			///< number of frames in ring
+    uint32_t Offset;			///< byte offset of first frame
+
+    uint32_t Ready;			///< index of newest complete frame
+    uint32_t Sequence;			///< number of completed frames
+    uint32_t FrameSequence[WMDIA_FEED_FRAMES];	///< odd while written
+
+    uint32_t Presented;			///< sequence of newest presented frame
+    uint64_t PresentedUst;		///< its presentation time in us
+} WmdiaFeed;
+
+    /// size of the shared memory object
+#define WMDIA_FEED_SIZE	(sizeof(WmdiaFeed) + WMDIA_FEED_FRAMES \
+	* WMDIA_FEED_WIDTH * WMDIA_FEED_HEIGHT * 4)
+
+#ifndef WMDIA_FEED_NO_PRODUCER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+
+static int WmdiaFeedFd = -1;		///< wakeup fifo of the producer
+static uint32_t WmdiaFeedNext;		///< frame written by the producer
+
+/**
+**	Open the frame feed of a running wmdia.
+**
+**	@param name	window name of wmdia (-n name)
+**
+**	@returns mapped frame feed, NULL on error.
+*/
+static inline WmdiaFeed *WmdiaFeedOpen(const char *name)
+{
+    char path[256];
+    const char *dir;
+    WmdiaFeed *feed;
+    int fd;
+
+    snprintf(path, sizeof(path), "/wmdia-%s", name);
+    if ((fd = shm_open(path, O_RDWR, 0)) < 0) {
+	return NULL;
+    }
+    feed = mmap(NULL, WMDIA_FEED_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+	fd, 0);
+    close(fd);
+    if (feed == MAP_FAILED) {
+	return NULL;
+    }
+    if (feed->Magic != WMDIA_FEED_MAGIC
+	|| feed->Version != WMDIA_FEED_VERSION
+	|| feed->Stride != WMDIA_FEED_WIDTH * 4
+	|| feed->Frames != WMDIA_FEED_FRAMES
+	|| feed->Offset != sizeof(WmdiaFeed)) {
+	munmap(feed, WMDIA_FEED_SIZE);
+	return NULL;
+    }
+
+    if (!(dir = getenv("XDG_RUNTIME_DIR"))) {
+	dir = "/tmp";
+    }
+    snprintf(path, sizeof(path), "%s/wmdia-%s.feed", dir, name);
+    WmdiaFeedFd = open(path, O_WRONLY | O_NONBLOCK);
+
+    return feed;
+}
+
+/**
+**	Begin a new frame.
+**
+**	@param feed	frame feed
+**
+**	@returns pixels of the frame to write, #WMDIA_FEED_WIDTH per line.
+*/
+static inline uint32_t *WmdiaFeedBegin(WmdiaFeed * feed)
+{
+    WmdiaFeedNext =
+	(__atomic_load_n(&feed->Ready, __ATOMIC_ACQUIRE) + 1)
+	% WMDIA_FEED_FRAMES;
+    __atomic_add_fetch(&feed->FrameSequence[WmdiaFeedNext], 1,
+	__ATOMIC_ACQ_REL);
+    return (uint32_t *) ((uint8_t *) feed + sizeof(WmdiaFeed) +
+	WmdiaFeedNext * WMDIA_FEED_WIDTH * 4 * WMDIA_FEED_HEIGHT);
+}
+
+/**
+**	Commit the frame and wakeup wmdia.
+**
+**	@param feed	frame feed
+*/
+static inline void WmdiaFeedCommit(WmdiaFeed * feed)
+{
+    __atomic_add_fetch(&feed->FrameSequence[WmdiaFeedNext], 1,
+	__ATOMIC_RELEASE);
+    __atomic_store_n(&feed->Ready, WmdiaFeedNext, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&feed->Sequence, 1, __ATOMIC_RELEASE);
+    if (WmdiaFeedFd >= 0) {
+	ssize_t n;
+
+	// full fifo is fine, wmdia is already woken up
+	n = write(WmdiaFeedFd, "", 1);
+	(void)n;
+    }
+}
+
+#endif
+
+/// @}
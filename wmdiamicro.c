@@ -0,0 +1,592 @@
+///
+///	@file wmdiamicro.c	@brief	Kernel microbenchmark of the wmdia dockapp
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Wmdiamicro The kernel microbenchmark.
+///
+///	Times the per pixel kernels of the pixel and scale modules on
+///	synthetic inputs, without X11 server:
+///
+///	- xpm32 xpm16 xpm8: XPM row conversion and mask into 32/16/8 bpp
+///	- scale: area-averaging scaler of RGB images into a dia
+///	- diff: tile compare of live frames
+///	- bgrx rgb24 yuv420: raw frame formats into 32bit pixels of a
+///	  native (0x00RRGGBB) and a 16bit (RGB565) visual
+///
+///	All supported variants of a kernel (c, sse2, avx2) are run side by
+///	side and checked against the scalar reference.  Each case is
+///	repeated until a batch takes some ms, the median of #MICRO_BATCHES
+///	batches is reported as cycles (TSC) and ns per pixel and as MB/s of
+///	input.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <xcb/xcb.h>
+#include <xcb/xcb_image.h>
+
+#include "wmdia.h"
+#include "frame.h"
+#include "pixel.h"
+#include "scale.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define MICRO_BATCHES	7		///< timed batches of each case
+#define MICRO_BATCH_MS	20		///< default min. time of a batch
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+int NativeRgb;				///< visual pixels are 0x00RRGGBB
+
+static int BatchMs = MICRO_BATCH_MS;	///< min. time of a batch
+static int Json;			///< write JSON lines
+
+static int Width;			///< width of current case
+static int Height;			///< height of current case
+static int Bpp;				///< bits per pixel of current case
+static uint8_t *Src;			///< input of current case
+static uint8_t *Dst;			///< output of current case
+static uint32_t Table[256];		///< XPM character to pixel
+static uint8_t None[256];		///< XPM character is transparent
+static FrameDiffFunc *Diff;		///< tile compare of current case
+static volatile uint64_t Sink;		///< keeps results alive
+
+//----------------------------------------------------------------------------
+//	Visual
+//----------------------------------------------------------------------------
+
+/**
+**	Scale 8bit color component to visual mask.
+**
+**	Same calculation as wmdia for non native visuals.
+**
+**	@param c	8bit color component
+**	@param mask	visual color mask
+*/
+static inline uint32_t MaskColor(int c, uint32_t mask)
+{
+    int shift;
+    int bits;
+
+    shift = __builtin_ctz(mask);
+    bits = __builtin_popcount(mask);
+    if (bits < 8) {
+	c >>= 8 - bits;
+    } else {
+	c = (c << (bits - 8)) | (c >> (16 - bits));
+    }
+    return ((uint32_t) c << shift) & mask;
+}
+
+/**
+**	Convert 8bit RGB to pixel of a RGB565 visual.
+**
+**	@param r	red component
+**	@param g	green component
+**	@param b	blue component
+*/
+uint32_t RgbPixel(int r, int g, int b)
+{
+    return MaskColor(r, 0xF800) | MaskColor(g, 0x07E0) | MaskColor(b,
+	0x001F);
+}
+
+//----------------------------------------------------------------------------
+//	Timing
+//----------------------------------------------------------------------------
+
+/**
+**	Get monotonic time.
+**
+**	@returns time in ns.
+*/
+static uint64_t MicroNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+**	Read cycle counter.
+**
+**	@returns time stamp counter, 0 if there is none.
+*/
+static inline uint64_t MicroCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+**	Compare two batch times for qsort.
+*/
+static int MicroCompare(const void *a, const void *b)
+{
+    return *(const uint64_t *)a < *(const uint64_t *)b ? -1 :
+	*(const uint64_t *)a > *(const uint64_t *)b;
+}
+
+/**
+**	Time a case and print its result line.
+**
+**	@param kernel	name of the kernel
+**	@param variant	name of the kernel variant
+**	@param label	input size and format of the case
+**	@param pixels	pixels processed by one call
+**	@param bytes	input bytes of one call
+**	@param func	run the case once
+*/
+static void MicroRun(const char *kernel, const char *variant,
+    const char *label, long pixels, long bytes, void (*func) (void))
+{
+    uint64_t ns[MICRO_BATCHES];
+    uint64_t cycles[MICRO_BATCHES];
+    uint64_t start;
+    uint64_t tsc;
+    double cpp;
+    double npp;
+    double mbs;
+    long n;
+    long i;
+    int b;
+
+    // calibrate, also warms caches and branch predictors
+    for (n = 1;; n *= 2) {
+	start = MicroNow();
+	for (i = 0; i < n; ++i) {
+	    func();
+	}
+	if (MicroNow() - start >= BatchMs * 1000000ULL || n >= 1L << 30) {
+	    break;
+	}
+    }
+    for (b = 0; b < MICRO_BATCHES; ++b) {
+	start = MicroNow();
+	tsc = MicroCycles();
+	for (i = 0; i < n; ++i) {
+	    func();
+	}
+	cycles[b] = MicroCycles() - tsc;
+	ns[b] = MicroNow() - start;
+    }
+    qsort(ns, MICRO_BATCHES, sizeof(*ns), MicroCompare);
+    qsort(cycles, MICRO_BATCHES, sizeof(*cycles), MicroCompare);
+
+    cpp = (double)cycles[MICRO_BATCHES / 2] / n / pixels;
+    npp = (double)ns[MICRO_BATCHES / 2] / n / pixels;
+    mbs = (double)bytes * n * 1000 / ns[MICRO_BATCHES / 2];
+    if (Json) {
+	printf("{\"kernel\": \"%s\", \"variant\": \"%s\", \"case\": \"%s\", "
+	    "\"cycles_per_pixel\": %.3f, \"ns_per_pixel\": %.3f, "
+	    "\"mb_per_s\": %.1f}\n", kernel, variant, label, cpp, npp, mbs);
+    } else {
+	printf("%-7s %-5s %-16s %10.3f %10.3f %10.1f\n", kernel, variant,
+	    label, cpp, npp, mbs);
+    }
+    fflush(stdout);
+}
+
+/**
+**	Fill buffer with pseudo random bytes.
+**
+**	@param buf	buffer
+**	@param n	number of bytes
+*/
+static void MicroRandom(uint8_t * buf, long n)
+{
+    uint32_t seed;
+    long i;
+
+    seed = 0x12345678;
+    for (i = 0; i < n; ++i) {
+	seed = seed * 1103515245 + 12345;
+	buf[i] = seed >> 16;
+    }
+}
+
+//----------------------------------------------------------------------------
+//	XPM
+//----------------------------------------------------------------------------
+
+/**
+**	Convert the XPM image of the case.
+*/
+static void MicroXpm(void)
+{
+    int stride;
+    int y;
+
+    stride = Width * Bpp / 8;
+    for (y = 0; y < Height; ++y) {
+	PixelXpmRow(Dst + y * stride, Bpp, (const char *)Src + y * Width,
+	    Table, Width);
+	PixelXpmMask(Dst + Height * stride + y * ((Width + 7) / 8),
+	    (const char *)Src + y * Width, None, Width);
+    }
+}
+
+/**
+**	XPM conversion into 32, 16 and 8 bpp images.
+**
+**	16 colors and one transparent color, like the dock icon.
+*/
+static void MicroXpmAll(void)
+{
+    static const int sizes[] = { 64, 256, 1024 };
+    static const int bpps[] = { 32, 16, 8 };
+    char kernel[16];
+    char label[32];
+    int s;
+    int b;
+    long i;
+
+    for (i = 0; i < 256; ++i) {
+	Table[i] = i * 0x010101;
+	None[i] = i == '.';
+    }
+    for (b = 0; b < 3; ++b) {
+	for (s = 0; s < 3; ++s) {
+	    Width = Height = sizes[s];
+	    Bpp = bpps[b];
+	    Src = malloc(Width * Height);
+	    Dst = malloc(Width * Height * 4 + Height * ((Width + 7) / 8));
+	    MicroRandom(Src, Width * Height);
+	    for (i = 0; i < Width * Height; ++i) {
+		Src[i] = ".abcdefghijklmno"[Src[i] & 15];
+	    }
+	    snprintf(kernel, sizeof(kernel), "xpm%d", Bpp);
+	    snprintf(label, sizeof(label), "%dx%d", Width, Height);
+	    MicroRun(kernel, "c", label, Width * Height, Width * Height,
+		MicroXpm);
+	    free(Src);
+	    free(Dst);
+	}
+    }
+}
+
+//----------------------------------------------------------------------------
+//	Scale
+//----------------------------------------------------------------------------
+
+/**
+**	Scale the RGB image of the case into a dia.
+*/
+static void MicroScale(void)
+{
+    Scaler scaler;
+    int y;
+
+    if (ScalerInitDia(&scaler, Width, Height, (uint32_t *) Dst, DIA_SIZE)) {
+	abort();
+    }
+    for (y = 0; y < Height; ++y) {
+	ScalerPutRow(&scaler, Src + y * Width * 3);
+    }
+    ScalerExit(&scaler);
+}
+
+/**
+**	Scaler with all accumulate kernels.
+*/
+static void MicroScaleAll(void)
+{
+    static const int sizes[][2] = {
+	{320, 240}, {640, 480}, {1920, 1080}, {4000, 3000}
+    };
+    uint32_t reference[DIA_SIZE * DIA_SIZE];
+    char label[32];
+    int s;
+    int k;
+
+    NativeRgb = 1;
+    Dst = malloc(DIA_SIZE * DIA_SIZE * 4);
+    for (s = 0; s < 4; ++s) {
+	Width = sizes[s][0];
+	Height = sizes[s][1];
+	Src = malloc(Width * Height * 3);
+	MicroRandom(Src, Width * Height * 3);
+	snprintf(label, sizeof(label), "%dx%d", Width, Height);
+	for (k = 0; ScaleKernels[k].Name; ++k) {
+	    if (!ScaleKernels[k].Supported()) {
+		continue;
+	    }
+	    ScaleAccumulate = ScaleKernels[k].Accumulate;
+	    MicroScale();
+	    if (!k) {
+		memcpy(reference, Dst, sizeof(reference));
+	    } else if (memcmp(reference, Dst, sizeof(reference))) {
+		fprintf(stderr, "wmdiamicro: scale %s differs from c\n",
+		    ScaleKernels[k].Name);
+	    }
+	    MicroRun("scale", ScaleKernels[k].Name, label, Width * Height,
+		Width * Height * 3, MicroScale);
+	}
+	free(Src);
+    }
+    free(Dst);
+    ScaleAccumulate = ScaleKernels[0].Accumulate;
+}
+
+//----------------------------------------------------------------------------
+//	Diff
+//----------------------------------------------------------------------------
+
+/**
+**	Compare the frames of the case.
+*/
+static void MicroDiff(void)
+{
+    Sink += Diff((const uint32_t *)Src, (const uint32_t *)Dst, DOCK_SIZE);
+}
+
+/**
+**	Tile compare with all kernels.
+**
+**	Equal frames compare all pixels, changed frames have one changed
+**	pixel in each tile, the last case only the last pixel changed.
+*/
+static void MicroDiffAll(void)
+{
+    static const char *const labels[] = { "equal", "all-tiles", "last-pixel" };
+    uint64_t reference;
+    uint32_t *frame;
+    int c;
+    int k;
+    int i;
+
+    Src = malloc(DOCK_SIZE * DOCK_SIZE * 4);
+    Dst = malloc(DOCK_SIZE * DOCK_SIZE * 4);
+    MicroRandom(Src, DOCK_SIZE * DOCK_SIZE * 4);
+    for (c = 0; c < 3; ++c) {
+	memcpy(Dst, Src, DOCK_SIZE * DOCK_SIZE * 4);
+	frame = (uint32_t *) Dst;
+	if (c == 1) {
+	    for (i = 0; i < DOCK_SIZE * DOCK_SIZE; i += FRAME_TILE + 1) {
+		frame[i] ^= 1;
+	    }
+	} else if (c == 2) {
+	    frame[DOCK_SIZE * DOCK_SIZE - 1] ^= 1;
+	}
+	reference = 0;
+	for (k = 0; PixelDiffKernels[k].Name; ++k) {
+	    if (!PixelDiffKernels[k].Supported()) {
+		continue;
+	    }
+	    Diff = PixelDiffKernels[k].Diff;
+	    if (!k) {
+		reference = Diff((uint32_t *) Src, frame, DOCK_SIZE);
+	    } else if (Diff((uint32_t *) Src, frame, DOCK_SIZE) != reference) {
+		fprintf(stderr, "wmdiamicro: diff %s differs from c\n",
+		    PixelDiffKernels[k].Name);
+	    }
+	    MicroRun("diff", PixelDiffKernels[k].Name, labels[c],
+		DOCK_SIZE * DOCK_SIZE, DOCK_SIZE * DOCK_SIZE * 4 * 2,
+		MicroDiff);
+	}
+    }
+    free(Src);
+    free(Dst);
+}
+
+//----------------------------------------------------------------------------
+//	Raw frame formats
+//----------------------------------------------------------------------------
+
+/**
+**	Convert BGRX frame of the case.
+*/
+static void MicroBGRX(void)
+{
+    PixelFromBGRX((uint32_t *) Dst, Src, Width * Height);
+}
+
+/**
+**	Convert RGB24 frame of the case.
+*/
+static void MicroRGB24(void)
+{
+    PixelFromRGB24((uint32_t *) Dst, Src, Width * Height);
+}
+
+/**
+**	Convert YUV 4:2:0 frame of the case.
+*/
+static void MicroYUV420(void)
+{
+    PixelFromYUV420((uint32_t *) Dst, Src, Width, Height);
+}
+
+/**
+**	Raw frame formats into native and RGB565 visuals.
+*/
+static void MicroFormatAll(void)
+{
+    static const int sizes[] = { 64, 256, 1024 };
+    static const struct
+    {
+	const char *Name;		///< pixel format
+	int Bytes;			///< input bytes of 2 pixels
+	void (*Func) (void);		///< convert the case
+    } formats[] = {
+	{"bgrx", 8, MicroBGRX},
+	{"rgb24", 6, MicroRGB24},
+	{"yuv420", 3, MicroYUV420},
+    };
+    char label[32];
+    int f;
+    int s;
+    int v;
+
+    for (f = 0; f < 3; ++f) {
+	for (v = 1; v >= 0; --v) {
+	    NativeRgb = v;
+	    for (s = 0; s < 3; ++s) {
+		Width = Height = sizes[s];
+		Src = malloc(Width * Height * 4);
+		Dst = malloc(Width * Height * 4);
+		MicroRandom(Src, Width * Height * 4);
+		snprintf(label, sizeof(label), "%dx%d %s", Width, Height,
+		    v ? "native" : "rgb565");
+		MicroRun(formats[f].Name, "c", label, Width * Height,
+		    Width * Height * formats[f].Bytes / 2, formats[f].Func);
+		free(Src);
+		free(Dst);
+	    }
+	}
+    }
+    NativeRgb = 1;
+}
+
+//----------------------------------------------------------------------------
+//	Main
+//----------------------------------------------------------------------------
+
+///
+///	Table of all kernel groups.
+///
+static const struct
+{
+    const char *Name;			///< name of the group
+    void (*Run) (void);			///< run all cases of the group
+} MicroGroups[] = {
+    {"xpm", MicroXpmAll},
+    {"scale", MicroScaleAll},
+    {"diff", MicroDiffAll},
+    {"format", MicroFormatAll},
+};
+
+/**
+**	Print usage.
+*/
+static void PrintUsage(void)
+{
+    printf("Usage: wmdiamicro [-j] [-t ms] [group...]\n"
+	"\t-j\tWrite one JSON object per line\n"
+	"\t-t ms\tMin. time of a timed batch (default %d)\n"
+	"\tgroups: xpm scale diff format (default all)\n",
+	MICRO_BATCH_MS);
+}
+
+/**
+**	Main entry point.
+**
+**	@param argc	number of arguments
+**	@param argv	arguments vector
+**
+**	@returns 0 if all groups were run.
+*/
+int main(int argc, char *const argv[])
+{
+    int run;
+    int i;
+    int j;
+
+    for (;;) {
+	switch (getopt(argc, argv, "h?jt:")) {
+	    case 'j':
+		Json = 1;
+		continue;
+	    case 't':
+		BatchMs = atoi(optarg);
+		continue;
+	    case EOF:
+		break;
+	    default:
+		PrintUsage();
+		return 0;
+	}
+	break;
+    }
+    if (BatchMs < 1) {
+	PrintUsage();
+	return -1;
+    }
+    for (j = optind; j < argc; ++j) {
+	for (i = 0; i < (int)(sizeof(MicroGroups) / sizeof(*MicroGroups));
+	    ++i) {
+	    if (!strcmp(argv[j], MicroGroups[i].Name)) {
+		break;
+	    }
+	}
+	if (i == (int)(sizeof(MicroGroups) / sizeof(*MicroGroups))) {
+	    fprintf(stderr, "wmdiamicro: unknown group '%s'\n", argv[j]);
+	    return -1;
+	}
+    }
+
+    if (!Json) {
+	printf("%-7s %-5s %-16s %10s %10s %10s\n", "kernel", "var", "case",
+	    "cycles/px", "ns/px", "MB/s");
+    }
+    for (i = 0; i < (int)(sizeof(MicroGroups) / sizeof(*MicroGroups)); ++i) {
+	run = optind == argc;
+	for (j = optind; j < argc; ++j) {
+	    run |= !strcmp(argv[j], MicroGroups[i].Name);
+	}
+	if (run) {
+	    MicroGroups[i].Run();
+	}
+    }
+
+    return 0;
+}
@@ -0,0 +1,254 @@
+///
+///	@file wmdiatest.c	@brief	Kernel conformance test of the wmdia dockapp
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Wmdiatest The kernel conformance test.
+///
+///	Checks that every SIMD accumulate kernel of the scaler (sse2, avx2)
+///	supported by the cpu gives exactly the results of the scalar
+///	reference, without X11 server:
+///
+///	- accumulate: all row lengths 0 - 300 (vector body and tail), all
+///	  weights 0 - 128, unaligned rows and sums
+///	- scaler: images of many sizes, up- and downscaled into a dia, for
+///	  a native (0x00RRGGBB) and a 16bit (RGB565) visual
+///
+///	Unsupported kernels are reported as skipped.  The exit code is the
+///	number of failed cases, make test fails on any mismatch.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <xcb/xcb.h>
+
+#include "wmdia.h"
+#include "scale.h"
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#define TEST_ROW	300		///< max. row length of accumulate
+#define TEST_WEIGHT	128		///< max. weight of accumulate
+
+//----------------------------------------------------------------------------
+//	Variables
+//----------------------------------------------------------------------------
+
+int NativeRgb;				///< visual pixels are 0x00RRGGBB
+
+static int Failed;			///< number of failed cases
+
+//----------------------------------------------------------------------------
+//	Visual
+//----------------------------------------------------------------------------
+
+/**
+**	Convert 8bit RGB to pixel of a RGB565 visual.
+**
+**	@param r	red component
+**	@param g	green component
+**	@param b	blue component
+*/
+uint32_t RgbPixel(int r, int g, int b)
+{
+    return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+//----------------------------------------------------------------------------
+//	Test
+//----------------------------------------------------------------------------
+
+/**
+**	Fill buffer with pseudo random bytes.
+**
+**	@param buf	buffer
+**	@param n	number of bytes
+**	@param seed	start of the sequence
+*/
+static void TestRandom(uint8_t * buf, long n, uint32_t seed)
+{
+    long i;
+
+    for (i = 0; i < n; ++i) {
+	seed = seed * 1103515245 + 12345;
+	buf[i] = seed >> 16;
+    }
+}
+
+/**
+**	Report failed case.
+**
+**	Only the first failures are printed.
+**
+**	@param kernel	name of the kernel
+**	@param what	case of the failure
+*/
+static void TestFail(const char *kernel, const char *what)
+{
+    if (Failed++ < 10) {
+	fprintf(stderr, "wmdiatest: %s differs from c: %s\n", kernel, what);
+    }
+}
+
+/**
+**	Check accumulate kernel against the scalar reference.
+**
+**	The row and the sums start at every offset of a vector, the sums
+**	beyond the row must stay untouched.
+**
+**	@param kernel	accumulate kernel to check
+*/
+static void TestAccumulate(const ScaleKernel * kernel)
+{
+    uint8_t row[TEST_ROW + 32];
+    uint32_t reference[TEST_ROW + 40];
+    uint32_t accu[TEST_ROW + 40];
+    char what[64];
+    int align;
+    int n;
+    int w;
+    int i;
+
+    TestRandom(row, sizeof(row), 0x12345678);
+    for (align = 0; align < 8; ++align) {
+	for (n = 0; n <= TEST_ROW; ++n) {
+	    for (w = 0; w <= TEST_WEIGHT; ++w) {
+		for (i = 0; i < TEST_ROW + 40; ++i) {
+		    reference[i] = accu[i] = i * 1000 + w;
+		}
+		ScaleKernels[0].Accumulate(reference + align, row + align, n,
+		    w);
+		kernel->Accumulate(accu + align, row + align, n, w);
+		if (memcmp(reference, accu, sizeof(accu))) {
+		    snprintf(what, sizeof(what),
+			"accumulate n=%d weight=%d align=%d", n, w, align);
+		    TestFail(kernel->Name, what);
+		}
+	    }
+	}
+    }
+}
+
+/**
+**	Scale image into dia with the selected kernel.
+**
+**	@param src	RGB image
+**	@param width	image width
+**	@param height	image height
+**	@param[out] dia	#DIA_SIZE x #DIA_SIZE pixels
+*/
+static void TestScaleImage(const uint8_t * src, int width, int height,
+    uint32_t * dia)
+{
+    Scaler scaler;
+    int y;
+
+    memset(dia, 0, DIA_SIZE * DIA_SIZE * sizeof(*dia));
+    if (ScalerInitDia(&scaler, width, height, dia, DIA_SIZE)) {
+	return;
+    }
+    for (y = 0; y < height; ++y) {
+	ScalerPutRow(&scaler, src + y * width * 3);
+    }
+    ScalerExit(&scaler);
+}
+
+/**
+**	Check the scaler with a kernel against the scalar reference.
+**
+**	@param kernel	accumulate kernel to check
+*/
+static void TestScaler(const ScaleKernel * kernel)
+{
+    static const int sizes[] = {
+	1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 61, 62, 63, 64, 65, 100, 127,
+	128, 129, 255, 256, 257, 640, 1001
+    };
+    uint32_t reference[DIA_SIZE * DIA_SIZE];
+    uint32_t dia[DIA_SIZE * DIA_SIZE];
+    char what[64];
+    uint8_t *src;
+    int n;
+    int w;
+    int h;
+
+    n = sizeof(sizes) / sizeof(*sizes);
+    for (NativeRgb = 0; NativeRgb < 2; ++NativeRgb) {
+	for (w = 0; w < n; ++w) {
+	    for (h = 0; h < n; ++h) {
+		if (!(src = malloc(sizes[w] * sizes[h] * 3))) {
+		    TestFail(kernel->Name, "out of memory");
+		    return;
+		}
+		TestRandom(src, sizes[w] * sizes[h] * 3, sizes[w] * 7919
+		    + sizes[h]);
+		ScaleAccumulate = ScaleKernels[0].Accumulate;
+		TestScaleImage(src, sizes[w], sizes[h], reference);
+		ScaleAccumulate = kernel->Accumulate;
+		TestScaleImage(src, sizes[w], sizes[h], dia);
+		if (memcmp(reference, dia, sizeof(dia))) {
+		    snprintf(what, sizeof(what), "scaler %dx%d %s", sizes[w],
+			sizes[h], NativeRgb ? "native" : "rgb565");
+		    TestFail(kernel->Name, what);
+		}
+		free(src);
+	    }
+	}
+    }
+    ScaleAccumulate = ScaleKernels[0].Accumulate;
+}
+
+//----------------------------------------------------------------------------
+//	Main
+//----------------------------------------------------------------------------
+
+/**
+**	Main entry point.
+**
+**	@returns number of failed cases.
+*/
+int main(void)
+{
+    int before;
+    int k;
+
+    for (k = 1; ScaleKernels[k].Name; ++k) {
+	if (!ScaleKernels[k].Supported()) {
+	    printf("scale %-5s skipped, not supported by cpu\n",
+		ScaleKernels[k].Name);
+	    continue;
+	}
+	before = Failed;
+	TestAccumulate(ScaleKernels + k);
+	TestScaler(ScaleKernels + k);
+	printf("scale %-5s %s\n", ScaleKernels[k].Name,
+	    Failed == before ? "ok" : "FAILED");
+    }
+
+    return Failed > 125 ? 125 : Failed;
+}
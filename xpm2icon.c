@@ -0,0 +1,142 @@
+///
+///	@file xpm2icon.c	@brief	Build tool: XPM to pixel data converter
+///
+///	Copyright (c) 2009 - 2011,2021 by Lutz Sammer.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of wmdia
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Xpm2Icon The XPM to icon converter.
+///
+///	Runs on the build host and writes the dock icon wmdia.xpm as C
+///	header to stdout: 32bit 0x00RRGGBB pixels and the shape bitmap
+///	(LSB first, rows padded to bytes).  wmdia uploads these without
+///	parsing the XPM and without any AllocColor round trip on TrueColor
+///	visuals.
+///
+///	Only the XPM subset of wmdia.xpm is supported: one character per
+///	pixel and "c #RRGGBB" or "c None" colors.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "wmdia.xpm"
+
+/**
+**	Parse one color line of the XPM.
+**
+**	@param line		color line "x c #RRGGBB"
+**	@param[out] rgb		0x00RRGGBB of the color
+**
+**	@returns true if the color is transparent.
+*/
+static int Xpm2IconColor(const char *line, uint32_t * rgb)
+{
+    const char *s;
+    char *end;
+
+    // the color key follows the pixel character
+    for (s = line + 1; (s = strchr(s, 'c')); ++s) {
+	if (s[-1] == ' ' || s[-1] == '\t') {
+	    break;
+	}
+    }
+    if (!s) {
+	fprintf(stderr, "xpm2icon: no color in \"%s\"\n", line);
+	exit(-1);
+    }
+    s += strspn(s + 1, " \t") + 1;
+    if (!strncasecmp(s, "none", 4)) {
+	*rgb = 0;
+	return 1;
+    }
+    if (*s != '#' || (*rgb = strtoul(s + 1, &end, 16), end != s + 7)) {
+	fprintf(stderr, "xpm2icon: unparsable color \"%s\"\n", line);
+	exit(-1);
+    }
+    return 0;
+}
+
+/**
+**	Main entry point.
+**
+**	@returns 0 if the header was written.
+*/
+int main(void)
+{
+    const char *const *data;
+    uint32_t rgb[256];
+    char none[256];
+    uint8_t *shape;
+    int w;
+    int h;
+    int colors;
+    int cpp;
+    int stride;
+    int x;
+    int y;
+    int i;
+    int c;
+
+    data = (const char *const *)wmdia_xpm;
+    if (sscanf(*data++, "%d %d %d %d", &w, &h, &colors, &cpp) != 4
+	|| cpp != 1 || colors < 1 || colors > 255) {
+	fprintf(stderr, "xpm2icon: unsupported XPM header\n");
+	return -1;
+    }
+    memset(rgb, 0, sizeof(rgb));
+    memset(none, 0, sizeof(none));
+    for (i = 0; i < colors; ++i) {
+	c = **data & 0xFF;
+	none[c] = Xpm2IconColor(*data++, rgb + c);
+    }
+
+    stride = (w + 7) / 8;
+    shape = calloc(h, stride);
+
+    printf("// generated by xpm2icon from wmdia.xpm, don't edit\n\n");
+    printf("#define ICON_WIDTH %d\t\t///< width of dock icon\n", w);
+    printf("#define ICON_HEIGHT %d\t\t///< height of dock icon\n\n", h);
+    printf("    /// dock icon 0x00RRGGBB pixels\n");
+    printf("static const uint32_t IconPixels[%d] = {", w * h);
+    for (y = 0; y < h; ++y) {
+	for (x = 0; x < w; ++x) {
+	    c = data[y][x] & 0xFF;
+	    if (!none[c]) {
+		shape[y * stride + x / 8] |= 1 << (x & 7);
+	    }
+	    printf("%s0x%06X,", (y * w + x) % 6 ? " " : "\n    ", rgb[c]);
+	}
+    }
+    printf("\n};\n\n");
+    printf("    /// dock icon shape, bit set for opaque pixels\n");
+    printf("static const uint8_t IconShape[%d] = {", h * stride);
+    for (i = 0; i < h * stride; ++i) {
+	printf("%s0x%02X,", i % 8 ? " " : "\n    ", shape[i]);
+    }
+    printf("\n};\n");
+    free(shape);
+
+    return 0;
+}